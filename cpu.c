@@ -29,10 +29,12 @@
 #include "cpu.h"
 #include "print.h"
 #include "schedule.h"
+#include "reduction.h"
 #include "util.h"
 
 #include "split_tiling.h"
 #include "overlapped_tiling.h"
+#include "stencil.h"
 
 /* Representation of a statement inside a generated AST.
  *
@@ -97,6 +99,8 @@ static FILE *get_output_file(const char *input, const char *output)
 struct ast_node_userinfo {
 	/* The for node is an openmp parallel for node. */
 	int is_openmp;
+	/* The reduction clauses of the openmp for node or NULL. */
+	char *reduction;
 };
 
 /* Information used while building the ast.
@@ -112,10 +116,47 @@ struct ast_build_userinfo {
 	isl_union_pw_multi_aff *contraction;
 };
 
-/* Check if the current scheduling dimension is parallel.
- *
- * We check for parallelism by verifying that the loop does not carry any
- * dependences.
+/* Information used while printing the ast.
+ */
+struct ast_print_userinfo {
+	/* Are we currently inside an openmp parallel region? */
+	int in_parallel_region;
+
+	/* The openmp for node inside the current parallel region
+	 * that does not need to be followed by a barrier, if any.
+	 */
+	isl_ast_node *nowait;
+
+	/* Should the outermost parallel loops and regions be timed? */
+	int instrument;
+	/* The line of the scop in the input file. */
+	int line;
+	/* The number of timed loops and regions printed so far. */
+	int n_timed;
+};
+
+/* Print a call that records the end of the next timed loop or region
+ * in the current scop.
+ * The name of the timed loop or region includes the line of the scop
+ * such that loops in different scops are timed separately.
+ */
+static __isl_give isl_printer *print_instrument_stop(__isl_take isl_printer *p,
+	struct ast_print_userinfo *print_info)
+{
+	char prefix[32];
+
+	snprintf(prefix, sizeof(prefix), "loop%d_", print_info->line);
+	return ppcg_print_instrument_stop(p, prefix, NULL,
+					print_info->n_timed++);
+}
+
+/* The name of the mark placed on top of a sequence of phases
+ * that should be executed inside a single openmp parallel region.
+ */
+static const char *omp_parallel_mark = "omp_parallel";
+
+/* Return the partial schedule at the current position of "build",
+ * in terms of the expanded statement instances.
  *
  * If any expansion nodes are present in the schedule tree,
  * then they are assumed to be situated near the leaves of the schedule tree,
@@ -129,31 +170,86 @@ struct ast_build_userinfo {
  * refer to the expanded domains.
  * Note that if the schedule tree does not contain any expansions,
  * then the contraction is an identity function.
+ */
+static __isl_give isl_union_map *get_expanded_schedule(
+	__isl_keep isl_ast_build *build, struct ast_build_userinfo *build_info)
+{
+	isl_union_map *schedule;
+
+	schedule = isl_ast_build_get_schedule(build);
+	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
+		isl_union_pw_multi_aff_copy(build_info->contraction));
+	return schedule;
+}
+
+/* Does the scheduling dimension "dimension" of "schedule"
+ * carry any of the dependences in "deps"?
+ *
+ * Implementation: first, translate dependences into time space, then force
+ * outer dimensions to be equal.  If the distance is zero in the current
+ * dimension, then the dependences are not carried.
+ * The distance is zero in the current dimension if it is a subset of a map
+ * with equal values for the current dimension.
+ */
+static int dim_carries_dependences(__isl_take isl_union_map *deps,
+	__isl_keep isl_union_map *schedule, unsigned dimension)
+{
+	isl_map *schedule_deps, *test;
+	unsigned i;
+	int is_parallel;
+
+	deps = isl_union_map_apply_range(deps, isl_union_map_copy(schedule));
+	deps = isl_union_map_apply_domain(deps, isl_union_map_copy(schedule));
+
+	if (isl_union_map_is_empty(deps)) {
+		isl_union_map_free(deps);
+		return 0;
+	}
+
+	schedule_deps = isl_map_from_union_map(deps);
+
+	for (i = 0; i < dimension; i++)
+		schedule_deps = isl_map_equate(schedule_deps, isl_dim_out, i,
+					       isl_dim_in, i);
+
+	test = isl_map_universe(isl_map_get_space(schedule_deps));
+	test = isl_map_equate(test, isl_dim_out, dimension, isl_dim_in,
+			      dimension);
+	is_parallel = isl_map_is_subset(schedule_deps, test);
+
+	isl_map_free(test);
+	isl_map_free(schedule_deps);
+
+	return !is_parallel;
+}
+
+/* Check if the current scheduling dimension is parallel.
+ *
+ * We check for parallelism by verifying that the loop does not carry any
+ * dependences.
  *
  * If the live_range_reordering option is set, then this currently
  * includes the order dependences.  In principle, non-zero order dependences
  * could be allowed, but this would require privatization and/or expansion.
  *
+ * If the reductions option is set, then the dependences between
+ * reduction updates are ignored.  Any such dependences that are
+ * carried by the loop are taken care of by the reduction clauses
+ * constructed by ast_schedule_dim_reductions.
+ *
  * Parallelism test: if the distance is zero in all outer dimensions, then it
  * has to be zero in the current dimension as well.
- * Implementation: first, translate dependences into time space, then force
- * outer dimensions to be equal.  If the distance is zero in the current
- * dimension, then the loop is parallel.
- * The distance is zero in the current dimension if it is a subset of a map
- * with equal values for the current dimension.
  */
 static int ast_schedule_dim_is_parallel(__isl_keep isl_ast_build *build,
 	struct ast_build_userinfo *build_info)
 {
 	struct ppcg_scop *scop = build_info->scop;
 	isl_union_map *schedule, *deps;
-	isl_map *schedule_deps, *test;
 	isl_space *schedule_space;
-	unsigned i, dimension, is_parallel;
+	unsigned dimension;
+	int is_parallel;
 
-	schedule = isl_ast_build_get_schedule(build);
-	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
-		isl_union_pw_multi_aff_copy(build_info->contraction));
+	schedule = get_expanded_schedule(build, build_info);
 	schedule_space = isl_ast_build_get_schedule_space(build);
 
 	dimension = isl_space_dim(schedule_space, isl_dim_out) - 1;
@@ -164,34 +260,102 @@ static int ast_schedule_dim_is_parallel(__isl_keep isl_ast_build *build,
 		isl_union_map *order = isl_union_map_copy(scop->dep_order);
 		deps = isl_union_map_union(deps, order);
 	}
-	deps = isl_union_map_apply_range(deps, isl_union_map_copy(schedule));
-	deps = isl_union_map_apply_domain(deps, schedule);
+	if (scop->dep_reduction)
+		deps = isl_union_map_subtract(deps,
+				isl_union_map_copy(scop->dep_reduction));
 
-	if (isl_union_map_is_empty(deps)) {
-		isl_union_map_free(deps);
-		isl_space_free(schedule_space);
-		return 1;
-	}
+	is_parallel = !dim_carries_dependences(deps, schedule, dimension);
 
-	schedule_deps = isl_map_from_union_map(deps);
+	isl_space_free(schedule_space);
+	isl_union_map_free(schedule);
 
-	for (i = 0; i < dimension; i++)
-		schedule_deps = isl_map_equate(schedule_deps, isl_dim_out, i,
-					       isl_dim_in, i);
+	return is_parallel;
+}
 
-	test = isl_map_universe(isl_map_get_space(schedule_deps));
-	test = isl_map_equate(test, isl_dim_out, dimension, isl_dim_in,
-			      dimension);
-	is_parallel = isl_map_is_subset(schedule_deps, test);
+/* Return the reduction clauses that need to be added to
+ * the current (parallel) scheduling dimension or NULL if there are none.
+ * That is, for each reduction statement such that
+ * the current dimension carries reduction dependences
+ * from instances of the statement, add a reduction clause
+ * for the corresponding operator and variable.
+ * All reduction statements with dependences between them
+ * update the same variable with the same operator,
+ * so each variable only needs to appear in a single clause.
+ */
+static char *ast_schedule_dim_reductions(__isl_keep isl_ast_build *build,
+	struct ast_build_userinfo *build_info)
+{
+	struct ppcg_scop *scop = build_info->scop;
+	isl_ctx *ctx;
+	isl_union_map *schedule;
+	isl_space *schedule_space;
+	isl_id_list *vars;
+	isl_printer *p;
+	unsigned dimension;
+	char *clauses;
+	int i, j, n;
 
+	if (!scop->dep_reduction || isl_union_map_is_empty(scop->dep_reduction))
+		return NULL;
+
+	ctx = isl_ast_build_get_ctx(build);
+	schedule = get_expanded_schedule(build, build_info);
+	schedule_space = isl_ast_build_get_schedule_space(build);
+	dimension = isl_space_dim(schedule_space, isl_dim_out) - 1;
 	isl_space_free(schedule_space);
-	isl_map_free(test);
-	isl_map_free(schedule_deps);
 
-	return is_parallel;
+	vars = isl_id_list_alloc(ctx, 0);
+	p = isl_printer_to_str(ctx);
+	for (i = 0; i < scop->pet->n_stmt; ++i) {
+		struct pet_stmt *stmt = scop->pet->stmts[i];
+		const char *op;
+		isl_id *var;
+		isl_union_map *deps;
+		int carried;
+
+		op = ppcg_stmt_reduction(stmt, &var);
+		if (!op)
+			continue;
+		n = isl_id_list_n_id(vars);
+		for (j = 0; j < n; ++j) {
+			isl_id *id = isl_id_list_get_id(vars, j);
+			isl_id_free(id);
+			if (id == var)
+				break;
+		}
+		if (j < n) {
+			isl_id_free(var);
+			continue;
+		}
+		deps = isl_union_map_copy(scop->dep_reduction);
+		deps = isl_union_map_intersect_domain(deps,
+			isl_union_set_from_set(isl_set_copy(stmt->domain)));
+		carried = dim_carries_dependences(deps, schedule, dimension);
+		if (!carried) {
+			isl_id_free(var);
+			continue;
+		}
+		if (n > 0)
+			p = isl_printer_print_str(p, " ");
+		p = isl_printer_print_str(p, "reduction(");
+		p = isl_printer_print_str(p, op);
+		p = isl_printer_print_str(p, ":");
+		p = isl_printer_print_str(p, isl_id_get_name(var));
+		p = isl_printer_print_str(p, ")");
+		vars = isl_id_list_add(vars, var);
+	}
+	n = isl_id_list_n_id(vars);
+	clauses = n > 0 ? isl_printer_get_str(p) : NULL;
+	isl_printer_free(p);
+	isl_id_list_free(vars);
+	isl_union_map_free(schedule);
+
+	return clauses;
 }
 
 /* Mark a for node openmp parallel, if it is the outermost parallel for node.
+ * If the loop carries reduction dependences, then also keep track
+ * of the corresponding reduction clauses.
  */
 static void mark_openmp_parallel(__isl_keep isl_ast_build *build,
 	struct ast_build_userinfo *build_info,
@@ -203,6 +367,8 @@ static void mark_openmp_parallel(__isl_keep isl_ast_build *build,
 	if (ast_schedule_dim_is_parallel(build, build_info)) {
 		build_info->in_parallel_for = 1;
 		node_info->is_openmp = 1;
+		node_info->reduction = ast_schedule_dim_reductions(build,
+								build_info);
 	}
 }
 
@@ -214,6 +380,7 @@ static struct ast_node_userinfo *allocate_ast_node_userinfo()
 	node_info = (struct ast_node_userinfo *)
 		malloc(sizeof(struct ast_node_userinfo));
 	node_info->is_openmp = 0;
+	node_info->reduction = NULL;
 	return node_info;
 }
 
@@ -223,6 +390,8 @@ static void free_ast_node_userinfo(void *ptr)
 {
 	struct ast_node_userinfo *info;
 	info = (struct ast_node_userinfo *) ptr;
+	if (info)
+		free(info->reduction);
 	free(info);
 }
 
@@ -279,6 +448,75 @@ static __isl_give isl_ast_node *ast_build_after_for(
 	return node;
 }
 
+static void free_ast_node(void *user)
+{
+	isl_ast_node_free(user);
+}
+
+/* This method is executed after the construction of a mark node.
+ *
+ * If the mark is an "omp_parallel" mark, then replace "node"
+ * by a user node that is annotated with an identifier
+ * with the same name referring to the marked AST node,
+ * such that print_user can print this AST node inside
+ * an openmp parallel region.
+ */
+static __isl_give isl_ast_node *ast_build_after_mark(
+	__isl_take isl_ast_node *node, __isl_keep isl_ast_build *build,
+	void *user)
+{
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_ast_expr *expr;
+	isl_ast_expr_list *list;
+	isl_ast_node *marked;
+
+	ctx = isl_ast_node_get_ctx(node);
+	id = isl_ast_node_mark_get_id(node);
+	if (!id)
+		return isl_ast_node_free(node);
+	if (strcmp(isl_id_get_name(id), omp_parallel_mark)) {
+		isl_id_free(id);
+		return node;
+	}
+	isl_id_free(id);
+	marked = isl_ast_node_mark_get_node(node);
+	isl_ast_node_free(node);
+
+	id = isl_id_alloc(ctx, omp_parallel_mark, marked);
+	id = isl_id_set_free_user(id, &free_ast_node);
+	expr = isl_ast_expr_from_id(isl_id_copy(id));
+	list = isl_ast_expr_list_alloc(ctx, 0);
+	expr = isl_ast_expr_call(expr, list);
+	node = isl_ast_node_alloc_user(expr);
+	node = isl_ast_node_set_annotation(node, id);
+
+	return node;
+}
+
+/* If "node" is a user node constructed by ast_build_after_mark,
+ * then return the AST node that should be printed inside
+ * an openmp parallel region.  Otherwise, return NULL.
+ * The result is only valid as long as "node" is.
+ */
+static isl_ast_node *get_parallel_region(__isl_keep isl_ast_node *node)
+{
+	isl_id *id;
+	const char *name;
+	isl_ast_node *marked;
+
+	if (isl_ast_node_get_type(node) != isl_ast_node_user)
+		return NULL;
+	id = isl_ast_node_get_annotation(node);
+	name = isl_id_get_name(id);
+	marked = NULL;
+	if (name && !strcmp(name, omp_parallel_mark))
+		marked = isl_id_get_user(id);
+	isl_id_free(id);
+
+	return marked;
+}
+
 /* Find the element in scop->stmts that has the given "id".
  */
 static struct pet_stmt *find_stmt(struct ppcg_scop *scop, __isl_keep isl_id *id)
@@ -300,16 +538,144 @@ static struct pet_stmt *find_stmt(struct ppcg_scop *scop, __isl_keep isl_id *id)
 		"statement not found", return NULL);
 }
 
+/* Return the openmp parallel for node that "node" consists of,
+ * possibly guarded by if nodes without else branch,
+ * or NULL if "node" is not of this form.
+ * The result is only valid as long as "node" is.
+ */
+static isl_ast_node *get_phase_loop(__isl_keep isl_ast_node *node)
+{
+	isl_id *id;
+	isl_ast_node *then;
+	struct ast_node_userinfo *info;
+	int openmp;
+
+	switch (isl_ast_node_get_type(node)) {
+	case isl_ast_node_if:
+		if (isl_ast_node_if_has_else_node(node) != isl_bool_false)
+			return NULL;
+		then = isl_ast_node_if_get_then_node(node);
+		isl_ast_node_free(then);
+		return get_phase_loop(then);
+	case isl_ast_node_for:
+		id = isl_ast_node_get_annotation(node);
+		info = isl_id_get_user(id);
+		openmp = info && info->is_openmp;
+		isl_id_free(id);
+		return openmp ? node : NULL;
+	default:
+		return NULL;
+	}
+}
+
+/* Print the phases of split tiling in "node" inside a single
+ * openmp parallel region, such that the threads are created
+ * only once rather than once for each phase.
+ *
+ * Each phase is printed as an openmp worksharing loop by print_for.
+ * The implicit barrier at the end of such a loop separates
+ * the phase from the next phase.  The last phase does not need
+ * a barrier of its own ("nowait") since it is followed by
+ * the implicit barrier at the end of the parallel region.
+ *
+ * This is only valid if every phase consists of an openmp parallel
+ * for node, possibly guarded by if nodes without else branch,
+ * since any other code inside the parallel region would be
+ * executed by every thread.  Otherwise, or if we are already inside
+ * a parallel region, "node" is printed without parallel region.
+ *
+ * If the --instrument option is set, then the entire parallel region
+ * is timed.
+ */
+static __isl_give isl_printer *print_parallel_region(__isl_take isl_printer *p,
+	__isl_take isl_ast_print_options *print_options,
+	__isl_keep isl_ast_node *node, struct ast_print_userinfo *print_info)
+{
+	int i, n;
+	isl_ast_node *last;
+	isl_ast_node_list *list;
+
+	if (isl_ast_node_get_type(node) == isl_ast_node_block)
+		list = isl_ast_node_block_get_children(node);
+	else
+		list = isl_ast_node_list_from_ast_node(isl_ast_node_copy(node));
+	n = isl_ast_node_list_n_ast_node(list);
+
+	last = NULL;
+	for (i = 0; i < n; ++i) {
+		isl_ast_node *phase;
+
+		phase = isl_ast_node_list_get_ast_node(list, i);
+		last = get_phase_loop(phase);
+		isl_ast_node_free(phase);
+		if (!last)
+			break;
+	}
+
+	if (!last || print_info->in_parallel_region) {
+		isl_ast_node_list_free(list);
+		return isl_ast_node_print(node, p, print_options);
+	}
+
+	if (print_info->instrument) {
+		p = ppcg_start_block(p);
+		p = ppcg_print_instrument_start(p);
+	}
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "#pragma omp parallel");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "{");
+	p = isl_printer_end_line(p);
+	p = isl_printer_indent(p, 2);
+
+	print_info->in_parallel_region = 1;
+	print_info->nowait = last;
+	for (i = 0; i < n; ++i) {
+		isl_ast_node *phase;
+
+		phase = isl_ast_node_list_get_ast_node(list, i);
+		p = isl_ast_node_print(phase, p,
+				isl_ast_print_options_copy(print_options));
+		isl_ast_node_free(phase);
+	}
+	print_info->in_parallel_region = 0;
+	print_info->nowait = NULL;
+
+	p = isl_printer_indent(p, -2);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "}");
+	p = isl_printer_end_line(p);
+
+	if (print_info->instrument) {
+		p = print_instrument_stop(p, print_info);
+		p = ppcg_end_block(p);
+	}
+
+	isl_ast_node_list_free(list);
+	isl_ast_print_options_free(print_options);
+
+	return p;
+}
+
 /* Print a user statement in the generated AST.
  * The ppcg_stmt has been attached to the node in at_each_domain.
+ * User nodes that have been constructed by ast_build_after_mark
+ * are printed as an openmp parallel region instead.
  */
 static __isl_give isl_printer *print_user(__isl_take isl_printer *p,
 	__isl_take isl_ast_print_options *print_options,
 	__isl_keep isl_ast_node *node, void *user)
 {
 	struct ppcg_stmt *stmt;
+	isl_ast_node *region;
 	isl_id *id;
 
+	region = get_parallel_region(node);
+	if (region)
+		return print_parallel_region(p, print_options, region, user);
+
 	id = isl_ast_node_get_annotation(node);
 	stmt = isl_id_get_user(id);
 	isl_id_free(id);
@@ -326,6 +692,13 @@ static __isl_give isl_printer *print_user(__isl_take isl_printer *p,
  *
  * To print an openmp parallel loop we print a normal for loop, but add
  * "#pragma openmp parallel for" in front.
+ * Inside an openmp parallel region, the threads have already been
+ * created and we add "#pragma omp for" instead, followed by "nowait"
+ * if "node" does not need to be followed by a barrier.
+ * The reduction clauses "reduction", if any, are added to the pragma.
+ * Outside such a region, the loop is timed if the --instrument option
+ * is set.  The loop is then put inside a block since "node"
+ * may be the body of another for loop.
  *
  * Variables that are declared within the body of this for loop are
  * automatically openmp 'private'. Iterators declared outside of the
@@ -339,14 +712,36 @@ static __isl_give isl_printer *print_user(__isl_take isl_printer *p,
  */
 static __isl_give isl_printer *print_for_with_openmp(
 	__isl_keep isl_ast_node *node, __isl_take isl_printer *p,
-	__isl_take isl_ast_print_options *print_options)
+	__isl_take isl_ast_print_options *print_options,
+	struct ast_print_userinfo *print_info, const char *reduction)
 {
+	int timed = print_info->instrument && !print_info->in_parallel_region;
+
+	if (timed) {
+		p = ppcg_start_block(p);
+		p = ppcg_print_instrument_start(p);
+	}
+
 	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "#pragma omp parallel for");
+	if (!print_info->in_parallel_region)
+		p = isl_printer_print_str(p, "#pragma omp parallel for");
+	else
+		p = isl_printer_print_str(p, "#pragma omp for");
+	if (reduction) {
+		p = isl_printer_print_str(p, " ");
+		p = isl_printer_print_str(p, reduction);
+	}
+	if (print_info->in_parallel_region && node == print_info->nowait)
+		p = isl_printer_print_str(p, " nowait");
 	p = isl_printer_end_line(p);
 
 	p = isl_ast_node_for_print(node, p, print_options);
 
+	if (timed) {
+		p = print_instrument_stop(p, print_info);
+		p = ppcg_end_block(p);
+	}
+
 	return p;
 }
 
@@ -361,6 +756,7 @@ static __isl_give isl_printer *print_for(__isl_take isl_printer *p,
 {
 	isl_id *id;
 	int openmp;
+	const char *reduction = NULL;
 
 	openmp = 0;
 	id = isl_ast_node_get_annotation(node);
@@ -369,12 +765,15 @@ static __isl_give isl_printer *print_for(__isl_take isl_printer *p,
 		struct ast_node_userinfo *info;
 
 		info = (struct ast_node_userinfo *) isl_id_get_user(id);
-		if (info && info->is_openmp)
+		if (info && info->is_openmp) {
 			openmp = 1;
+			reduction = info->reduction;
+		}
 	}
 
 	if (openmp)
-		p = print_for_with_openmp(node, p, print_options);
+		p = print_for_with_openmp(node, p, print_options, user,
+					reduction);
 	else
 		p = isl_ast_node_for_print(node, p, print_options);
 
@@ -476,12 +875,22 @@ static isl_bool update_depth(__isl_keep isl_schedule_node *node, void *user)
 static isl_bool at_node(__isl_keep isl_ast_node *node, void *user)
 {
 	struct ppcg_stmt *stmt;
+	isl_ast_node *region;
 	isl_id *id;
 	isl_printer **p = user;
 
 	if (isl_ast_node_get_type(node) != isl_ast_node_user)
 		return isl_bool_true;
 
+	region = get_parallel_region(node);
+	if (region) {
+		if (isl_ast_node_foreach_descendant_top_down(region,
+							&at_node, p) < 0)
+			return isl_bool_error;
+		*p = ppcg_print_macros(*p, region);
+		return *p ? isl_bool_false : isl_bool_error;
+	}
+
 	id = isl_ast_node_get_annotation(node);
 	stmt = isl_id_get_user(id);
 	isl_id_free(id);
@@ -551,8 +960,12 @@ static __isl_give isl_printer *print_scop(struct ppcg_scop *scop,
 	isl_ast_node *tree;
 	isl_id_list *iterators;
 	struct ast_build_userinfo build_info;
+	struct ast_print_userinfo print_info = { 0, NULL, options->instrument,
+							0, 0 };
 	int depth;
 
+	print_info.line = pet_loc_get_line(scop->pet->loc);
+
 	depth = 0;
 	if (isl_schedule_foreach_schedule_node_top_down(schedule, &update_depth,
 						&depth) < 0)
@@ -573,6 +986,9 @@ static __isl_give isl_printer *print_scop(struct ppcg_scop *scop,
 		build = isl_ast_build_set_after_each_for(build,
 							&ast_build_after_for,
 							&build_info);
+		build = isl_ast_build_set_after_each_mark(build,
+							&ast_build_after_mark,
+							&build_info);
 	}
 
 	tree = isl_ast_build_node_from_schedule(build, schedule);
@@ -583,10 +999,10 @@ static __isl_give isl_printer *print_scop(struct ppcg_scop *scop,
 
 	print_options = isl_ast_print_options_alloc(ctx);
 	print_options = isl_ast_print_options_set_print_user(print_options,
-							&print_user, NULL);
+							&print_user, &print_info);
 
 	print_options = isl_ast_print_options_set_print_for(print_options,
-							&print_for, NULL);
+							&print_for, &print_info);
 
 	p = cpu_print_macros(p, tree);
 	p = isl_ast_node_print(tree, p, print_options);
@@ -612,20 +1028,47 @@ static __isl_give isl_schedule_node *tile(__isl_take isl_schedule_node *node,
 	return node;
 }
 
+/* Given the time tile band node "node" returned by split_tile,
+ * mark the sequence of phases underneath it, such that the phases
+ * of each time tile get executed inside a single openmp parallel region.
+ */
+static __isl_give isl_schedule_node *mark_parallel_phases(
+	__isl_take isl_schedule_node *node)
+{
+	isl_id *id;
+
+	if (!node)
+		return NULL;
+
+	node = isl_schedule_node_child(node, 0);
+	if (isl_schedule_node_get_type(node) == isl_schedule_node_sequence) {
+		id = isl_id_alloc(isl_schedule_node_get_ctx(node),
+				omp_parallel_mark, NULL);
+		node = isl_schedule_node_insert_mark(node, id);
+	}
+	node = isl_schedule_node_parent(node);
+
+	return node;
+}
+
 /* Tile "node", if it is a band node with at least 2 members.
  * The tile sizes are set from the "tile_size" option.
+ *
+ * The kind of tiling is determined by the "split_tile" and "rectangle"
+ * options, unless automatic selection of the kind of tiling is requested,
+ * in which case it is derived from the dependence pattern of the band.
+ * Without explicit "tile" option, a band that is not recognized
+ * as a stencil is then left untouched.
  */
 static __isl_give isl_schedule_node *tile_band(
 	__isl_take isl_schedule_node *node, void *user)
 {
 	struct ppcg_scop *scop = user;
-	isl_ctx *ctx;
 	int n;
+	int split, overlapped;
 	isl_space *space;
 	isl_multi_val *sizes;
 
-	ctx = isl_union_set_get_ctx(scop->domain);
-
 	if (isl_schedule_node_get_type(node) != isl_schedule_node_band)
 		return node;
 
@@ -633,18 +1076,36 @@ static __isl_give isl_schedule_node *tile_band(
 	if (n <= 1)
 		return node;
 
+	split = scop->options->split_tile;
+	overlapped = scop->options->rectangle;
+	if (scop->options->tiling == PPCG_TILING_AUTO) {
+		enum ppcg_tiling_type type;
+		const char *reason;
+
+		if (ppcg_stencil_choose_tiling(scop, node, 0,
+						&type, &reason) < 0)
+			return isl_schedule_node_free(node);
+		if (scop->options->debug->verbose)
+			ppcg_stencil_report_tiling(node, type, reason);
+		split = type == ppcg_tiling_split;
+		overlapped = type == ppcg_tiling_overlapped;
+		if (!split && !overlapped && !scop->options->tile)
+			return node;
+	}
+
 	space = isl_schedule_node_band_get_space(node);
 	sizes = ppcg_multi_val_from_int(space, scop->options->tile_size);
-	
-	//TODO: check stencil_partern before scheduling
-	int stencil_partern = 1;
-	if(stencil_partern && scop->options->split_tile){
+
+	if (split) {
 		isl_multi_val_free(sizes);
 		sizes = split_tile_read_tile_sizes(node, scop, &n);
-		return split_tile(node, scop, sizes);
+		node = split_tile(node, scop, sizes);
+		if (scop->options->openmp)
+			node = mark_parallel_phases(node);
+		return node;
 	}
-	
-	if(stencil_partern && scop->options->rectangle) {
+
+	if (overlapped) {
 		if (!scop->options->isolate_expanded_points)
 			scop->options->isolate_expanded_points = 1;
 		return overlapped_tile(node, scop, sizes, NULL, 0, 0);
@@ -770,7 +1231,8 @@ static __isl_give isl_schedule *get_schedule(struct ppcg_scop *ps,
 	schedule = ppcg_get_schedule(ctx, options,
 				    &optionally_compute_schedule, ps);
 
-	if (ps->options->tile || ps->options->split_tile || ps->options->rectangle) {
+	if (ps->options->tile || ps->options->split_tile ||
+	    ps->options->rectangle || ps->options->tiling == PPCG_TILING_AUTO) {
 		schedule = isl_schedule_map_schedule_node_bottom_up(schedule,
 							&tile_band, ps);
 	}
@@ -865,6 +1327,8 @@ int generate_cpu(isl_ctx *ctx, struct ppcg_options *options,
 	output_file = get_output_file(input, output);
 	if (!output_file)
 		return -1;
+	if (options->instrument)
+		fprintf(output_file, "#include \"ppcg_instrument.h\"\n");
 
 	r = ppcg_transform(ctx, input, output_file, options,
 					&print_cpu_wrap, options);
@@ -39,6 +39,36 @@ static __isl_give isl_printer *print_cuda_macros(__isl_take isl_printer *p)
 	return p;
 }
 
+/* Print the macros used for pinning and unpinning host memory
+ * in the code generated for the --async-transfers option.
+ * Failing to pin host memory is not an error since the transfers
+ * can still be performed from pageable memory, albeit without
+ * overlapping with kernel execution.  Clear the error such that
+ * it is not picked up by a subsequent cudaCheckKernel and
+ * keep track of whether the memory was pinned in "pinned"
+ * such that only memory that was effectively pinned gets unpinned.
+ */
+static __isl_give isl_printer *print_cuda_async_macros(
+	__isl_take isl_printer *p)
+{
+	const char *macros =
+		"#define cudaPinHost(ptr, size, pinned) \\\n"
+		"  do { \\\n"
+		"    pinned = cudaHostRegister(ptr, size, "
+		"cudaHostRegisterDefault) == cudaSuccess; \\\n"
+		"    if (!pinned) \\\n"
+		"      (void) cudaGetLastError(); \\\n"
+		"  } while(0)\n"
+		"#define cudaUnpinHost(ptr, pinned) \\\n"
+		"  do { \\\n"
+		"    if (pinned) \\\n"
+		"      cudaCheckReturn(cudaHostUnregister(ptr)); \\\n"
+		"  } while(0)\n\n";
+
+	p = isl_printer_print_str(p, macros);
+	return p;
+}
+
 /* Print a declaration for the device array corresponding to "array" on "p".
  */
 static __isl_give isl_printer *declare_device_array(__isl_take isl_printer *p,
@@ -99,6 +129,18 @@ static __isl_give isl_printer *allocate_device_arrays(
 			continue;
 		p = ppcg_ast_expr_print_macros(array->bound_expr, p);
 		p = isl_printer_start_line(p);
+		if (array->persistent) {
+			p = isl_printer_print_str(p,
+				"ppcg_cuda_acquire((void **) &dev_");
+			p = isl_printer_print_str(p, array->name);
+			p = isl_printer_print_str(p, ", ");
+			p = isl_printer_print_str(p, array->name);
+			p = isl_printer_print_str(p, ", ");
+			p = gpu_array_info_print_size(p, array);
+			p = isl_printer_print_str(p, ");");
+			p = isl_printer_end_line(p);
+			continue;
+		}
 		p = isl_printer_print_str(p,
 			"cudaCheckReturn(cudaMalloc((void **) &dev_");
 		p = isl_printer_print_str(p, prog->array[i].name);
@@ -120,6 +162,8 @@ static __isl_give isl_printer *free_device_arrays(__isl_take isl_printer *p,
 	for (i = 0; i < prog->n_array; ++i) {
 		if (!gpu_array_requires_device_allocation(&prog->array[i]))
 			continue;
+		if (prog->array[i].persistent)
+			continue;
 		p = isl_printer_start_line(p);
 		p = isl_printer_print_str(p, "cudaCheckReturn(cudaFree(dev_");
 		p = isl_printer_print_str(p, prog->array[i].name);
@@ -130,14 +174,339 @@ static __isl_give isl_printer *free_device_arrays(__isl_take isl_printer *p,
 	return p;
 }
 
+/* Print the name of the event that is recorded after "array"
+ * has been copied to the device in the code generated
+ * for the --async-transfers option.
+ */
+static __isl_give isl_printer *print_to_device_event(__isl_take isl_printer *p,
+	struct gpu_array_info *array)
+{
+	p = isl_printer_print_str(p, "ppcg_to_device_");
+	p = isl_printer_print_str(p, array->name);
+
+	return p;
+}
+
+/* Print the name of the variable that keeps track of whether
+ * the host memory of "array" has been pinned in the code generated
+ * for the --async-transfers option.
+ */
+static __isl_give isl_printer *print_pinned_flag(__isl_take isl_printer *p,
+	struct gpu_array_info *array)
+{
+	p = isl_printer_print_str(p, "ppcg_pinned_");
+	p = isl_printer_print_str(p, array->name);
+
+	return p;
+}
+
+/* Print declarations for the streams and events used by the code
+ * generated for the --async-transfers option and create them.
+ *
+ * All transfers are performed on ppcg_copy_stream, while
+ * all kernels are launched on ppcg_compute_stream.
+ * Since the streams are created as non-blocking streams,
+ * they do not synchronize with the default stream.
+ * For each array that is allocated on the device, an event is
+ * recorded on ppcg_copy_stream after the array has been copied
+ * to the device.  Kernels accessing the array wait for this event.
+ * Since an event that has never been recorded is considered to have
+ * completed, the kernels can wait for this event even if the array
+ * is not copied to the device.
+ * The ppcg_kernels_done event is recorded on ppcg_compute_stream
+ * before an array is copied back from the device.
+ */
+static __isl_give isl_printer *create_streams(__isl_take isl_printer *p,
+	struct gpu_prog *prog)
+{
+	int i;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+		"cudaStream_t ppcg_copy_stream, ppcg_compute_stream;");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaEvent_t ppcg_kernels_done;");
+	p = isl_printer_end_line(p);
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cudaEvent_t ");
+		p = print_to_device_event(p, array);
+		p = isl_printer_print_str(p, ";");
+		p = isl_printer_end_line(p);
+	}
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaStreamCreateWithFlags("
+		"&ppcg_copy_stream, cudaStreamNonBlocking));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaStreamCreateWithFlags("
+		"&ppcg_compute_stream, cudaStreamNonBlocking));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaEventCreateWithFlags("
+		"&ppcg_kernels_done, cudaEventDisableTiming));");
+	p = isl_printer_end_line(p);
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p,
+			"cudaCheckReturn(cudaEventCreateWithFlags(&");
+		p = print_to_device_event(p, array);
+		p = isl_printer_print_str(p, ", cudaEventDisableTiming));");
+		p = isl_printer_end_line(p);
+	}
+	p = isl_printer_start_line(p);
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Does the host memory of "array" need to be pinned such that
+ * it can be transferred asynchronously?
+ * Only non-scalar arrays that are allocated on the device are pinned.
+ * Persistent arrays are not pinned since they are only copied
+ * to the device if their device copy is out of date and
+ * they are copied back outside of the scop, after the host memory
+ * would have been unpinned again.
+ */
+static int needs_pinning(struct gpu_array_info *array)
+{
+	if (!gpu_array_requires_device_allocation(array))
+		return 0;
+	if (gpu_array_is_scalar(array))
+		return 0;
+	return !array->persistent;
+}
+
+/* Print code for pinning the host memory of the arrays
+ * for which needs_pinning holds, keeping track of whether
+ * pinning succeeded.
+ */
+static __isl_give isl_printer *pin_host_arrays(__isl_take isl_printer *p,
+	struct gpu_prog *prog)
+{
+	int i;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!needs_pinning(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "int ");
+		p = print_pinned_flag(p, array);
+		p = isl_printer_print_str(p, ";");
+		p = isl_printer_end_line(p);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cudaPinHost(");
+		p = isl_printer_print_str(p, array->name);
+		p = isl_printer_print_str(p, ", ");
+		p = gpu_array_info_print_size(p, array);
+		p = isl_printer_print_str(p, ", ");
+		p = print_pinned_flag(p, array);
+		p = isl_printer_print_str(p, ");");
+		p = isl_printer_end_line(p);
+	}
+	p = isl_printer_start_line(p);
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print code for waiting for all transfers and kernels to finish,
+ * unpinning the host memory pinned by pin_host_arrays and
+ * destroying the streams and events created by create_streams.
+ */
+static __isl_give isl_printer *destroy_streams(__isl_take isl_printer *p,
+	struct gpu_prog *prog)
+{
+	int i;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+		"cudaCheckReturn(cudaStreamSynchronize(ppcg_copy_stream));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+		"cudaCheckReturn(cudaStreamSynchronize(ppcg_compute_stream));");
+	p = isl_printer_end_line(p);
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		if (needs_pinning(array)) {
+			p = isl_printer_start_line(p);
+			p = isl_printer_print_str(p, "cudaUnpinHost(");
+			p = isl_printer_print_str(p, array->name);
+			p = isl_printer_print_str(p, ", ");
+			p = print_pinned_flag(p, array);
+			p = isl_printer_print_str(p, ");");
+			p = isl_printer_end_line(p);
+		}
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cudaCheckReturn(cudaEventDestroy(");
+		p = print_to_device_event(p, array);
+		p = isl_printer_print_str(p, "));");
+		p = isl_printer_end_line(p);
+	}
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+		"cudaCheckReturn(cudaEventDestroy(ppcg_kernels_done));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+		"cudaCheckReturn(cudaStreamDestroy(ppcg_copy_stream));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p,
+		"cudaCheckReturn(cudaStreamDestroy(ppcg_compute_stream));");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print a pointer to the first element of the current row of "box"
+ * in the copy of "array" on the device (if "dev" is set) or on the host.
+ */
+static __isl_give isl_printer *print_box_pointer(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box, int dev)
+{
+	p = isl_printer_print_str(p, "(char *) ");
+	if (dev)
+		p = isl_printer_print_str(p, "dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, " + ");
+	p = gpu_array_box_print_offset(p, array, box);
+
+	return p;
+}
+
+/* Print code to "p" for copying the elements of "array" in "box"
+ * from the host to the device (to_host = 0) or
+ * back from the device to the host (to_host = 1).
+ * If "async" is set, then the copy is performed asynchronously
+ * on ppcg_copy_stream.
+ *
+ * If the array is one-dimensional, then the box is contiguous and
+ * it is copied using a single call to cudaMemcpy.
+ * Otherwise, the box is copied using cudaMemcpy2D, one slice at a time,
+ * where a slice is formed by the last two dimensions.
+ * The host and the device copy of the array have the same layout.
+ */
+static __isl_give isl_printer *copy_array_box(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box, int to_host,
+	int async)
+{
+	int two_d = array->n_index >= 2;
+
+	p = gpu_array_box_print_macros(p, box);
+	p = gpu_array_box_print_loops(p, array, box);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaMemcpy");
+	if (two_d)
+		p = isl_printer_print_str(p, "2D");
+	if (async)
+		p = isl_printer_print_str(p, "Async");
+	p = isl_printer_print_str(p, "(");
+	p = print_box_pointer(p, array, box, !to_host);
+	if (two_d) {
+		p = isl_printer_print_str(p, ", ");
+		p = gpu_array_info_print_pitch(p, array);
+	}
+	p = isl_printer_print_str(p, ", ");
+	p = print_box_pointer(p, array, box, to_host);
+	if (two_d) {
+		p = isl_printer_print_str(p, ", ");
+		p = gpu_array_info_print_pitch(p, array);
+	}
+	p = isl_printer_print_str(p, ", ");
+	p = gpu_array_box_print_width(p, array, box);
+	if (two_d) {
+		p = isl_printer_print_str(p, ", ");
+		p = gpu_array_box_print_height(p, array, box);
+	}
+	if (to_host)
+		p = isl_printer_print_str(p, ", cudaMemcpyDeviceToHost");
+	else
+		p = isl_printer_print_str(p, ", cudaMemcpyHostToDevice");
+	if (async)
+		p = isl_printer_print_str(p, ", ppcg_copy_stream");
+	p = isl_printer_print_str(p, "));");
+	p = isl_printer_end_line(p);
+	p = gpu_array_box_print_end_loops(p, array);
+
+	return p;
+}
+
+/* Print code to "p" for copying the persistent "array" from the host
+ * to the device (to_host = 0) or back from the device to the host
+ * (to_host = 1).
+ * The runtime only copies the array to the device if the device copy
+ * is out of date.  Copying back is postponed until the host
+ * accesses the array, so it is only recorded that the host copy
+ * is now out of date.
+ * If "async" is set, then the kernels run on ppcg_compute_stream,
+ * which does not synchronize with the default stream.
+ * The copy to the device is then performed on ppcg_copy_stream and
+ * the corresponding event is recorded such that kernels accessing
+ * the array wait for the copy to complete.
+ * Copying back only happens after the scop, when all streams
+ * have been synchronized in destroy_streams.
+ */
+static __isl_give isl_printer *copy_persistent_array(__isl_take isl_printer *p,
+	struct gpu_array_info *array, int to_host, int async)
+{
+	p = isl_printer_start_line(p);
+	if (to_host)
+		p = isl_printer_print_str(p, "ppcg_cuda_mark_device_written(");
+	else if (async)
+		p = isl_printer_print_str(p,
+					"ppcg_cuda_copy_to_device_async(");
+	else
+		p = isl_printer_print_str(p, "ppcg_cuda_copy_to_device(");
+	p = isl_printer_print_str(p, array->name);
+	if (!to_host && async)
+		p = isl_printer_print_str(p, ", ppcg_copy_stream");
+	p = isl_printer_print_str(p, ");");
+	p = isl_printer_end_line(p);
+
+	if (to_host || !async)
+		return p;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaEventRecord(");
+	p = print_to_device_event(p, array);
+	p = isl_printer_print_str(p, ", ppcg_copy_stream));");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
 /* Print code to "p" for copying "array" from the host to the device
  * in its entirety.  The bounds on the extent of "array" have
  * been precomputed in extract_array_info and are used in
  * gpu_array_info_print_size.
+ * If only a box of the array needs to be copied, then
+ * copy only that box instead.
  */
 static __isl_give isl_printer *copy_array_to_device(__isl_take isl_printer *p,
 	struct gpu_array_info *array)
 {
+	if (array->copy_in.offset)
+		return copy_array_box(p, array, &array->copy_in, 0, 0);
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "cudaCheckReturn(cudaMemcpy(dev_");
 	p = isl_printer_print_str(p, array->name);
@@ -155,14 +524,58 @@ static __isl_give isl_printer *copy_array_to_device(__isl_take isl_printer *p,
 	return p;
 }
 
+/* Print code to "p" for asynchronously copying "array" from the host
+ * to the device in its entirety on ppcg_copy_stream and
+ * for recording the corresponding event such that kernels accessing
+ * the array can wait for the copy to complete.
+ * If only a box of the array needs to be copied, then
+ * copy only that box instead.
+ */
+static __isl_give isl_printer *copy_array_to_device_async(
+	__isl_take isl_printer *p, struct gpu_array_info *array)
+{
+	if (array->copy_in.offset) {
+		p = copy_array_box(p, array, &array->copy_in, 0, 1);
+	} else {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p,
+			"cudaCheckReturn(cudaMemcpyAsync(dev_");
+		p = isl_printer_print_str(p, array->name);
+		p = isl_printer_print_str(p, ", ");
+
+		if (gpu_array_is_scalar(array))
+			p = isl_printer_print_str(p, "&");
+		p = isl_printer_print_str(p, array->name);
+		p = isl_printer_print_str(p, ", ");
+
+		p = gpu_array_info_print_size(p, array);
+		p = isl_printer_print_str(p,
+			", cudaMemcpyHostToDevice, ppcg_copy_stream));");
+		p = isl_printer_end_line(p);
+	}
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaEventRecord(");
+	p = print_to_device_event(p, array);
+	p = isl_printer_print_str(p, ", ppcg_copy_stream));");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
 /* Print code to "p" for copying "array" back from the device to the host
  * in its entirety.  The bounds on the extent of "array" have
  * been precomputed in extract_array_info and are used in
  * gpu_array_info_print_size.
+ * If only a box of the array needs to be copied, then
+ * copy only that box instead.
  */
 static __isl_give isl_printer *copy_array_from_device(
 	__isl_take isl_printer *p, struct gpu_array_info *array)
 {
+	if (array->copy_out.offset)
+		return copy_array_box(p, array, &array->copy_out, 1, 0);
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "cudaCheckReturn(cudaMemcpy(");
 	if (gpu_array_is_scalar(array))
@@ -178,6 +591,44 @@ static __isl_give isl_printer *copy_array_from_device(
 	return p;
 }
 
+/* Print code to "p" for asynchronously copying "array" back from
+ * the device to the host in its entirety on ppcg_copy_stream,
+ * after all kernels launched so far have completed.
+ * The host only waits for the copy to complete in destroy_streams.
+ * If only a box of the array needs to be copied, then
+ * copy only that box instead.
+ */
+static __isl_give isl_printer *copy_array_from_device_async(
+	__isl_take isl_printer *p, struct gpu_array_info *array)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaEventRecord("
+		"ppcg_kernels_done, ppcg_compute_stream));");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaStreamWaitEvent("
+		"ppcg_copy_stream, ppcg_kernels_done, 0));");
+	p = isl_printer_end_line(p);
+
+	if (array->copy_out.offset)
+		return copy_array_box(p, array, &array->copy_out, 1, 1);
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaMemcpyAsync(");
+	if (gpu_array_is_scalar(array))
+		p = isl_printer_print_str(p, "&");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, ", dev_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, ", ");
+	p = gpu_array_info_print_size(p, array);
+	p = isl_printer_print_str(p,
+		", cudaMemcpyDeviceToHost, ppcg_copy_stream));");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
 static void print_reverse_list(FILE *out, int len, int *list)
 {
 	int i;
@@ -408,10 +859,15 @@ static __isl_give isl_printer *print_kernel_var(__isl_take isl_printer *p,
 	p = isl_printer_start_line(p);
 	if (var->type == ppcg_access_shared)
 		p = isl_printer_print_str(p, "__shared__ ");
+	if (var->align) {
+		p = isl_printer_print_str(p, "__align__(");
+		p = isl_printer_print_int(p, var->align);
+		p = isl_printer_print_str(p, ") ");
+	}
 	p = isl_printer_print_str(p, var->array->type);
 	p = isl_printer_print_str(p, " ");
 	p = isl_printer_print_str(p,  var->name);
-	for (j = 0; j < var->array->n_index; ++j) {
+	for (j = 0; j < isl_vec_size(var->size); ++j) {
 		isl_val *v;
 
 		p = isl_printer_print_str(p, "[");
@@ -438,12 +894,17 @@ static __isl_give isl_printer *print_kernel_vars(__isl_take isl_printer *p,
 }
 
 /* Print a sync statement.
+ * If only the threads of a single warp need to be synchronized,
+ * then print a warp level synchronization.
  */
 static __isl_give isl_printer *print_sync(__isl_take isl_printer *p,
 	struct ppcg_kernel_stmt *stmt)
 {
 	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "__syncthreads();");
+	if (stmt->u.s.warp)
+		p = isl_printer_print_str(p, "__syncwarp();");
+	else
+		p = isl_printer_print_str(p, "__syncthreads();");
 	p = isl_printer_end_line(p);
 
 	return p;
@@ -467,6 +928,8 @@ static __isl_give isl_printer *print_kernel_stmt(__isl_take isl_printer *p,
 
 	switch (stmt->type) {
 	case ppcg_kernel_copy:
+		if (stmt->u.c.vector)
+			return ppcg_kernel_print_vector_copy(p, stmt, "", "");
 		return ppcg_kernel_print_copy(p, stmt);
 	case ppcg_kernel_sync:
 		return print_sync(p, stmt);
@@ -506,28 +969,100 @@ static void print_kernel(struct gpu_prog *prog, struct ppcg_kernel *kernel,
 	fprintf(cuda->kernel_c, "}\n");
 }
 
+/* Print code to "p" for copying "array" from the host to the device
+ * (to_host = 0) or back from the device to the host (to_host = 1),
+ * asynchronously if "async" is set.
+ */
+static __isl_give isl_printer *copy_array(__isl_take isl_printer *p,
+	struct gpu_array_info *array, int to_host, int async)
+{
+	if (async) {
+		if (!to_host)
+			return copy_array_to_device_async(p, array);
+		else
+			return copy_array_from_device_async(p, array);
+	}
+	if (!to_host)
+		return copy_array_to_device(p, array);
+	else
+		return copy_array_from_device(p, array);
+}
+
+/* Print code for waiting for all pending operations on the device
+ * to complete.
+ */
+static __isl_give isl_printer *synchronize_device(__isl_take isl_printer *p)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cudaCheckReturn(cudaDeviceSynchronize());");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print code to "p" for copying "array" to or from the device
+ * as in copy_array, in the code generated for the --instrument option.
+ * The copy is timed from the point where all pending operations
+ * have completed until the copy itself has completed and
+ * the number of copied bytes is recorded.
+ * This means that asynchronous copies no longer overlap
+ * with kernel execution.
+ */
+static __isl_give isl_printer *copy_array_instrumented(
+	__isl_take isl_printer *p, struct gpu_array_info *array, int to_host,
+	int async)
+{
+	const char *prefix = to_host ? "from_device_" : "to_device_";
+
+	p = ppcg_start_block(p);
+	p = synchronize_device(p);
+	p = ppcg_print_instrument_start(p);
+	p = copy_array(p, array, to_host, async);
+	p = synchronize_device(p);
+	p = ppcg_print_instrument_stop(p, prefix, array->name, 0);
+	p = gpu_array_print_instrument_bytes(p, array, to_host);
+	p = ppcg_end_block(p);
+
+	return p;
+}
+
 /* Print code for initializing the device for execution of the transformed
  * code.  This includes declaring locally defined variables as well as
  * declaring and allocating the required copies of arrays on the device.
+ * If the --async-transfers option is set, then also create the streams
+ * and events and pin the host arrays.
  */
 static __isl_give isl_printer *init_device(__isl_take isl_printer *p,
 	struct gpu_prog *prog)
 {
+	int async = prog->scop->options->async_transfers;
+
 	p = print_cuda_macros(p);
+	if (async)
+		p = print_cuda_async_macros(p);
 
 	p = gpu_print_local_declarations(p, prog);
 	p = declare_device_arrays(p, prog);
 	p = allocate_device_arrays(p, prog);
+	if (async) {
+		p = create_streams(p, prog);
+		p = pin_host_arrays(p, prog);
+	}
 
 	return p;
 }
 
 /* Print code for clearing the device after execution of the transformed code.
  * In particular, free the memory that was allocated on the device.
+ * If the --async-transfers option is set, then first wait for
+ * all pending operations to complete and release the resources
+ * acquired in init_device.
  */
 static __isl_give isl_printer *clear_device(__isl_take isl_printer *p,
 	struct gpu_prog *prog)
 {
+	if (prog->scop->options->async_transfers)
+		p = destroy_streams(p, prog);
 	p = free_device_arrays(p, prog);
 
 	return p;
@@ -543,7 +1078,10 @@ static __isl_give isl_printer *clear_device(__isl_take isl_printer *p,
  * The node for clearing the device is called "clear_device".
  *
  * Extract the array (if any) from the identifier and call
- * init_device, clear_device, copy_array_to_device or copy_array_from_device.
+ * init_device, clear_device, copy_array_to_device or copy_array_from_device
+ * (or their asynchronous variants).
+ * Copying persistent arrays is handled by copy_persistent_array.
+ * Other copies are timed if the --instrument option is set.
  */
 static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
 	__isl_keep isl_ast_node *node, struct gpu_prog *prog)
@@ -571,10 +1109,103 @@ static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
 	if (!array)
 		return isl_printer_free(p);
 
-	if (!prefixcmp(name, "to_device"))
-		return copy_array_to_device(p, array);
-	else
-		return copy_array_from_device(p, array);
+	if (array->persistent)
+		return copy_persistent_array(p, array,
+				prefixcmp(name, "to_device"),
+				prog->scop->options->async_transfers);
+	if (prog->scop->options->instrument)
+		return copy_array_instrumented(p, array,
+				prefixcmp(name, "to_device"),
+				prog->scop->options->async_transfers);
+	return copy_array(p, array, prefixcmp(name, "to_device"),
+				prog->scop->options->async_transfers);
+}
+
+/* Print code for making ppcg_compute_stream wait for the arrays
+ * accessed by "kernel" to have been copied to the device.
+ */
+static __isl_give isl_printer *wait_for_kernel_arrays(
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct ppcg_kernel *kernel)
+{
+	int i;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!ppcg_kernel_requires_array_argument(kernel, i))
+			continue;
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cudaCheckReturn(cudaStreamWaitEvent("
+			"ppcg_compute_stream, ");
+		p = print_to_device_event(p, array);
+		p = isl_printer_print_str(p, ", 0));");
+		p = isl_printer_end_line(p);
+	}
+
+	return p;
+}
+
+/* Does "stmt" access any element of "array"?
+ * The range of an access to a field of a structure is a wrapped relation
+ * with the accessed array in its domain.
+ */
+static isl_bool stmt_accesses_array(struct gpu_stmt *stmt,
+	struct gpu_array_info *array)
+{
+	struct gpu_stmt_access *access;
+
+	for (access = stmt->accesses; access; access = access->next) {
+		isl_space *space;
+		isl_bool equal;
+
+		space = isl_space_range(isl_map_get_space(access->access));
+		while (space && isl_space_is_wrapping(space))
+			space = isl_space_domain(isl_space_unwrap(space));
+		equal = isl_space_tuple_is_equal(space, isl_dim_set,
+						array->space, isl_dim_set);
+		isl_space_free(space);
+		if (equal < 0 || equal)
+			return equal;
+	}
+
+	return isl_bool_false;
+}
+
+/* Print code for preparing the persistent arrays accessed by
+ * the original user statement "stmt" for being accessed on the host.
+ * Host statements may be executed after the kernels in the scop,
+ * when the host copy of a persistent array may be out of date,
+ * or before the arrays are copied to the device, when a write
+ * on the host needs to invalidate the device copy.
+ * Both are taken care of by ppcg_cuda_host_access.
+ */
+static __isl_give isl_printer *print_host_access(__isl_take isl_printer *p,
+	struct gpu_prog *prog, struct gpu_stmt *stmt)
+{
+	int i;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+		isl_bool accessed;
+
+		if (!array->persistent)
+			continue;
+		accessed = stmt_accesses_array(stmt, array);
+		if (accessed < 0)
+			return isl_printer_free(p);
+		if (!accessed)
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "ppcg_cuda_host_access(");
+		p = isl_printer_print_str(p, array->name);
+		p = isl_printer_print_str(p, ");");
+		p = isl_printer_end_line(p);
+	}
+
+	return p;
 }
 
 struct print_host_user_data {
@@ -594,6 +1225,20 @@ struct print_host_user_data {
  *
  * In case of a kernel launch, print a block of statements that
  * defines the grid and the block and then launches the kernel.
+ *
+ * If the --async-transfers option is set, then the kernel is launched
+ * on ppcg_compute_stream after waiting for the arrays it accesses
+ * to have been copied to the device, while an original user statement
+ * is only executed on the host after all pending operations
+ * on the device have completed.
+ *
+ * If the --persistent-arrays option is set, then the persistent arrays
+ * accessed by an original user statement are first prepared
+ * for being accessed on the host (see print_host_access).
+ *
+ * If the --instrument option is set, then the kernel launch is timed
+ * from the point where all pending operations have completed
+ * until the kernel itself has completed.
  */
 static __isl_give isl_printer *print_host_user(__isl_take isl_printer *p,
 	__isl_take isl_ast_print_options *print_options,
@@ -604,10 +1249,13 @@ static __isl_give isl_printer *print_host_user(__isl_take isl_printer *p,
 	struct ppcg_kernel *kernel;
 	struct ppcg_kernel_stmt *stmt;
 	struct print_host_user_data *data;
+	int async, instrument;
 
 	isl_ast_print_options_free(print_options);
 
 	data = (struct print_host_user_data *) user;
+	async = data->prog->scop->options->async_transfers;
+	instrument = data->prog->scop->options->instrument;
 
 	id = isl_ast_node_get_annotation(node);
 	if (!id)
@@ -618,8 +1266,16 @@ static __isl_give isl_printer *print_host_user(__isl_take isl_printer *p,
 	stmt = is_user ? isl_id_get_user(id) : NULL;
 	isl_id_free(id);
 
-	if (is_user)
+	if (is_user) {
+		if (async) {
+			p = isl_printer_start_line(p);
+			p = isl_printer_print_str(p,
+				"cudaCheckReturn(cudaDeviceSynchronize());");
+			p = isl_printer_end_line(p);
+		}
+		p = print_host_access(p, data->prog, stmt->u.d.stmt);
 		return ppcg_kernel_print_domain(p, stmt);
+	}
 
 	p = ppcg_start_block(p);
 
@@ -634,6 +1290,13 @@ static __isl_give isl_printer *print_host_user(__isl_take isl_printer *p,
 
 	p = print_grid(p, kernel);
 
+	if (async)
+		p = wait_for_kernel_arrays(p, data->prog, kernel);
+	if (instrument) {
+		p = synchronize_device(p);
+		p = ppcg_print_instrument_start(p);
+	}
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "kernel");
 	p = isl_printer_print_int(p, kernel->id);
@@ -641,7 +1304,10 @@ static __isl_give isl_printer *print_host_user(__isl_take isl_printer *p,
 	p = isl_printer_print_int(p, kernel->id);
 	p = isl_printer_print_str(p, "_dimGrid, k");
 	p = isl_printer_print_int(p, kernel->id);
-	p = isl_printer_print_str(p, "_dimBlock>>> (");
+	p = isl_printer_print_str(p, "_dimBlock");
+	if (async)
+		p = isl_printer_print_str(p, ", 0, ppcg_compute_stream");
+	p = isl_printer_print_str(p, ">>> (");
 	p = print_kernel_arguments(p, data->prog, kernel, 0);
 	p = isl_printer_print_str(p, ");");
 	p = isl_printer_end_line(p);
@@ -650,6 +1316,11 @@ static __isl_give isl_printer *print_host_user(__isl_take isl_printer *p,
 	p = isl_printer_print_str(p, "cudaCheckKernel();");
 	p = isl_printer_end_line(p);
 
+	if (instrument) {
+		p = synchronize_device(p);
+		p = ppcg_print_instrument_stop(p, "kernel", NULL, kernel->id);
+	}
+
 	p = ppcg_end_block(p);
 
 	p = isl_printer_start_line(p);
@@ -712,6 +1383,10 @@ static __isl_give isl_printer *print_cuda(__isl_take isl_printer *p,
  *
  * To prepare for this printing, we first open the output files
  * and we close them after generate_gpu has finished.
+ * If the persistent_arrays option is set, then the host code
+ * relies on the runtime in cuda_utilities.c.
+ * If the instrument option is set, then it relies on
+ * the runtime in ppcg_instrument.c.
  */
 int generate_cuda(isl_ctx *ctx, struct ppcg_options *options,
 	const char *input)
@@ -720,6 +1395,10 @@ int generate_cuda(isl_ctx *ctx, struct ppcg_options *options,
 	int r;
 
 	cuda_open_files(&cuda, input);
+	if (options->persistent_arrays)
+		fprintf(cuda.host_c, "#include \"cuda_utilities.h\"\n");
+	if (options->instrument)
+		fprintf(cuda.host_c, "#include \"ppcg_instrument.h\"\n");
 
 	r = generate_gpu(ctx, input, cuda.host_c, options, &print_cuda, &cuda);
 
@@ -0,0 +1,196 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda_runtime_api.h>
+#include "cuda_utilities.h"
+
+/* An entry in the table of device copies of host memory.
+ * "host" and "size" describe the host memory, while "dev" is
+ * the corresponding device copy.
+ * "dev_valid" is set if the device copy is up to date.
+ * "host_valid" is set if the host copy is up to date.
+ */
+struct ppcg_cuda_buffer {
+	void *host;
+	size_t size;
+	void *dev;
+	int dev_valid;
+	int host_valid;
+};
+
+/* The table of device copies of host memory,
+ * with "n" entries and room for "size" entries.
+ */
+static struct {
+	int n;
+	int size;
+	struct ppcg_cuda_buffer *buffer;
+} ppcg_cuda_table;
+
+/* Abort with an error message if "err" signals an error.
+ */
+static void check(cudaError_t err, const char *what)
+{
+	if (err == cudaSuccess)
+		return;
+	fprintf(stderr, "CUDA error while %s: %s\n", what,
+		cudaGetErrorString(err));
+	exit(1);
+}
+
+/* Return the entry in the table for the host memory at "host" or
+ * NULL if there is no such entry.
+ */
+static struct ppcg_cuda_buffer *find(void *host)
+{
+	int i;
+
+	for (i = 0; i < ppcg_cuda_table.n; ++i)
+		if (ppcg_cuda_table.buffer[i].host == host)
+			return &ppcg_cuda_table.buffer[i];
+	return NULL;
+}
+
+/* Return the entry in the table for the host memory at "host",
+ * aborting if there is no such entry.
+ */
+static struct ppcg_cuda_buffer *get(void *host)
+{
+	struct ppcg_cuda_buffer *buffer;
+
+	buffer = find(host);
+	if (!buffer) {
+		fprintf(stderr, "No device copy of host memory at %p\n", host);
+		exit(1);
+	}
+	return buffer;
+}
+
+/* Copy the device copy of "buffer" back to the host if the host copy
+ * is out of date.
+ */
+static void sync_host(struct ppcg_cuda_buffer *buffer)
+{
+	if (buffer->host_valid)
+		return;
+	check(cudaMemcpy(buffer->host, buffer->dev, buffer->size,
+		cudaMemcpyDeviceToHost), "copying data to the host");
+	buffer->host_valid = 1;
+}
+
+/* Store the device copy of the "size" bytes of host memory at "host"
+ * in "dev".
+ *
+ * If there is a device copy of a different size, then the host memory
+ * has presumably been reused for a different array.
+ * Synchronize the host copy, free the old device copy and
+ * allocate a new one.  A newly allocated device copy is not up to date.
+ */
+void ppcg_cuda_acquire(void **dev, void *host, size_t size)
+{
+	struct ppcg_cuda_buffer *buffer;
+
+	buffer = find(host);
+	if (buffer && buffer->size == size) {
+		*dev = buffer->dev;
+		return;
+	}
+	if (buffer) {
+		sync_host(buffer);
+		check(cudaFree(buffer->dev), "freeing device memory");
+	} else {
+		if (ppcg_cuda_table.n == ppcg_cuda_table.size) {
+			int size = 2 * ppcg_cuda_table.size + 4;
+			struct ppcg_cuda_buffer *grown;
+
+			grown = (struct ppcg_cuda_buffer *)
+				realloc(ppcg_cuda_table.buffer,
+					size * sizeof(*grown));
+			if (!grown) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+			ppcg_cuda_table.buffer = grown;
+			ppcg_cuda_table.size = size;
+		}
+		buffer = &ppcg_cuda_table.buffer[ppcg_cuda_table.n++];
+		buffer->host = host;
+	}
+
+	buffer->size = size;
+	buffer->dev_valid = 0;
+	buffer->host_valid = 1;
+	check(cudaMalloc(&buffer->dev, size), "allocating device memory");
+
+	*dev = buffer->dev;
+}
+
+void ppcg_cuda_copy_to_device(void *host)
+{
+	struct ppcg_cuda_buffer *buffer;
+
+	buffer = get(host);
+	if (buffer->dev_valid)
+		return;
+	check(cudaMemcpy(buffer->dev, buffer->host, buffer->size,
+		cudaMemcpyHostToDevice), "copying data to the device");
+	buffer->dev_valid = 1;
+}
+
+void ppcg_cuda_copy_to_device_async(void *host, cudaStream_t stream)
+{
+	struct ppcg_cuda_buffer *buffer;
+
+	buffer = get(host);
+	if (buffer->dev_valid)
+		return;
+	check(cudaMemcpyAsync(buffer->dev, buffer->host, buffer->size,
+		cudaMemcpyHostToDevice, stream), "copying data to the device");
+	buffer->dev_valid = 1;
+}
+
+/* The generated code copies out entire arrays and makes sure that
+ * any element that is not written on the device has been copied
+ * to the device first.  The device copy is therefore up to date.
+ */
+void ppcg_cuda_mark_device_written(void *host)
+{
+	struct ppcg_cuda_buffer *buffer;
+
+	buffer = get(host);
+	buffer->dev_valid = 1;
+	buffer->host_valid = 0;
+}
+
+/* The host memory may not have a device copy, in which case
+ * there is nothing to do.
+ */
+void ppcg_cuda_host_access(void *host)
+{
+	struct ppcg_cuda_buffer *buffer;
+
+	buffer = find(host);
+	if (!buffer)
+		return;
+	sync_host(buffer);
+	buffer->dev_valid = 0;
+}
+
+void ppcg_cuda_release_all(void)
+{
+	int i;
+
+	for (i = 0; i < ppcg_cuda_table.n; ++i) {
+		struct ppcg_cuda_buffer *buffer = &ppcg_cuda_table.buffer[i];
+
+		sync_host(buffer);
+		check(cudaFree(buffer->dev), "freeing device memory");
+	}
+	free(ppcg_cuda_table.buffer);
+	ppcg_cuda_table.buffer = NULL;
+	ppcg_cuda_table.n = 0;
+	ppcg_cuda_table.size = 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#ifndef CUDA_UTILITIES_H
+#define CUDA_UTILITIES_H
+
+#include <stddef.h>
+#include <cuda_runtime_api.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Store the device copy of the "size" bytes of host memory at "host"
+ * in "dev", allocating it if there is no device copy of that size yet.
+ * The device copy is kept across calls until ppcg_cuda_release_all
+ * is called.
+ */
+void ppcg_cuda_acquire(void **dev, void *host, size_t size);
+
+/* Copy the host memory at "host" to its device copy,
+ * unless the device copy is known to be up to date.
+ */
+void ppcg_cuda_copy_to_device(void *host);
+
+/* Asynchronously copy the host memory at "host" to its device copy
+ * on "stream", unless the device copy is known to be up to date.
+ * The host memory should not be modified until the copy has completed.
+ */
+void ppcg_cuda_copy_to_device_async(void *host, cudaStream_t stream);
+
+/* Record that the device copy of the host memory at "host" has been
+ * modified, such that the host copy is out of date.
+ */
+void ppcg_cuda_mark_device_written(void *host);
+
+/* Prepare the host memory at "host" for being accessed by the host.
+ * If the host copy is out of date, then copy the data back from the device.
+ * Since the host may modify the data, the device copy is no longer
+ * considered to be up to date afterwards.
+ * This function needs to be called before the host reads or writes
+ * any memory that may be resident on the device.
+ */
+void ppcg_cuda_host_access(void *host);
+
+/* Copy back all out of date host memory and free all device copies.
+ */
+void ppcg_cuda_release_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,7 @@
 #include "cpu.h"
 #include "gpu.h"
 #include "gpu_array_tile.h"
+#include "gpu_device.h"
 #include "gpu_group.h"
 #include "gpu_hybrid.h"
 #include "gpu_tree.h"
@@ -37,6 +38,7 @@
 #include "util.h"
 #include "split_tiling.h"
 #include "overlapped_tiling.h"
+#include "stencil.h"
 #include <isl/isl_schedule_node_private.h>
 
 struct gpu_array_info;
@@ -186,6 +188,11 @@ static isl_bool only_fixed_element_accessed(struct gpu_array_info *array)
  * If the array is zero-dimensional and does not contain structures,
  * i.e., if the array is a scalar, we check whether it is read-only.
  * We also check whether the array is accessed at all.
+ *
+ * If the persistent_arrays option is set, then the device copies
+ * of arrays that are not local to the scop are kept across scops.
+ * This is only supported by the CUDA target and scalars are excluded
+ * since they are typically stored in local variables on the host.
  */
 static isl_stat extract_array_info(struct gpu_prog *prog,
 	struct gpu_array_info *info, struct pet_array *pa,
@@ -210,6 +217,9 @@ static isl_stat extract_array_info(struct gpu_prog *prog,
 	info->local = pa->declared && !pa->exposed;
 	info->has_compound_element = pa->element_is_record;
 	info->read_only_scalar = is_read_only_scalar(info, prog);
+	info->persistent = prog->scop->options->persistent_arrays &&
+		prog->scop->options->target == PPCG_TARGET_CUDA &&
+		!info->local && n_index > 0;
 
 	info->declared_extent = isl_set_copy(pa->extent);
 	accessed = isl_union_set_extract_set(arrays,
@@ -380,11 +390,23 @@ static isl_stat collect_array_info(struct gpu_prog *prog)
 	return r;
 }
 
+/* Free the fields of "box".
+ */
+static void gpu_array_box_clear(struct gpu_array_box *box)
+{
+	isl_multi_pw_aff_free(box->offset);
+	isl_multi_pw_aff_free(box->size);
+	isl_ast_expr_free(box->offset_expr);
+	isl_ast_expr_free(box->size_expr);
+}
+
 static void free_array_info(struct gpu_prog *prog)
 {
 	int i;
 
 	for (i = 0; i < prog->n_array; ++i) {
+		gpu_array_box_clear(&prog->array[i].copy_in);
+		gpu_array_box_clear(&prog->array[i].copy_out);
 		free(prog->array[i].type);
 		free(prog->array[i].name);
 		isl_multi_pw_aff_free(prog->array[i].bound);
@@ -565,20 +587,15 @@ error:
 	return isl_stat_error;
 }
 
-/* Add the map { kernel[id] -> type[sizes] } to gen->used_sizes,
- * if the option debug->dump_sizes is set.
+/* Construct the map { kernel[id] -> type[sizes] } with parameters
+ * taken from "space".
  */
-static void set_used_sizes(struct gpu_gen *gen, const char *type, int id,
-	int *sizes, int len)
+static __isl_give isl_map *kernel_sizes(__isl_take isl_space *space,
+	const char *type, int id, int *sizes, int len)
 {
 	int i;
-	isl_space *space;
 	isl_map *map;
 
-	if (!gen->options->debug->dump_sizes)
-		return;
-
-	space = isl_union_map_get_space(gen->used_sizes);
 	space = isl_space_set_from_params(space);
 	space = isl_space_add_dims(space, isl_dim_set, 1);
 	space = isl_space_set_tuple_name(space, isl_dim_set, "kernel");
@@ -591,6 +608,23 @@ static void set_used_sizes(struct gpu_gen *gen, const char *type, int id,
 	for (i = 0; i < len; ++i)
 		map = isl_map_fix_si(map, isl_dim_out, i, sizes[i]);
 
+	return map;
+}
+
+/* Add the map { kernel[id] -> type[sizes] } to gen->used_sizes,
+ * if the option debug->dump_sizes is set.
+ */
+static void set_used_sizes(struct gpu_gen *gen, const char *type, int id,
+	int *sizes, int len)
+{
+	isl_space *space;
+	isl_map *map;
+
+	if (!gen->options->debug->dump_sizes)
+		return;
+
+	space = isl_union_map_get_space(gen->used_sizes);
+	map = kernel_sizes(space, type, id, sizes, len);
 	gen->used_sizes = isl_union_map_add_map(gen->used_sizes, map);
 }
 
@@ -721,25 +755,175 @@ static isl_stat read_grid_sizes(struct ppcg_kernel *kernel,
 	return read_sizes_from_set(size, kernel->grid_dim, &kernel->n_grid);
 }
 
+/* Did the user specify any sizes of type "type" for the kernel
+ * with identifier "id" in the "sizes" command line option?
+ */
+static int has_user_sizes(__isl_keep isl_union_map *sizes, const char *type,
+	int id)
+{
+	isl_set *size;
+
+	size = extract_sizes(sizes, type, id);
+	if (!size)
+		return 0;
+	isl_set_free(size);
+	return 1;
+}
+
+/* Reduce the block of "kernel" to a single warp, placing all its threads
+ * in the x dimension, and mark the kernel as only requiring
+ * synchronization at warp level.
+ * The warp size is taken from the device description, if any.
+ * Block sizes that have been explicitly specified by the user
+ * are kept as they are.  Since such a block need not consist
+ * of exactly one warp, the kernel is then synchronized at block level.
+ */
+static void set_warp_block_sizes(struct ppcg_kernel *kernel,
+	struct gpu_gen *gen)
+{
+	int i;
+
+	if (kernel->n_block == 0)
+		return;
+	if (has_user_sizes(gen->sizes, "block", kernel->id))
+		return;
+	for (i = 0; i < kernel->n_block - 1; ++i)
+		kernel->block_dim[i] = 1;
+	kernel->block_dim[kernel->n_block - 1] =
+				gen->device ? gen->device->warp_size : 32;
+	kernel->warp_sync = 1;
+}
+
+/* Does the (effective) block of "kernel" consist of exactly one warp?
+ */
+static int is_single_warp(struct ppcg_kernel *kernel, struct gpu_gen *gen)
+{
+	int i;
+	int n = 1;
+
+	for (i = 0; i < kernel->n_block; ++i)
+		n *= kernel->block_dim[i];
+
+	return n == (gen->device ? gen->device->warp_size : 32);
+}
+
 /* Extract user specified grid and block sizes from the gen->sizes
  * command line option after filling in some potentially useful defaults.
  * Store the extracted sizes in "kernel".
- * Add the effectively used sizes to gen->used_sizes.
+ * If the kernel is mapped to a single warp, then the default block sizes
+ * are replaced by those of a single warp.
+ * Add the effectively used grid sizes to gen->used_sizes.
+ * The block sizes may still be reduced by coarsen_block_sizes and
+ * are only added to gen->used_sizes after that
+ * (see gpu_create_kernel).
  */
 static isl_stat read_grid_and_block_sizes(struct ppcg_kernel *kernel,
 	struct gpu_gen *gen)
 {
 	if (read_block_sizes(kernel, gen->sizes) < 0)
 		return isl_stat_error;
+	if (gen->warp_kernel)
+		set_warp_block_sizes(kernel, gen);
 	if (read_grid_sizes(kernel, gen->sizes) < 0)
 		return isl_stat_error;
-	set_used_sizes(gen, "block", kernel->id,
-					    kernel->block_dim, kernel->n_block);
 	set_used_sizes(gen, "grid", kernel->id,
 					    kernel->grid_dim, kernel->n_grid);
 	return isl_stat_ok;
 }
 
+/* Extract user specified "coarsen" factors from the gen->sizes
+ * command line option, defaulting to the thread_coarsening option
+ * in each dimension, and reduce the block sizes of "kernel" accordingly.
+ * "node" points to the band that is mapped to threads.
+ * Add the effectively used factors to gen->used_sizes.
+ *
+ * For each block dimension with a coarsening factor greater than one,
+ * the block size is reduced such that each thread computes
+ * (at least) the given number of points of the corresponding member
+ * of the band.  The extent of this member is computed from
+ * the domain elements that reach "node", after projecting out
+ * all parameters.  If this extent turns out to be unbounded,
+ * then the block size in this dimension is left untouched.
+ * Since the thread identifiers are equated to the band members
+ * modulo the block size, the points computed by a given thread
+ * are spread out over the band with a stride equal to the block size,
+ * preserving coalescing.
+ * If the block size has effectively been reduced, then kernel->coarsened
+ * is set so that the band mapped to threads gets unrolled.
+ *
+ * If the block has been reduced to a single warp (see set_warp_block_sizes),
+ * then it is not coarsened any further since the warp level
+ * synchronization requires all threads of the warp to be present.
+ * The coarsening factors are then all recorded as one.
+ */
+static isl_stat coarsen_block_sizes(struct ppcg_kernel *kernel,
+	struct gpu_gen *gen, __isl_keep isl_schedule_node *node)
+{
+	int i, n;
+	int coarsen[3];
+	isl_set *size;
+	isl_union_map *schedule;
+	isl_set *extent;
+	isl_local_space *ls;
+	isl_aff *obj;
+
+	if (kernel->n_block == 0)
+		return isl_stat_ok;
+
+	for (i = 0; i < kernel->n_block; ++i)
+		coarsen[i] = gen->options->thread_coarsening;
+	n = kernel->n_block;
+	size = extract_sizes(gen->sizes, "coarsen", kernel->id);
+	if (read_sizes_from_set(size, coarsen, &n) < 0)
+		return isl_stat_error;
+	if (kernel->warp_sync)
+		for (i = 0; i < kernel->n_block; ++i)
+			coarsen[i] = 1;
+	set_used_sizes(gen, "coarsen", kernel->id, coarsen, kernel->n_block);
+
+	for (i = 0; i < kernel->n_block; ++i)
+		if (coarsen[i] > 1)
+			break;
+	if (i >= kernel->n_block)
+		return isl_stat_ok;
+
+	schedule = isl_union_map_from_multi_union_pw_aff(
+			isl_schedule_node_band_get_partial_schedule(node));
+	schedule = isl_union_map_intersect_domain(schedule,
+			isl_schedule_node_get_domain(node));
+	extent = isl_set_from_union_set(isl_union_map_range(schedule));
+	extent = isl_set_project_out(extent, isl_dim_param, 0,
+				    isl_set_dim(extent, isl_dim_param));
+
+	ls = isl_local_space_from_space(isl_set_get_space(extent));
+	obj = isl_aff_zero_on_domain(ls);
+	for (i = 0; i < kernel->n_block; ++i) {
+		isl_val *max;
+		int block;
+
+		if (coarsen[i] <= 1)
+			continue;
+		obj = isl_aff_set_coefficient_si(obj, isl_dim_in, i, 1);
+		max = isl_set_max_val(extent, obj);
+		obj = isl_aff_set_coefficient_si(obj, isl_dim_in, i, 0);
+		if (!max)
+			break;
+		if (isl_val_is_int(max)) {
+			block = isl_val_get_num_si(max) + 1;
+			block = (block + coarsen[i] - 1) / coarsen[i];
+			if (block < kernel->block_dim[i]) {
+				kernel->block_dim[i] = block;
+				kernel->coarsened = 1;
+			}
+		}
+		isl_val_free(max);
+	}
+	isl_aff_free(obj);
+	isl_set_free(extent);
+
+	return i < kernel->n_block ? isl_stat_error : isl_stat_ok;
+}
+
 static void *free_stmts(struct gpu_stmt *stmts, int n)
 {
 	int i;
@@ -983,145 +1167,685 @@ static __isl_give isl_pw_multi_aff *compute_sched_to_copy(
 	return isl_pw_multi_aff_pullback_pw_multi_aff(pma, iterator_map);
 }
 
-/* If max_shared_memory is not set to infinity (-1), then make
- * sure that the total amount of shared memory required by the
- * array reference groups mapped to shared memory by "kernel"
- * is no larger than this maximum.
- *
- * We apply a greedy approach and discard (keep in global memory)
- * those groups that would result in a total memory size that
- * is larger than the maximum.
- *
- * This function should be called after any function that may
- * affect the decision on whether to place a reference group
- * in private, shared or global memory.
+/* Return the number of elements of "array" that fit in a 16 byte
+ * vector access or 0 if no vector type is available for the elements.
+ */
+static int vector_width(struct gpu_array_info *array)
+{
+	if (strcmp(array->type, "float") && strcmp(array->type, "double") &&
+	    strcmp(array->type, "int"))
+		return 0;
+	if (array->size != 4 && array->size != 8)
+		return 0;
+	return 16 / array->size;
+}
+
+/* Adjust "bound" such that both its lower bound and its size
+ * are multiples of "width", while still containing the original range.
+ * That is, the lower bound is rounded down to a multiple of "width" and
+ * the size is rounded up to a multiple of "width", after increasing it
+ * by width - 1 if the lower bound was not known to be a multiple
+ * of "width" already.
  */
-static void check_shared_memory_bound(struct ppcg_kernel *kernel)
+static void align_bound(struct gpu_array_bound *bound, int width)
+{
+	isl_ctx *ctx;
+	isl_aff *lb;
+	isl_val *w;
+	isl_bool equal;
+
+	ctx = isl_aff_get_ctx(bound->lb);
+	w = isl_val_int_from_si(ctx, width);
+	lb = isl_aff_copy(bound->lb);
+	lb = isl_aff_scale_down_val(lb, isl_val_copy(w));
+	lb = isl_aff_floor(lb);
+	lb = isl_aff_scale_val(lb, isl_val_copy(w));
+	equal = isl_aff_plain_is_equal(lb, bound->lb);
+	if (equal < 0 || !equal)
+		bound->size = isl_val_add_ui(bound->size, width - 1);
+	bound->size = isl_val_div(bound->size, isl_val_copy(w));
+	bound->size = isl_val_ceil(bound->size);
+	bound->size = isl_val_mul(bound->size, w);
+	isl_aff_free(bound->lb);
+	bound->lb = lb;
+}
+
+/* If the vector_copies option is set, then prepare the shared memory
+ * tiles of "kernel" for being copied in using 16 byte vector accesses.
+ *
+ * This is only possible for non-scalar arrays with an element type
+ * for which a vector type is available and if there is no stride
+ * in the innermost dimension.
+ * The innermost dimension of the tile is aligned such that
+ * the position of an element inside a vector of the tile is
+ * the same as its position inside a vector of the global array.
+ * The resulting increase in size is taken into account by
+ * check_shared_memory_bound, which should therefore be called afterwards.
+ */
+static void align_vector_tiles(struct ppcg_kernel *kernel)
 {
 	int i, j;
-	isl_val *left, *size;
 
-	if (kernel->options->max_shared_memory < 0)
+	if (!kernel->options->vector_copies)
 		return;
 
-	left = isl_val_int_from_si(kernel->ctx,
-				    kernel->options->max_shared_memory);
-
 	for (i = 0; i < kernel->n_array; ++i) {
 		struct gpu_local_array_info *local = &kernel->array[i];
+		int width;
 
+		if (gpu_array_is_scalar(local->array))
+			continue;
+		width = vector_width(local->array);
+		if (!width)
+			continue;
 		for (j = 0; j < local->n_group; ++j) {
-			struct gpu_array_ref_group *group;
-			enum ppcg_group_access_type type;
+			struct gpu_array_ref_group *group = local->groups[j];
+			struct gpu_array_tile *tile;
 
-			group = local->groups[j];
-			type = gpu_array_ref_group_type(group);
-			if (type != ppcg_access_shared)
+			if (gpu_array_ref_group_type(group) !=
+							ppcg_access_shared)
 				continue;
-
-			size = gpu_array_tile_size(group->shared_tile);
-			size = isl_val_mul_ui(size, local->array->size);
-
-			if (isl_val_le(size, left)) {
-				left = isl_val_sub(left, size);
+			tile = group->shared_tile;
+			if (!isl_val_is_one(tile->bound[tile->n - 1].stride))
 				continue;
-			}
-			isl_val_free(size);
+			align_bound(&tile->bound[tile->n - 1], width);
+			tile->vector = width;
+		}
+	}
+}
+
+/* Data used in bank_conflict_degree.
+ *
+ * tile is the shared memory tile being considered.
+ * padding is the candidate padding of the innermost dimension of the tile.
+ * words is the number of 4 byte words in an array element.
+ * degree is the maximal degree of bank conflicts encountered so far.
+ */
+struct ppcg_bank_data {
+	struct gpu_array_tile *tile;
+	int padding;
+	int words;
+	int degree;
+};
 
-			group->shared_tile =
-					gpu_array_tile_free(group->shared_tile);
+/* Return the greatest common divisor of "a" and "b".
+ */
+static long gcd(long a, long b)
+{
+	while (b != 0) {
+		long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Update data->degree with the degree of the bank conflicts caused
+ * by threads with consecutive values of the innermost thread identifier
+ * accessing array elements that differ by "delta",
+ * assuming 32 banks of 4 byte words.
+ *
+ * The difference in offset inside the tile, with the innermost dimension
+ * increased by data->padding, is computed first.
+ * The threads in a warp then access every gcd(offset * words, 32)/words-th
+ * bank, except if the offset is zero, in which case all threads
+ * access the same element and the value is broadcast.
+ * Elements of more than one word are accessed in as many phases,
+ * which is why the degree is divided by the number of words.
+ * Differences that are not a multiple of the stride of the tile
+ * are ignored.
+ */
+static isl_stat bank_conflict_degree(__isl_take isl_point *delta, void *user)
+{
+	struct ppcg_bank_data *data = user;
+	struct gpu_array_tile *tile = data->tile;
+	int i, degree;
+	long offset = 0;
+
+	for (i = 0; i < tile->n; ++i) {
+		isl_val *v, *size;
+		isl_bool is_int;
+
+		v = isl_point_get_coordinate_val(delta, isl_dim_set, i);
+		v = isl_val_div(v, isl_val_copy(tile->bound[i].stride));
+		is_int = isl_val_is_int(v);
+		if (is_int < 0 || !is_int) {
+			isl_val_free(v);
+			isl_point_free(delta);
+			return is_int < 0 ? isl_stat_error : isl_stat_ok;
 		}
+		size = isl_val_copy(tile->bound[i].size);
+		if (i == tile->n - 1)
+			size = isl_val_add_ui(size, data->padding);
+		offset = offset * isl_val_get_num_si(size) +
+			isl_val_get_num_si(v);
+		isl_val_free(size);
+		isl_val_free(v);
 	}
+	isl_point_free(delta);
 
-	isl_val_free(left);
+	if (offset < 0)
+		offset = -offset;
+	if (offset == 0)
+		return isl_stat_ok;
+	degree = gcd(offset * data->words, 32) / data->words;
+	if (degree > data->degree)
+		data->degree = degree;
+
+	return isl_stat_ok;
 }
 
-/* Mark all arrays of "kernel" that have an array reference group
- * that is not mapped to private or shared memory as
- * accessing the corresponding global device memory.
+/* Compute the padding of the innermost dimension of the shared memory tile
+ * of "group" that minimizes the degree of the bank conflicts
+ * caused by the accesses in the group and store it in tile->padding.
+ * If there are no bank conflicts without padding, then the tile
+ * is left untouched.
+ * The accesses are described by group->thread_x_delta.
+ * Only paddings smaller than the number of banks are considered
+ * and only multiples of the vector width if the tile
+ * has been prepared for vector accesses.
+ * Return 1 if the tile has been padded, 0 if not and -1 on error.
  */
-static void mark_global_arrays(struct ppcg_kernel *kernel)
+static int pad_shared_tile(struct gpu_array_ref_group *group)
 {
-	int i, j;
+	struct gpu_array_tile *tile = group->shared_tile;
+	struct ppcg_bank_data data = { tile, 0, 0, 0 };
+	int padding, best, step;
+
+	if (!group->thread_x_delta || tile->n < 2)
+		return 0;
+	if (group->array->size < 4 || group->array->size % 4 != 0)
+		return 0;
+
+	data.words = group->array->size / 4;
+	data.degree = 1;
+	if (isl_set_foreach_point(group->thread_x_delta,
+				&bank_conflict_degree, &data) < 0)
+		return -1;
+	if (data.degree <= 1)
+		return 0;
+
+	best = data.degree;
+	step = tile->vector ? tile->vector : 1;
+	for (padding = step; padding < 32; padding += step) {
+		data.padding = padding;
+		data.degree = 1;
+		if (isl_set_foreach_point(group->thread_x_delta,
+					&bank_conflict_degree, &data) < 0)
+			return -1;
+		if (data.degree >= best)
+			continue;
+		best = data.degree;
+		tile->padding = padding;
+		if (best == 1)
+			break;
+	}
+
+	return tile->padding != 0;
+}
+
+/* If the pad_shared option is set, then pad the innermost dimension
+ * of the shared memory tiles of "kernel" to avoid bank conflicts.
+ * Add the padded sizes of the tiles to gen->used_sizes.
+ * The resulting increase in size is taken into account by
+ * check_shared_memory_bound, which should therefore be called afterwards.
+ */
+static isl_stat pad_shared_tiles(struct ppcg_kernel *kernel,
+	struct gpu_gen *gen)
+{
+	int i, j, k;
+
+	if (!kernel->options->pad_shared)
+		return isl_stat_ok;
 
 	for (i = 0; i < kernel->n_array; ++i) {
 		struct gpu_local_array_info *local = &kernel->array[i];
 
-		if (local->global)
-			continue;
 		for (j = 0; j < local->n_group; ++j) {
-			if (gpu_array_ref_group_tile(local->groups[j]))
+			struct gpu_array_ref_group *group = local->groups[j];
+			struct gpu_array_tile *tile;
+			isl_printer *p;
+			char *name;
+			int *sizes;
+			int padded;
+
+			if (gpu_array_ref_group_type(group) !=
+							ppcg_access_shared)
+				continue;
+			padded = pad_shared_tile(group);
+			if (padded < 0)
+				return isl_stat_error;
+			if (!padded)
 				continue;
 
-			local->global = 1;
-			local->array->global = 1;
-			break;
+			tile = group->shared_tile;
+			sizes = isl_alloc_array(kernel->ctx, int, tile->n);
+			if (!sizes)
+				return isl_stat_error;
+			for (k = 0; k < tile->n; ++k)
+				sizes[k] = isl_val_get_num_si(
+							tile->bound[k].size);
+			sizes[tile->n - 1] += tile->padding;
+			p = isl_printer_to_str(kernel->ctx);
+			p = gpu_array_ref_group_print_name(group, p);
+			name = isl_printer_get_str(p);
+			isl_printer_free(p);
+			set_used_sizes(gen, name, kernel->id, sizes, tile->n);
+			free(name);
+			free(sizes);
 		}
 	}
+
+	return isl_stat_ok;
 }
 
-/* Compute a tiling for all the array reference groups in "kernel".
+/* Solve the 0/1 knapsack problem of selecting elements
+ * from the "n" items with weights "weight" and values "value"
+ * such that the total weight is at most "capacity" and
+ * the total value is maximal.
+ * The selection is stored in "keep".
+ *
+ * The problem is solved using dynamic programming over the capacity.
+ * To keep the table small, the weights and the capacity are first
+ * divided by their greatest common divisor and, if the capacity
+ * is still too large, they are scaled down further, rounding
+ * the weights up and the capacity down such that the selection
+ * remains valid, at the cost of possibly losing optimality.
+ */
+static isl_stat knapsack(isl_ctx *ctx, int n, long *weight, long *value,
+	long capacity, int *keep)
+{
+	int k;
+	long c, g, scale, cap;
+	long *w, *best;
+	char *take;
+
+	for (k = 0; k < n; ++k)
+		keep[k] = 0;
+	g = capacity;
+	for (k = 0; k < n; ++k)
+		g = gcd(g, weight[k]);
+	if (g == 0)
+		g = 1;
+	cap = capacity / g;
+	scale = 1;
+	if (cap > (1 << 16))
+		scale = (cap + (1 << 16) - 1) >> 16;
+	cap /= scale;
+
+	w = isl_alloc_array(ctx, long, n);
+	best = isl_calloc_array(ctx, long, cap + 1);
+	take = isl_calloc_array(ctx, char, n * (cap + 1));
+	if (!w || !best || (n && !take)) {
+		free(w);
+		free(best);
+		free(take);
+		return isl_stat_error;
+	}
+
+	for (k = 0; k < n; ++k) {
+		w[k] = (weight[k] / g + scale - 1) / scale;
+		for (c = cap; c >= w[k]; --c) {
+			if (best[c - w[k]] + value[k] <= best[c])
+				continue;
+			best[c] = best[c - w[k]] + value[k];
+			take[k * (cap + 1) + c] = 1;
+		}
+	}
+
+	c = cap;
+	for (k = n - 1; k >= 0; --k) {
+		if (!take[k * (cap + 1) + c])
+			continue;
+		keep[k] = 1;
+		c -= w[k];
+	}
+
+	free(w);
+	free(best);
+	free(take);
+
+	return isl_stat_ok;
+}
+
+/* Report that the array reference group "group" is (if "kept" is set)
+ * or is not (if "kept" is not set) mapped to shared memory in "kernel",
+ * along with the size of the tile in bytes and its estimated reuse.
  */
-static void compute_group_tilings(struct ppcg_kernel *kernel)
+static void report_shared_placement(struct ppcg_kernel *kernel,
+	struct gpu_array_ref_group *group, long size, int kept)
 {
-	int i, j;
+	isl_printer *p;
+	isl_val *v;
 
-	for (i = 0; i < kernel->n_array; ++i) {
-		struct gpu_local_array_info *array = &kernel->array[i];
+	p = isl_printer_to_file(kernel->ctx, stdout);
+	p = isl_printer_print_str(p, "Array reference group ");
+	p = gpu_array_ref_group_print_name(group, p);
+	p = isl_printer_print_str(p, kept ? " mapped" : " not mapped");
+	p = isl_printer_print_str(p, " to shared memory in kernel ");
+	p = isl_printer_print_int(p, kernel->id);
+	p = isl_printer_print_str(p, " (size ");
+	v = isl_val_int_from_si(kernel->ctx, size);
+	p = isl_printer_print_val(p, v);
+	isl_val_free(v);
+	p = isl_printer_print_str(p, " bytes, estimated reuse ");
+	v = isl_val_int_from_si(kernel->ctx, group->shared_reuse);
+	p = isl_printer_print_val(p, v);
+	isl_val_free(v);
+	p = isl_printer_print_str(p, ")");
+	p = isl_printer_end_line(p);
+	isl_printer_free(p);
+}
 
-		for (j = 0; j < array->n_group; ++j)
-			gpu_array_ref_group_compute_tiling(array->groups[j]);
-	}
+/* Return the size in bytes of the shared memory tile of "group".
+ */
+static long shared_tile_bytes(struct gpu_array_ref_group *group)
+{
+	isl_val *size;
+	long bytes;
+
+	size = gpu_array_tile_size(group->shared_tile);
+	size = isl_val_mul_ui(size, group->array->size);
+	bytes = isl_val_get_num_si(size);
+	isl_val_free(size);
+
+	return bytes;
 }
 
-/* Compute the effective grid size as a list of the sizes in each dimension.
- *
- * The grid size specified by the user or set by default
- * in read_grid_sizes() and applied by the block filter,
- * may be too large for the given code in the sense that
- * it may contain blocks that don't need to execute anything.
- * We therefore don't return this grid size, but instead the
- * smallest grid size that ensures that all blocks that actually
- * execute code are included in the grid.
+/* If max_shared_memory is not set to infinity (-1), then make
+ * sure that the total amount of shared memory required by the
+ * array reference groups mapped to shared memory by "kernel"
+ * is no larger than this maximum.
  *
- * We first extract a description of the grid, i.e., the possible values
- * of the block ids, from the domain elements in "domain" and
- * kernel->block_filter.
- * The block ids are parameters in kernel->block_filter.
- * We simply need to change them into set dimensions.
+ * Each group is assigned a value equal to the estimated number
+ * of global memory accesses that are replaced by shared memory accesses,
+ * i.e., the size of the tile (in elements) times its estimated reuse,
+ * and the groups that maximize the total value within
+ * the available shared memory are selected by solving
+ * the corresponding 0/1 knapsack problem.
+ * Groups that are not selected are kept in global memory.
+ * Note that groups with a private memory tile are not considered here
+ * since they are mapped to registers anyway.
+ * Any padding of the tiles is included in their sizes.
+ * If a padded tile does not get selected, then it is still mapped
+ * to shared memory without padding if that fits in the remaining space.
+ * If the verbose option is set, then the final placement is reported.
  *
- * Then, for each block dimension, we compute the maximal value of the block id
- * and add one.
+ * This function should be called after any function that may
+ * affect the decision on whether to place a reference group
+ * in private, shared or global memory.
  */
-static __isl_give isl_multi_pw_aff *extract_grid_size(
-	struct ppcg_kernel *kernel, __isl_take isl_union_set *domain)
+static isl_stat check_shared_memory_bound(struct ppcg_kernel *kernel)
 {
-	int i;
-	isl_set *grid;
-	isl_set *context;
-	isl_multi_pw_aff *size;
+	int i, j, k, n;
+	long left;
+	struct gpu_array_ref_group **groups;
+	long *weight, *value;
+	int *keep;
 
-	domain = isl_union_set_intersect(domain,
-				    isl_union_set_copy(kernel->block_filter));
-	grid = isl_union_set_params(domain);
-	grid = isl_set_from_params(grid);
-	grid = isl_set_add_dims(grid, isl_dim_set, kernel->n_grid);
-	for (i = 0; i < kernel->n_grid; ++i) {
-		int pos;
-		isl_id *id;
+	if (kernel->options->max_shared_memory < 0)
+		return isl_stat_ok;
 
-		if (!grid)
-			return NULL;
+	n = 0;
+	for (i = 0; i < kernel->n_array; ++i) {
+		struct gpu_local_array_info *local = &kernel->array[i];
 
-		id = isl_id_list_get_id(kernel->block_ids, i);
-		pos = isl_set_find_dim_by_id(grid, isl_dim_param, id);
-		isl_id_free(id);
-		if (pos < 0)
-			isl_die(isl_set_get_ctx(grid), isl_error_internal,
-				"missing constraints on block identifier",
-				grid = isl_set_free(grid));
-		grid = isl_set_equate(grid, isl_dim_param, pos, isl_dim_set, i);
-		grid = isl_set_project_out(grid, isl_dim_param, pos, 1);
+		for (j = 0; j < local->n_group; ++j)
+			if (gpu_array_ref_group_type(local->groups[j]) ==
+							ppcg_access_shared)
+				n++;
+	}
+	if (n == 0)
+		return isl_stat_ok;
+
+	groups = isl_alloc_array(kernel->ctx,
+				struct gpu_array_ref_group *, n);
+	weight = isl_alloc_array(kernel->ctx, long, n);
+	value = isl_alloc_array(kernel->ctx, long, n);
+	keep = isl_alloc_array(kernel->ctx, int, n);
+	if (!groups || !weight || !value || !keep)
+		goto error;
+
+	k = 0;
+	for (i = 0; i < kernel->n_array; ++i) {
+		struct gpu_local_array_info *local = &kernel->array[i];
+
+		for (j = 0; j < local->n_group; ++j) {
+			struct gpu_array_ref_group *group = local->groups[j];
+			isl_val *size;
+
+			if (gpu_array_ref_group_type(group) !=
+							ppcg_access_shared)
+				continue;
+			groups[k] = group;
+			weight[k] = shared_tile_bytes(group);
+			size = gpu_array_tile_size(group->shared_tile);
+			value[k] = isl_val_get_num_si(size) *
+					(group->shared_reuse > 0 ?
+					 group->shared_reuse : 1);
+			isl_val_free(size);
+			k++;
+		}
+	}
+
+	left = kernel->options->max_shared_memory;
+	if (knapsack(kernel->ctx, n, weight, value, left, keep) < 0)
+		goto error;
+
+	for (k = 0; k < n; ++k)
+		if (keep[k])
+			left -= weight[k];
+
+	for (k = 0; k < n; ++k) {
+		struct gpu_array_tile *tile = groups[k]->shared_tile;
+		int padding;
+
+		if (keep[k] || !tile->padding)
+			continue;
+		padding = tile->padding;
+		tile->padding = 0;
+		weight[k] = shared_tile_bytes(groups[k]);
+		if (weight[k] > left) {
+			tile->padding = padding;
+			continue;
+		}
+		keep[k] = 1;
+		left -= weight[k];
+	}
+
+	for (k = 0; k < n; ++k) {
+		if (kernel->options->debug->verbose)
+			report_shared_placement(kernel, groups[k],
+						weight[k], keep[k]);
+		if (!keep[k])
+			groups[k]->shared_tile =
+				gpu_array_tile_free(groups[k]->shared_tile);
+	}
+
+	free(groups);
+	free(weight);
+	free(value);
+	free(keep);
+	return isl_stat_ok;
+error:
+	free(groups);
+	free(weight);
+	free(value);
+	free(keep);
+	return isl_stat_error;
+}
+
+/* Is the shared memory tile of "group" in "local" a candidate
+ * for double buffering?
+ * That is, has double buffering been requested and is the group
+ * a non-scalar group that is mapped to shared memory and
+ * that belongs to an array that is not written inside the kernel?
+ * The last condition ensures that the next tile can be loaded
+ * early without reading stale data.
+ */
+static int is_double_buffer_candidate(struct ppcg_kernel *kernel,
+	struct gpu_local_array_info *local, struct gpu_array_ref_group *group)
+{
+	int j;
+
+	if (!kernel->options->double_buffer_shared)
+		return 0;
+	if (gpu_array_ref_group_type(group) != ppcg_access_shared)
+		return 0;
+	if (gpu_array_is_scalar(local->array))
+		return 0;
+	for (j = 0; j < local->n_group; ++j)
+		if (local->groups[j]->write)
+			return 0;
+
+	return 1;
+}
+
+/* Reserve room for a second copy of the shared memory tiles
+ * of the candidates for double buffering in "kernel".
+ *
+ * If max_shared_memory is not set to infinity (-1), then
+ * we apply a greedy approach on the shared memory that is left
+ * after the single copies
+ * of all shared memory tiles have been taken into account.
+ * Groups for which there is no room for a second copy
+ * are simply not double buffered.
+ */
+static void reserve_double_buffers(struct ppcg_kernel *kernel)
+{
+	int i, j;
+	isl_val *left, *size;
+
+	if (!kernel->options->double_buffer_shared)
+		return;
+
+	left = isl_val_int_from_si(kernel->ctx,
+				    kernel->options->max_shared_memory);
+	for (i = 0; i < kernel->n_array; ++i) {
+		struct gpu_local_array_info *local = &kernel->array[i];
+
+		for (j = 0; j < local->n_group; ++j) {
+			struct gpu_array_ref_group *group = local->groups[j];
+
+			if (gpu_array_ref_group_type(group) !=
+							ppcg_access_shared)
+				continue;
+			size = gpu_array_tile_size(group->shared_tile);
+			size = isl_val_mul_ui(size, local->array->size);
+			left = isl_val_sub(left, size);
+		}
+	}
+
+	for (i = 0; i < kernel->n_array; ++i) {
+		struct gpu_local_array_info *local = &kernel->array[i];
+
+		for (j = 0; j < local->n_group; ++j) {
+			struct gpu_array_ref_group *group = local->groups[j];
+
+			if (!is_double_buffer_candidate(kernel, local, group))
+				continue;
+			if (kernel->options->max_shared_memory >= 0) {
+				size = gpu_array_tile_size(group->shared_tile);
+				size = isl_val_mul_ui(size, local->array->size);
+				if (!isl_val_le(size, left)) {
+					isl_val_free(size);
+					continue;
+				}
+				left = isl_val_sub(left, size);
+			}
+			group->shared_tile->double_buffer = 1;
+		}
+	}
+
+	isl_val_free(left);
+}
+
+/* Mark all arrays of "kernel" that have an array reference group
+ * that is not mapped to private or shared memory as
+ * accessing the corresponding global device memory.
+ */
+static void mark_global_arrays(struct ppcg_kernel *kernel)
+{
+	int i, j;
+
+	for (i = 0; i < kernel->n_array; ++i) {
+		struct gpu_local_array_info *local = &kernel->array[i];
+
+		if (local->global)
+			continue;
+		for (j = 0; j < local->n_group; ++j) {
+			if (gpu_array_ref_group_tile(local->groups[j]))
+				continue;
+
+			local->global = 1;
+			local->array->global = 1;
+			break;
+		}
+	}
+}
+
+/* Compute a tiling for all the array reference groups in "kernel".
+ */
+static void compute_group_tilings(struct ppcg_kernel *kernel)
+{
+	int i, j;
+
+	for (i = 0; i < kernel->n_array; ++i) {
+		struct gpu_local_array_info *array = &kernel->array[i];
+
+		for (j = 0; j < array->n_group; ++j)
+			gpu_array_ref_group_compute_tiling(array->groups[j]);
+	}
+}
+
+/* Compute the effective grid size as a list of the sizes in each dimension.
+ *
+ * The grid size specified by the user or set by default
+ * in read_grid_sizes() and applied by the block filter,
+ * may be too large for the given code in the sense that
+ * it may contain blocks that don't need to execute anything.
+ * We therefore don't return this grid size, but instead the
+ * smallest grid size that ensures that all blocks that actually
+ * execute code are included in the grid.
+ *
+ * We first extract a description of the grid, i.e., the possible values
+ * of the block ids, from the domain elements in "domain" and
+ * kernel->block_filter.
+ * The block ids are parameters in kernel->block_filter.
+ * We simply need to change them into set dimensions.
+ *
+ * Then, for each block dimension, we compute the maximal value of the block id
+ * and add one.
+ */
+static __isl_give isl_multi_pw_aff *extract_grid_size(
+	struct ppcg_kernel *kernel, __isl_take isl_union_set *domain)
+{
+	int i;
+	isl_set *grid;
+	isl_set *context;
+	isl_multi_pw_aff *size;
+
+	domain = isl_union_set_intersect(domain,
+				    isl_union_set_copy(kernel->block_filter));
+	grid = isl_union_set_params(domain);
+	grid = isl_set_from_params(grid);
+	grid = isl_set_add_dims(grid, isl_dim_set, kernel->n_grid);
+	for (i = 0; i < kernel->n_grid; ++i) {
+		int pos;
+		isl_id *id;
+
+		if (!grid)
+			return NULL;
+
+		id = isl_id_list_get_id(kernel->block_ids, i);
+		pos = isl_set_find_dim_by_id(grid, isl_dim_param, id);
+		isl_id_free(id);
+		if (pos < 0)
+			isl_die(isl_set_get_ctx(grid), isl_error_internal,
+				"missing constraints on block identifier",
+				grid = isl_set_free(grid));
+		grid = isl_set_equate(grid, isl_dim_param, pos, isl_dim_set, i);
+		grid = isl_set_project_out(grid, isl_dim_param, pos, 1);
 	}
 
 	grid = isl_set_coalesce(grid);
@@ -1294,6 +2018,21 @@ static void create_kernel_var(isl_ctx *ctx, struct gpu_array_ref_group *group,
 	for (j = 0; j < group->array->n_index; ++j)
 		var->size = isl_vec_set_element_val(var->size, j,
 					    isl_val_copy(tile->bound[j].size));
+	if (tile->padding) {
+		isl_val *v;
+
+		j = group->array->n_index - 1;
+		v = isl_vec_get_element_val(var->size, j);
+		v = isl_val_add_ui(v, tile->padding);
+		var->size = isl_vec_set_element_val(var->size, j, v);
+	}
+
+	if (tile->buffer) {
+		var->size = isl_vec_insert_els(var->size, 0, 1);
+		var->size = isl_vec_set_element_si(var->size, 0, 2);
+	}
+	if (tile->vector)
+		var->align = tile->vector * group->array->size;
 }
 
 static isl_stat create_kernel_vars(struct ppcg_kernel *kernel)
@@ -1724,7 +2463,7 @@ static __isl_give isl_multi_pw_aff *transform_index(
 					    tile->depth, dim - tile->depth);
 	pma = isl_pw_multi_aff_product(sched2depth, pma);
 	tiling = isl_multi_pw_aff_from_multi_aff(
-				    isl_multi_aff_copy(tile->tiling));
+				    gpu_array_tile_get_buffered_tiling(tile));
 	tiling = isl_multi_pw_aff_pullback_pw_multi_aff(tiling, pma);
 
 	index = tile_outer(index, tiling);
@@ -1965,7 +2704,9 @@ static __isl_give isl_ast_node *create_domain_leaf(
  * Attach a pointer to a ppcg_kernel_stmt representing the copy
  * statement to the node.
  * The statement name is "read" or "write", depending on whether we are
- * reading from global memory or writing to global memory.
+ * reading from global memory or writing to global memory,
+ * or "read_vector" if a vector of elements is read
+ * from global memory (see add_copies_group_shared).
  *
  * The schedule is of the form
  *
@@ -2011,9 +2752,12 @@ static __isl_give isl_ast_node *create_access_leaf(struct ppcg_kernel *kernel,
 	if (!stmt)
 		return isl_ast_node_free(node);
 
+	tile = gpu_array_ref_group_tile(group);
 	access = isl_map_from_union_map(isl_ast_build_get_schedule(build));
 	type = isl_map_get_tuple_name(access, isl_dim_in);
-	stmt->u.c.read = type && !strcmp(type, "read");
+	stmt->u.c.read = type && strcmp(type, "write") != 0;
+	if (type && !strcmp(type, "read_vector"))
+		stmt->u.c.vector = tile->vector;
 	access = isl_map_reverse(access);
 	pma = isl_pw_multi_aff_from_map(access);
 	pma = isl_pw_multi_aff_reset_tuple_id(pma, isl_dim_out);
@@ -2029,9 +2773,8 @@ static __isl_give isl_ast_node *create_access_leaf(struct ppcg_kernel *kernel,
 							    expr);
 	stmt->u.c.index = expr;
 
-	tile = gpu_array_ref_group_tile(group);
 	pma2 = isl_pw_multi_aff_from_multi_aff(
-					    isl_multi_aff_copy(tile->tiling));
+				    gpu_array_tile_get_buffered_tiling(tile));
 	pma2 = isl_pw_multi_aff_pullback_pw_multi_aff(pma2, pma);
 	expr = isl_ast_build_access_from_pw_multi_aff(build, pma2);
 	stmt->u.c.local_index = expr;
@@ -2062,6 +2805,7 @@ static __isl_give isl_ast_node *create_sync_leaf(
 		return isl_ast_node_free(node);
 
 	stmt->type = ppcg_kernel_sync;
+	stmt->u.s.warp = kernel->warp_sync;
 	id = isl_id_alloc(kernel->ctx, "sync", stmt);
 	id = isl_id_set_free_user(id, &ppcg_kernel_stmt_free);
 	if (!id)
@@ -2069,6 +2813,37 @@ static __isl_give isl_ast_node *create_sync_leaf(
 	return isl_ast_node_set_annotation(node, id);
 }
 
+/* Build AST expressions for the offset and size of the box of elements
+ * of "array" that is copied to the device (if "to_host" is not set) or
+ * back from the device (if "to_host" is set) using "build",
+ * provided the array is only partially copied.
+ * "node" is freed in case of error.
+ */
+static __isl_give isl_ast_node *build_copy_box(__isl_take isl_ast_node *node,
+	struct gpu_array_info *array, int to_host,
+	__isl_keep isl_ast_build *build)
+{
+	struct gpu_array_box *box;
+
+	if (!array)
+		return isl_ast_node_free(node);
+
+	box = to_host ? &array->copy_out : &array->copy_in;
+	if (!box->offset)
+		return node;
+
+	isl_ast_expr_free(box->offset_expr);
+	isl_ast_expr_free(box->size_expr);
+	box->offset_expr = ppcg_build_size_expr(
+				isl_multi_pw_aff_copy(box->offset), build);
+	box->size_expr = ppcg_build_size_expr(
+				isl_multi_pw_aff_copy(box->size), build);
+	if (!box->offset_expr || !box->size_expr)
+		return isl_ast_node_free(node);
+
+	return node;
+}
+
 /* Build AST expressions for the device array sizes of all arrays in "prog"
  * that require allocation on the device using "build", as well as
  * for the original array sizes of all arrays that need to be declared
@@ -2140,8 +2915,9 @@ struct ppcg_at_domain_data {
  * create_domain_leaf.  If it is "init_device", then we call
  * build_array_bounds.  Otherwise, we check if it is a copy or synchronization
  * statement and call the appropriate functions.  Statements that copy an array
- * to/from the device do not need any further treatment.
- * Neither does "clear_device".
+ * to/from the device only need further treatment if only a box
+ * of the array is copied, in which case build_copy_box is called.
+ * "clear_device" does not need any further treatment.
  */
 static __isl_give isl_ast_node *at_domain(__isl_take isl_ast_node *node,
 	__isl_keep isl_ast_build *build, void *user)
@@ -2169,15 +2945,18 @@ static __isl_give isl_ast_node *at_domain(__isl_take isl_ast_node *node,
 	if (gpu_stmt)
 		return create_domain_leaf(data->kernel, node, build, gpu_stmt);
 
-	if (!prefixcmp(name, "to_device_") || !prefixcmp(name, "from_device_"))
-		return node;
+	if (!prefixcmp(name, "to_device_"))
+		return build_copy_box(node, p, 0, build);
+	if (!prefixcmp(name, "from_device_"))
+		return build_copy_box(node, p, 1, build);
 	if (!strcmp(name, "init_device"))
 		return build_array_bounds(node, data->prog, build);
 	if (!strcmp(name, "clear_device"))
 		return node;
 	if (is_sync < 0)
 		return isl_ast_node_free(node);
-	if (!strcmp(name, "read") || !strcmp(name, "write")) {
+	if (!strcmp(name, "read") || !strcmp(name, "write") ||
+	    !strcmp(name, "read_vector")) {
 		struct gpu_array_ref_group *group = p;
 		return create_access_leaf(data->kernel, group, node, build);
 	}
@@ -3281,18 +4060,14 @@ static __isl_give isl_union_map *anchored_non_local_accesses(
 
 /* Given an array reference group "group", create a mapping
  *
- *	read[D -> A] -> [D -> A]
- *
- * if "read" is set or
- *
- *	write[D -> A] -> [D -> A]
+ *	type[D -> A] -> [D -> A]
  *
- * if "read" is not set.
+ * with "type" equal to "name".
  * D corresponds to the outer tile->depth dimensions of
  * the kernel schedule.
  */
-static __isl_give isl_multi_aff *create_from_access(isl_ctx *ctx,
-	struct gpu_array_ref_group *group, int read)
+static __isl_give isl_multi_aff *create_named_from_access(isl_ctx *ctx,
+	struct gpu_array_ref_group *group, const char *name)
 {
 	struct gpu_array_tile *tile;
 	isl_space *space;
@@ -3305,12 +4080,30 @@ static __isl_give isl_multi_aff *create_from_access(isl_ctx *ctx,
 	space = isl_space_wrap(space);
 	space = isl_space_map_from_set(space);
 
-	id = isl_id_alloc(ctx, read ? "read" : "write", group);
+	id = isl_id_alloc(ctx, name, group);
 	space = isl_space_set_tuple_id(space, isl_dim_in, id);
 
 	return isl_multi_aff_identity(space);
 }
 
+/* Given an array reference group "group", create a mapping
+ *
+ *	read[D -> A] -> [D -> A]
+ *
+ * if "read" is set or
+ *
+ *	write[D -> A] -> [D -> A]
+ *
+ * if "read" is not set.
+ * D corresponds to the outer tile->depth dimensions of
+ * the kernel schedule.
+ */
+static __isl_give isl_multi_aff *create_from_access(isl_ctx *ctx,
+	struct gpu_array_ref_group *group, int read)
+{
+	return create_named_from_access(ctx, group, read ? "read" : "write");
+}
+
 /* If any writes in "group" require synchronization, then make sure
  * that there is a synchronization node for "kernel" after the node
  * following "node" in a sequence.
@@ -3472,36 +4265,392 @@ static __isl_give isl_schedule_node *add_copies_group_private(
 	return node;
 }
 
-/* Add copy statements to the schedule tree of "node"
- * for reading from global memory to shared memory (if "read" is set) or
- * for writing back from shared memory to global memory
- * (if "read" is not set) for the array reference group "group" that
- * is mapped to shared memory.
- * On input, "node" points to the kernel node, and it is moved
- * back there on output.
- *
- * The copies are performed in the order of the corresponding shared
- * memory tile.
- * The copy statement instances include a reference to the outer
- * tile->depth dimensions of the kernel schedule for ease of
- * combining them with the group tiling.
- *
- * If we are performing a read from global memory to shared memory and
- * if the array involved is not a scalar, then we copy
- * the entire tile to shared memory.  This may result in some extra
- * elements getting copied, but it should lead to simpler code
- * (which means that fewer registers may be needed) and less divergence.
- *
- * Otherwise, we only copy the elements that will be read or have been written
- * in the kernel.
+/* Check whether the shared memory tile "tile", for which room
+ * has been reserved for a second copy, can effectively be double buffered
+ * when it is copied in at "node", which is assumed to be
+ * at schedule depth tile->depth, and, if so, set tile->buffer and
+ * return the mapping from the outer tile->depth schedule dimensions D
+ * to the next iteration of the innermost of these dimensions
+ * in "next".  Otherwise, "next" is set to NULL.
+ *
+ * The mapping "next" is computed as the lexicographically smallest
+ * later element of the set of D-values that reach "node" with
+ * the same outer tile->depth - 1 dimensions.
+ * The copy that holds the tile is selected based on the parity of
+ * the innermost dimension of D, scaled down by its stride.
+ * Double buffering is only performed if this parity is different
+ * for any pair of successive iterations.  This may not be the case
+ * if the iteration domain has holes.
+ * There is also no point in performing double buffering if
+ * there is at most one iteration.
+ */
+static isl_stat compute_double_buffer(struct gpu_array_tile *tile,
+	__isl_keep isl_schedule_node *node, __isl_give isl_map **next)
+{
+	int i, pos;
+	isl_ctx *ctx;
+	isl_union_map *prefix;
+	isl_set *domain;
+	isl_space *space;
+	isl_local_space *ls;
+	isl_map *map, *buffer, *same;
+	isl_aff *aff;
+	isl_val *stride;
+	isl_bool empty, single;
+
+	*next = NULL;
+	ctx = isl_schedule_node_get_ctx(node);
+	pos = tile->depth - 1;
+	prefix = isl_schedule_node_get_prefix_schedule_relation(node);
+	domain = isl_set_from_union_set(isl_union_map_range(prefix));
+	stride = isl_set_get_stride(domain, pos);
+	if (stride && !isl_val_is_pos(stride))
+		stride = isl_val_set_si(stride, 1);
+
+	space = isl_set_get_space(domain);
+	map = isl_map_universe(isl_space_map_from_set(isl_space_copy(space)));
+	for (i = 0; i < pos; ++i)
+		map = isl_map_equate(map, isl_dim_in, i, isl_dim_out, i);
+	map = isl_map_order_lt(map, isl_dim_in, pos, isl_dim_out, pos);
+	map = isl_map_intersect_domain(map, isl_set_copy(domain));
+	map = isl_map_intersect_range(map, domain);
+	map = isl_map_lexmin(map);
+
+	ls = isl_local_space_from_space(space);
+	aff = isl_aff_var_on_domain(ls, isl_dim_set, pos);
+	aff = isl_aff_scale_down_val(aff, stride);
+	aff = isl_aff_floor(aff);
+	aff = isl_aff_mod_val(aff, isl_val_int_from_si(ctx, 2));
+
+	buffer = isl_map_from_aff(isl_aff_copy(aff));
+	same = isl_map_apply_domain(isl_map_copy(map), isl_map_copy(buffer));
+	same = isl_map_apply_range(same, buffer);
+	same = isl_map_intersect(same,
+				isl_map_identity(isl_map_get_space(same)));
+	empty = isl_map_is_empty(same);
+	isl_map_free(same);
+	single = isl_map_is_empty(map);
+
+	if (empty < 0 || single < 0 || !empty || single) {
+		isl_aff_free(aff);
+		isl_map_free(map);
+		if (empty < 0 || single < 0)
+			return isl_stat_error;
+		return isl_stat_ok;
+	}
+
+	tile->buffer = aff;
+	*next = map;
+
+	return isl_stat_ok;
+}
+
+/* Construct a subtree for copying the elements in the range
+ * of the extension "extension" of the form
  *
- * That is, the extra schedule is of the form
+ *	D -> type[D' -> A]
  *
- *	type[D -> A] -> T
+ * between global memory and the shared memory tile "tile" of "kernel",
+ * using the schedule "mupa" on type[D' -> A].
+ * Return a pointer to the root of the subtree.
  *
- * where D corresponds to the outer tile->depth dimensions of
- * the kernel schedule, A to the global array and T is the corresponding
- * shared memory tile.
+ * The instances are mapped to the threads through a filter that
+ * equates the thread identifiers to the (innermost) position
+ * inside the shared memory tile modulo the block size.
+ * See add_copies_group_shared for more details.
+ */
+static __isl_give isl_schedule_node *create_shared_copy_graft(
+	struct ppcg_kernel *kernel, struct gpu_array_tile *tile,
+	__isl_take isl_union_map *extension,
+	__isl_take isl_multi_union_pw_aff *mupa)
+{
+	isl_schedule_node *graft;
+	isl_union_set *filter;
+	int skip;
+
+	graft = isl_schedule_node_from_extension(extension);
+
+	graft = isl_schedule_node_child(graft, 0);
+
+	graft = isl_schedule_node_insert_partial_schedule(graft, mupa);
+	if (kernel->options->unroll_copy_shared)
+		graft = ppcg_set_schedule_node_type(graft, isl_ast_loop_unroll);
+
+	if (tile->n > kernel->n_block && kernel->n_block > 0) {
+		graft = isl_schedule_node_band_split(graft,
+						tile->n - kernel->n_block);
+		graft = isl_schedule_node_child(graft, 0);
+	}
+	if (tile->n < kernel->n_block)
+		skip = kernel->n_block - tile->n;
+	else
+		skip = 0;
+	filter = set_schedule_modulo(graft, kernel->thread_ids,
+					kernel->block_dim);
+	if (!kernel->options->wrap)
+		graft = snap_band_to_sizes(graft, kernel->block_dim + skip,
+			    kernel->options);
+	if (tile->n > kernel->n_block && kernel->n_block > 0)
+		graft = isl_schedule_node_parent(graft);
+	graft = isl_schedule_node_insert_filter(graft, filter);
+
+	while (graft && isl_schedule_node_has_parent(graft))
+		graft = isl_schedule_node_parent(graft);
+
+	return graft;
+}
+
+/* Add copy statements for reading the double buffered shared memory
+ * tile of "group" to the schedule tree of "node", which points to
+ * the node at schedule depth tile->depth containing the core computation.
+ * "extension" is the extension of the form
+ *
+ *	D -> read[D -> A]
+ *
+ * that would be used without double buffering and
+ * "next" maps D to the next iteration D' (see compute_double_buffer).
+ * Return a pointer to the core computation in the updated tree.
+ *
+ * The reads are split into a prologue
+ *
+ *	D -> read[D -> A]
+ *
+ * for those D that do not have a previous iteration,
+ * i.e., that are not in the range of "next", and a prefetch
+ *
+ *	D -> read[D' -> A] : D' = next(D)
+ *
+ * Since the tile read for D' is stored in a different copy
+ * than the tile read for D, the prefetch can be performed
+ * right before the core computation without any synchronization
+ * in between, such that the load of the next tile can overlap
+ * with the computation on the current tile.
+ * The prologue is placed in front of the synchronization preceding
+ * the core computation, just like a non-double buffered read.
+ * A synchronization after the core computation is still required
+ * to ensure that the prefetched data is available in the next
+ * iteration and that the copy holding the current tile
+ * is no longer used when it gets overwritten two iterations later
+ * (or by the prologue of the next outer iteration).
+ */
+static __isl_give isl_schedule_node *add_double_buffered_reads(
+	struct ppcg_kernel *kernel, struct gpu_array_ref_group *group,
+	__isl_take isl_schedule_node *node,
+	__isl_take isl_union_map *extension, __isl_take isl_map *next,
+	__isl_take isl_multi_union_pw_aff *mupa)
+{
+	struct gpu_array_tile *tile;
+	isl_union_map *prologue, *prefetch;
+	isl_union_set *first;
+	isl_schedule_node *graft;
+
+	tile = gpu_array_ref_group_tile(group);
+
+	first = isl_union_map_domain(isl_union_map_copy(extension));
+	first = isl_union_set_subtract(first,
+		isl_union_set_from_set(isl_map_range(isl_map_copy(next))));
+	prologue = isl_union_map_copy(extension);
+	prologue = isl_union_map_intersect_domain(prologue, first);
+	prefetch = isl_union_map_apply_domain(extension,
+			isl_union_map_from_map(isl_map_reverse(next)));
+
+	node = gpu_tree_ensure_sync_after_core(node, kernel);
+	node = gpu_tree_move_left_to_sync(node, kernel);
+	graft = create_shared_copy_graft(kernel, tile, prologue,
+				isl_multi_union_pw_aff_copy(mupa));
+	node = isl_schedule_node_graft_before(node, graft);
+	node = gpu_tree_move_right_to_core(node, kernel);
+	graft = create_shared_copy_graft(kernel, tile, prefetch, mupa);
+	node = isl_schedule_node_graft_before(node, graft);
+
+	return node;
+}
+
+/* Return the set of elements of "array" that can be used as the start
+ * of an aligned vector access of "width" elements, i.e.,
+ *
+ *	{ A[a] : a_n mod width = 0 and a_n + width <= bound_n and
+ *		 bound_n mod width = 0 }
+ *
+ * with n the innermost dimension.
+ * The final constraint ensures that each row of the array
+ * starts at an aligned position and is omitted for one-dimensional
+ * arrays.  If it cannot be determined statically whether
+ * it holds, then it results in a run-time check in the generated code.
+ */
+static __isl_give isl_set *vector_extent(struct gpu_array_info *array,
+	int width)
+{
+	int n = array->n_index - 1;
+	isl_ctx *ctx;
+	isl_id *id;
+	isl_space *space;
+	isl_local_space *ls;
+	isl_set *extent;
+	isl_aff *aff;
+	isl_pw_aff *index, *bound;
+
+	ctx = isl_set_get_ctx(array->extent);
+	id = isl_set_get_tuple_id(array->extent);
+	space = isl_set_get_space(array->extent);
+	extent = isl_set_universe(isl_space_copy(space));
+	ls = isl_local_space_from_space(space);
+
+	aff = isl_aff_var_on_domain(ls, isl_dim_set, n);
+	aff = isl_aff_mod_val(aff, isl_val_int_from_si(ctx, width));
+	extent = isl_set_intersect(extent,
+			    isl_set_from_basic_set(isl_aff_zero_basic_set(aff)));
+
+	bound = isl_multi_pw_aff_get_pw_aff(array->bound, n);
+	bound = isl_pw_aff_from_range(bound);
+	bound = isl_pw_aff_add_dims(bound, isl_dim_in, array->n_index);
+	bound = isl_pw_aff_set_tuple_id(bound, isl_dim_in, id);
+	if (n > 0) {
+		isl_pw_aff *rem;
+
+		rem = isl_pw_aff_copy(bound);
+		rem = isl_pw_aff_mod_val(rem, isl_val_int_from_si(ctx, width));
+		extent = isl_set_intersect(extent, isl_pw_aff_zero_set(rem));
+	}
+	ls = isl_local_space_from_space(isl_set_get_space(extent));
+	aff = isl_aff_var_on_domain(ls, isl_dim_set, n);
+	aff = isl_aff_add_constant_si(aff, width);
+	index = isl_pw_aff_from_aff(aff);
+	extent = isl_set_intersect(extent, isl_pw_aff_le_set(index, bound));
+
+	return extent;
+}
+
+/* Return the elements covered by the vectors of "width" elements
+ * starting at the elements in the range of "starts".
+ */
+static __isl_give isl_map *vector_cover(__isl_take isl_map *starts,
+	int width)
+{
+	int i, n;
+	isl_space *space;
+	isl_map *cover;
+
+	n = isl_map_dim(starts, isl_dim_out);
+	space = isl_space_range(isl_map_get_space(starts));
+	cover = isl_map_copy(starts);
+	for (i = 1; i < width; ++i) {
+		isl_multi_aff *shift;
+		isl_aff *aff;
+
+		shift = isl_multi_aff_identity(
+				isl_space_map_from_set(isl_space_copy(space)));
+		aff = isl_multi_aff_get_aff(shift, n - 1);
+		aff = isl_aff_add_constant_si(aff, i);
+		shift = isl_multi_aff_set_aff(shift, n - 1, aff);
+		cover = isl_map_union(cover,
+			    isl_map_apply_range(isl_map_copy(starts),
+					    isl_map_from_multi_aff(shift)));
+	}
+	isl_space_free(space);
+	isl_map_free(starts);
+
+	return cover;
+}
+
+/* Split off the elements of the shared memory tile "map" of "group",
+ * of the form
+ *
+ *	D -> A
+ *
+ * that can be read using aligned vector accesses of tile->vector elements.
+ * Return the extension
+ *
+ *	D -> read_vector[D -> A]
+ *
+ * for the start elements of these vectors and the corresponding
+ * copy schedule in "mupa", and remove the elements covered by
+ * the vectors from "map".
+ * The copy schedule is derived from the group tiling, but with
+ * the innermost dimension divided by tile->vector such that
+ * successive vectors are assigned to successive threads.
+ * Return NULL if there are no such vectors.
+ */
+static __isl_give isl_union_map *split_vector_reads(
+	struct ppcg_kernel *kernel, struct gpu_array_ref_group *group,
+	__isl_keep isl_map **map, __isl_give isl_multi_union_pw_aff **mupa)
+{
+	struct gpu_array_tile *tile;
+	isl_map *starts;
+	isl_multi_aff *from_access, *ma;
+	isl_aff *aff;
+	isl_union_set *domain;
+	isl_union_map *extension;
+	isl_bool empty;
+	int n;
+
+	*mupa = NULL;
+	tile = gpu_array_ref_group_tile(group);
+	starts = isl_map_copy(*map);
+	starts = isl_map_intersect_range(starts,
+				vector_extent(group->array, tile->vector));
+	empty = isl_map_is_empty(starts);
+	if (empty < 0 || empty) {
+		isl_map_free(starts);
+		if (empty < 0)
+			*map = isl_map_free(*map);
+		return NULL;
+	}
+	*map = isl_map_subtract(*map,
+			vector_cover(isl_map_copy(starts), tile->vector));
+
+	from_access = create_named_from_access(kernel->ctx, group,
+						"read_vector");
+	ma = isl_multi_aff_copy(tile->tiling);
+	ma = isl_multi_aff_pullback_multi_aff(ma,
+					    isl_multi_aff_copy(from_access));
+	n = isl_multi_aff_dim(ma, isl_dim_out);
+	aff = isl_multi_aff_get_aff(ma, n - 1);
+	aff = isl_aff_scale_down_ui(aff, tile->vector);
+	aff = isl_aff_floor(aff);
+	ma = isl_multi_aff_set_aff(ma, n - 1, aff);
+	*mupa = isl_multi_union_pw_aff_from_multi_pw_aff(
+					isl_multi_pw_aff_from_multi_aff(ma));
+
+	domain = isl_union_set_from_set(isl_map_wrap(starts));
+	domain = isl_union_set_preimage_multi_aff(domain, from_access);
+	extension = isl_union_set_wrapped_domain_map(domain);
+	extension = isl_union_map_reverse(extension);
+	extension = isl_union_map_coalesce(extension);
+
+	return extension;
+}
+
+/* Add copy statements to the schedule tree of "node"
+ * for reading from global memory to shared memory (if "read" is set) or
+ * for writing back from shared memory to global memory
+ * (if "read" is not set) for the array reference group "group" that
+ * is mapped to shared memory.
+ * On input, "node" points to the kernel node, and it is moved
+ * back there on output.
+ *
+ * The copies are performed in the order of the corresponding shared
+ * memory tile.
+ * The copy statement instances include a reference to the outer
+ * tile->depth dimensions of the kernel schedule for ease of
+ * combining them with the group tiling.
+ *
+ * If we are performing a read from global memory to shared memory and
+ * if the array involved is not a scalar, then we copy
+ * the entire tile to shared memory.  This may result in some extra
+ * elements getting copied, but it should lead to simpler code
+ * (which means that fewer registers may be needed) and less divergence.
+ *
+ * Otherwise, we only copy the elements that will be read or have been written
+ * in the kernel.
+ *
+ * That is, the extra schedule is of the form
+ *
+ *	type[D -> A] -> T
+ *
+ * where D corresponds to the outer tile->depth dimensions of
+ * the kernel schedule, A to the global array and T is the corresponding
+ * shared memory tile.
  *
  * The copying is inserted in the schedule tree through an extension
  * of the form
@@ -3549,6 +4698,20 @@ static __isl_give isl_schedule_node *add_copies_group_private(
  * before the next iteration writes to the same shared memory.
  * It also makes sure the data has arrived in global memory before
  * it is read in a subsequent iteration.
+ *
+ * If the tile has been prepared for vector accesses (tile->vector is set),
+ * then the read of a non-scalar is split into reads of aligned vectors
+ * of tile->vector elements that lie entirely inside the array
+ * (using statements called "read_vector") and reads of
+ * the remaining individual elements.
+ * The AST generator takes care of any run-time checks
+ * on the alignment of the rows of the array.
+ *
+ * If room has been reserved for a second copy of the tile and
+ * if the copying is performed inside a sequential loop of the kernel
+ * (i.e., not at the outer level and not inside the loops
+ * mapped to blocks), then the read may be performed using
+ * double buffering instead.  See add_double_buffered_reads.
  */
 static __isl_give isl_schedule_node *add_copies_group_shared(
 	struct ppcg_kernel *kernel, struct gpu_array_ref_group *group,
@@ -3561,9 +4724,9 @@ static __isl_give isl_schedule_node *add_copies_group_shared(
 	isl_multi_aff *from_access;
 	isl_multi_pw_aff *mpa;
 	isl_multi_union_pw_aff *mupa;
+	isl_union_map *vector_access = NULL;
+	isl_multi_union_pw_aff *vector_mupa = NULL;
 	isl_schedule_node *graft;
-	isl_union_set *filter;
-	int skip;
 	int kernel_depth;
 	int empty;
 
@@ -3597,6 +4760,9 @@ static __isl_give isl_schedule_node *add_copies_group_shared(
 		isl_map *map;
 		isl_union_set_free(domain);
 		map = group_tile(group);
+		if (tile->vector)
+			vector_access = split_vector_reads(kernel, group,
+							&map, &vector_mupa);
 		domain = isl_union_set_from_set(isl_map_wrap(map));
 	}
 
@@ -3604,40 +4770,36 @@ static __isl_give isl_schedule_node *add_copies_group_shared(
 	access = isl_union_set_wrapped_domain_map(domain);
 	access = isl_union_map_reverse(access);
 	access = isl_union_map_coalesce(access);
-	graft = isl_schedule_node_from_extension(access);
-
-	graft = isl_schedule_node_child(graft, 0);
-
-	graft = isl_schedule_node_insert_partial_schedule(graft, mupa);
-	if (kernel->options->unroll_copy_shared)
-		graft = ppcg_set_schedule_node_type(graft, isl_ast_loop_unroll);
 
-	if (tile->n > kernel->n_block && kernel->n_block > 0) {
-		graft = isl_schedule_node_band_split(graft,
-						tile->n - kernel->n_block);
-		graft = isl_schedule_node_child(graft, 0);
+	if (read && tile->double_buffer &&
+	    tile->depth > kernel_depth + kernel->n_grid) {
+		isl_map *next;
+
+		if (compute_double_buffer(tile, node, &next) < 0)
+			node = isl_schedule_node_free(node);
+		if (next) {
+			if (vector_access)
+				node = add_double_buffered_reads(kernel, group,
+					    node, vector_access,
+					    isl_map_copy(next), vector_mupa);
+			node = add_double_buffered_reads(kernel, group, node,
+							access, next, mupa);
+			return gpu_tree_move_up_to_kernel(node);
+		}
 	}
-	if (tile->n < kernel->n_block)
-		skip = kernel->n_block - tile->n;
-	else
-		skip = 0;
-	filter = set_schedule_modulo(graft, kernel->thread_ids,
-					kernel->block_dim);
-	if (!kernel->options->wrap)
-		graft = snap_band_to_sizes(graft, kernel->block_dim + skip,
-			    kernel->options);
-	if (tile->n > kernel->n_block && kernel->n_block > 0)
-		graft = isl_schedule_node_parent(graft);
-	graft = isl_schedule_node_insert_filter(graft, filter);
 
-	while (graft && isl_schedule_node_has_parent(graft))
-		graft = isl_schedule_node_parent(graft);
+	graft = create_shared_copy_graft(kernel, tile, access, mupa);
 
 	if (read) {
 		if (kernel_depth < tile->depth)
 			node = gpu_tree_ensure_sync_after_core(node, kernel);
 		node = gpu_tree_move_left_to_sync(node, kernel);
 		node = isl_schedule_node_graft_before(node, graft);
+		if (vector_access) {
+			graft = create_shared_copy_graft(kernel, tile,
+						vector_access, vector_mupa);
+			node = isl_schedule_node_graft_before(node, graft);
+		}
 	} else {
 		node = gpu_tree_move_right_to_sync(node, kernel);
 		node = isl_schedule_node_graft_after(node, graft);
@@ -3885,8 +5047,16 @@ static __isl_give isl_schedule_node *group_statements(
  * requires the schedule of the band that needs to be mapped to
  * threads before the privatization is applied.
  *
+ * The block size may be reduced to let each thread compute
+ * several points of the band mapped to threads (see coarsen_block_sizes).
+ * If the effective block size of a kernel that was mapped to a single warp
+ * turns out to be smaller than a warp, then the warp level synchronization
+ * is replaced by block level synchronization since not all threads
+ * of the warp would participate.
+ *
  * If any array reference group requires the band mapped to threads
- * to be unrolled, then we perform the required unrolling.
+ * to be unrolled or if the block size has been reduced for this purpose,
+ * then we perform the unrolling.
  *
  * We save a copy of the schedule that may influence the mappings
  * to shared or private memory in kernel->copy_schedule.
@@ -3982,12 +5152,18 @@ __isl_give isl_schedule_node *gpu_create_kernel(struct gpu_gen *gen,
 	node = gpu_tree_move_down_to_thread(node, kernel->core);
 	node = isl_schedule_node_child(node, 0);
 	node = split_band(node, kernel->n_block);
+	if (coarsen_block_sizes(kernel, gen, node) < 0)
+		node = isl_schedule_node_free(node);
+	set_used_sizes(gen, "block", kernel->id,
+					    kernel->block_dim, kernel->n_block);
 	kernel->thread_ids = ppcg_scop_generate_names(gen->prog->scop,
 						kernel->n_block, "t");
 	kernel->thread_filter = set_schedule_modulo(node, kernel->thread_ids,
 						kernel->block_dim);
 	if (extract_block_size(kernel, domain) < 0)
 		node = isl_schedule_node_free(node);
+	if (kernel->warp_sync && !is_single_warp(kernel, gen))
+		kernel->warp_sync = 0;
 
 	node = gpu_tree_move_up_to_kernel(node);
 	node = isl_schedule_node_child(node, 0);
@@ -4003,7 +5179,12 @@ __isl_give isl_schedule_node *gpu_create_kernel(struct gpu_gen *gen,
 	localize_bounds(kernel, host_domain);
 	isl_set_free(host_domain);
 
-	check_shared_memory_bound(kernel);
+	align_vector_tiles(kernel);
+	if (pad_shared_tiles(kernel, gen) < 0)
+		node = isl_schedule_node_free(node);
+	if (check_shared_memory_bound(kernel) < 0)
+		node = isl_schedule_node_free(node);
+	reserve_double_buffers(kernel);
 	mark_global_arrays(kernel);
 	compute_group_tilings(kernel);
 
@@ -4019,7 +5200,7 @@ __isl_give isl_schedule_node *gpu_create_kernel(struct gpu_gen *gen,
 			node = isl_schedule_node_parent(node);*/
 	node = isl_schedule_node_insert_filter(node,
 				    isl_union_set_copy(kernel->thread_filter));
-	if (kernel_requires_unroll(kernel)) {
+	if (kernel->coarsened || kernel_requires_unroll(kernel)) {
 		node = isl_schedule_node_child(node, 0);
 		node = unroll(node);
 	}
@@ -4236,6 +5417,40 @@ static isl_stat extract_single_piece(__isl_take isl_set *set,
 	return isl_stat_error;
 }
 
+/* Add a copy of "pa", with the coefficient of the first (time) dimension
+ * of its single affine expression set to zero, to *user.
+ */
+static isl_stat add_without_time(__isl_take isl_pw_aff *pa, void *user)
+{
+	isl_union_pw_aff **upa = user;
+	isl_aff *aff = NULL;
+
+	isl_pw_aff_foreach_piece(pa, &extract_single_piece, &aff);
+	isl_pw_aff_free(pa);
+	if (!aff)
+		return isl_stat_error;
+	aff = isl_aff_set_coefficient_si(aff, isl_dim_in, 0, 0);
+	*upa = isl_union_pw_aff_add_pw_aff(*upa, isl_pw_aff_from_aff(aff));
+
+	return isl_stat_ok;
+}
+
+/* Return a copy of "upa" where the expression of each statement
+ * no longer depends on the first (time) dimension of the statement.
+ */
+static __isl_give isl_union_pw_aff *drop_time(
+	__isl_take isl_union_pw_aff *upa)
+{
+	isl_union_pw_aff *res;
+
+	res = isl_union_pw_aff_empty(isl_union_pw_aff_get_space(upa));
+	if (isl_union_pw_aff_foreach_pw_aff(upa, &add_without_time, &res) < 0)
+		res = isl_union_pw_aff_free(res);
+	isl_union_pw_aff_free(upa);
+
+	return res;
+}
+
 /* See if overlapped tiling can be performed on "node".
  * If so, apply overlapped tiling and return the updated schedule tree.
  * If not, return the original schedule tree.
@@ -4252,38 +5467,40 @@ static isl_stat extract_single_piece(__isl_take isl_set *set,
  * than are available.  In this case, the remaining schedule dimensions
  * are split off and the dependence distances should be computed
  * after these dimensions have been split off.
+ *
+ * If the "warp_overlapped" option is set, then each overlapped tile
+ * is mapped to a block consisting of a single warp.
+ * Since the overlapped tiles do not depend on each other,
+ * all dependences inside the kernel are then carried by threads
+ * of the same warp and synchronization can be performed at warp level.
  */
 static __isl_give isl_schedule_node *try_overlapped_tile(struct gpu_gen *gen,
 	__isl_take isl_schedule_node *node)
 {
-	int tile_len, block_len, after_mapping;
+	int tile_len, block_len, after_mapping, multi_level;
 	int *tile_size, *block_size;
-	int i, m, n;
+	int i, n;
 	isl_id *id;
-	isl_aff *aff;
 	isl_multi_val *sizes, *sub_sizes;
-	isl_pw_aff *pa;
-	isl_pw_aff_list *list;
 	isl_union_pw_aff *upa;
 	isl_multi_union_pw_aff *mupa;
 
 	tile_len = isl_schedule_node_band_n_member(node);
 	n = tile_len;
-	// force multi_level_overlapped to be equal to 0
-	// for one dimensional cases
-	if (gen->options->multi_level_overlapped && n <= 2)
-		gen->options->multi_level_overlapped = 0;
-	
 	tile_size = read_tile_sizes(gen, &tile_len);
 	if (!tile_size)
 		return isl_schedule_node_free(node);
-	// read block size before constructing kernel
-	// we currently only support single kernel cases
-	// TODO: multiple kernel cases
+	// read block size of the kernel that is about to be constructed
 	block_len = isl_schedule_node_band_n_member(node);
 	block_size = read_blk_sizes(gen, &block_len);
 	if (!block_size)
 		return isl_schedule_node_free(node);
+
+	// force multi_level_overlapped to be equal to 0
+	// for one dimensional cases, only for the current kernel
+	multi_level = gen->options->multi_level_overlapped;
+	if (gen->options->multi_level_overlapped && n <= 2)
+		gen->options->multi_level_overlapped = 0;
 	
 	if (tile_len < isl_schedule_node_band_n_member(node))
 		node = isl_schedule_node_band_split(node, tile_len);
@@ -4307,16 +5524,7 @@ static __isl_give isl_schedule_node *try_overlapped_tile(struct gpu_gen *gen,
 	mupa = isl_schedule_node_band_get_partial_schedule(node);
 	for (i = 0; i < isl_schedule_node_band_n_member(node); i++) {
 		upa = isl_multi_union_pw_aff_get_union_pw_aff(mupa, i);
-		list = isl_union_pw_aff_get_pw_aff_list(upa);
-		isl_union_pw_aff_free(upa);
-		//todo: multiple stmts
-		pa = isl_pw_aff_list_get_pw_aff(list, 0);
-		isl_pw_aff_list_free(list);
-		isl_pw_aff_foreach_piece(pa, &extract_single_piece, &aff);
-		isl_pw_aff_free(pa);
-		aff = isl_aff_set_coefficient_si(aff, isl_dim_in, 0, 0);
-		pa = isl_pw_aff_from_aff(aff);
-		upa = isl_union_pw_aff_from_pw_aff(pa);
+		upa = drop_time(upa);
 		mupa = isl_multi_union_pw_aff_set_union_pw_aff(mupa, i, upa);
 	}
 
@@ -4334,9 +5542,12 @@ static __isl_give isl_schedule_node *try_overlapped_tile(struct gpu_gen *gen,
 
 	tile_size = tile_size + 1;
 	sub_sizes = construct_band_tiles_sizes(node, tile_size);
+	gen->warp_kernel = gen->options->warp_overlapped;
 	node = gpu_create_kernel(gen, node, 0, sub_sizes);
+	gen->warp_kernel = 0;
 	node = isl_schedule_node_parent(node);
 	isl_multi_val_free(sub_sizes);
+	gen->options->multi_level_overlapped = multi_level;
 
 	return node;
 }
@@ -4346,50 +5557,327 @@ struct ppcg_mark_outer_data {
 	struct ppcg_scop *scop;
 };
 
-/* If "node" is the outermost permutable band that can be mapped to block and
- * thread identifiers in its branch (or the root of a subtree with
- * no such outer bands),
- * then mark the band as such, attaching a ppcg_kernel to the mark.
- *
- * If hybrid tiling is allowed, then first try and apply it
- * to "node" and its parent.
+/* Estimate the amount of shared memory (in bytes) used by a kernel
+ * created from the band "node" after tiling its first "n" members
+ * with tile sizes "tile_size".
  *
- * If "node" is the root of a subtree without permutable bands,
- * then insert a zero-dimensional permutable band such that
- * we can assume that "node" always points to a band node.
- * This includes the case where "node" already points to a band node,
- * but one without any coincident dimension.  In this case,
- * the extra node ensures that this original node does not get tiled.
- *
- * Tile "node" using user specified tile sizes, after splitting the band
- * if the number of specified tile sizes is smaller than the dimension
- * of the band.  Mark the point band of this tiling as the band that
- * needs to be mapped to threads and instruct the AST generator to unroll
- * the band if the "unroll_gpu_tile" option is set.
- * Create a kernel representing the domain instances that reach "node" and
- * insert a mark node pointing to the ppcg_kernel before the band node.
+ * For each non-scalar array accessed by the statement instances
+ * that reach "node", the fixed box hull of the elements accessed
+ * within a single tile is computed and the sizes of these boxes
+ * are added up.  Arrays for which no such box can be found are
+ * skipped since they would not be mapped to shared memory.
+ * The result is an overestimate since some arrays may end up being
+ * mapped to private memory or being accessed from global memory.
+ * It is therefore bounded by max_shared_memory.
  */
-static __isl_give isl_schedule_node *mark_outer_permutable(
-	__isl_take isl_schedule_node *node, void *user)
+static long estimate_shared_memory(struct gpu_gen *gen,
+	__isl_keep isl_schedule_node *node, int n, int *tile_size)
 {
-    struct ppcg_mark_outer_data *user_data = user;
+	int i;
+	long total = 0;
+	isl_space *space;
+	isl_multi_val *mv;
+	isl_multi_union_pw_aff *mupa;
+	isl_union_map *sched, *access;
 
-	struct gpu_gen *gen = user_data->gen;
-	struct ppcg_scop *scop = user_data->scop;
-	int outer;
-	int scale;
-	int tile_len;
-	int *tile_size;
-	isl_id *id;
-	isl_multi_val *sizes;
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	mupa = isl_multi_union_pw_aff_drop_dims(mupa, isl_dim_set, n,
+		    isl_multi_union_pw_aff_dim(mupa, isl_dim_set) - n);
+	space = isl_multi_union_pw_aff_get_space(mupa);
+	mv = ppcg_multi_val_from_int_list(space, tile_size);
+	mupa = isl_multi_union_pw_aff_scale_down_multi_val(mupa, mv);
+	mupa = isl_multi_union_pw_aff_floor(mupa);
+	sched = isl_schedule_node_get_prefix_schedule_union_map(node);
+	sched = isl_union_map_flat_range_product(sched,
+				isl_union_map_from_multi_union_pw_aff(mupa));
+
+	access = isl_union_map_union(isl_union_map_copy(gen->prog->read),
+				isl_union_map_copy(gen->prog->may_write));
+	access = isl_union_map_apply_range(access,
+				isl_union_map_copy(gen->prog->to_outer));
+	access = isl_union_map_apply_domain(access, sched);
+
+	for (i = 0; i < gen->prog->n_array; ++i) {
+		struct gpu_array_info *array = &gen->prog->array[i];
+		isl_union_map *umap;
+		isl_set *universe;
+		isl_map *map;
+		isl_fixed_box *box;
+		isl_multi_val *size;
+		isl_bool valid;
+		int empty, j;
+		long elements;
 
-	outer = is_outer_tilable(node);
+		if (gpu_array_is_scalar(array))
+			continue;
+		universe = isl_set_universe(isl_space_copy(array->space));
+		umap = isl_union_map_copy(access);
+		umap = isl_union_map_intersect_range(umap,
+					isl_union_set_from_set(universe));
+		empty = isl_union_map_is_empty(umap);
+		if (empty < 0 || empty) {
+			isl_union_map_free(umap);
+			continue;
+		}
+		map = isl_map_from_union_map(umap);
+		box = isl_map_get_range_simple_fixed_box_hull(map);
+		isl_map_free(map);
+		valid = isl_fixed_box_is_valid(box);
+		if (valid < 0 || !valid) {
+			isl_fixed_box_free(box);
+			continue;
+		}
+		size = isl_fixed_box_get_size(box);
+		elements = 1;
+		for (j = 0; j < array->n_index; ++j) {
+			isl_val *v;
+
+			v = isl_multi_val_get_val(size, j);
+			elements *= isl_val_get_num_si(v);
+			isl_val_free(v);
+		}
+		isl_multi_val_free(size);
+		isl_fixed_box_free(box);
+		total += elements * array->size;
+	}
+	isl_union_map_free(access);
+
+	if (gen->options->max_shared_memory >= 0 &&
+	    total > gen->options->max_shared_memory)
+		total = gen->options->max_shared_memory;
+
+	return total;
+}
+
+/* Select block sizes for the first "n" members of a tiled band
+ * with tile sizes "tile_size" that maximize the theoretical occupancy
+ * of gen->device, given that each block uses "shared_memory" bytes
+ * of shared memory, and store them in "block_size".
+ * Return the resulting occupancy.
+ *
+ * Only powers of two that are no larger than the corresponding
+ * tile size are considered.  If several choices result in the same
+ * occupancy, then the one with the largest innermost block size
+ * is preferred (to preserve coalescing), followed by the one with
+ * the largest number of threads.
+ */
+static double select_block_sizes(struct gpu_gen *gen, int n, int *tile_size,
+	long shared_memory, int *block_size)
+{
+	int i;
+	int block[3];
+	double best = -1;
+	int best_threads = 0;
+
+	for (i = 0; i < n; ++i)
+		block[i] = 1;
+	for (;;) {
+		int threads = 1;
+		double occupancy;
+
+		for (i = 0; i < n; ++i)
+			threads *= block[i];
+		occupancy = gpu_device_occupancy(gen->device, threads,
+						shared_memory);
+		if (occupancy > best ||
+		    (occupancy == best && block[n - 1] > block_size[n - 1]) ||
+		    (occupancy == best && block[n - 1] == block_size[n - 1] &&
+		     threads > best_threads)) {
+			best = occupancy;
+			best_threads = threads;
+			for (i = 0; i < n; ++i)
+				block_size[i] = block[i];
+		}
+
+		for (i = n - 1; i >= 0; --i) {
+			block[i] *= 2;
+			if (block[i] <= tile_size[i])
+				break;
+			block[i] = 1;
+		}
+		if (i < 0)
+			break;
+	}
+
+	return best;
+}
+
+/* If a description of the target device has been specified,
+ * then select tile and block sizes for the kernel that will be created
+ * from the band "node" that maximize the theoretical occupancy
+ * of the device and add them to gen->sizes, such that they get picked up
+ * by read_tile_sizes and read_block_sizes.
+ * The sizes are not changed if the user has specified any tile or
+ * block sizes for this kernel.
+ * The resulting occupancy (as a percentage) is added to gen->used_sizes.
+ *
+ * Tile sizes 16, 32 and 64 are considered for the outer (at most three)
+ * coincident members of the band, i.e., those that will be mapped
+ * to threads.  Any other members are tiled using the default tile size.
+ * For each choice of tile sizes, the shared memory usage is estimated
+ * by estimate_shared_memory and the optimal block sizes are computed.
+ * If several choices of tile sizes result in the same occupancy,
+ * then the largest tiles are preferred since they allow for more reuse.
+ */
+static isl_stat select_sizes(struct gpu_gen *gen,
+	__isl_keep isl_schedule_node *node)
+{
+	static const int candidates[] = { 16, 32, 64 };
+	int i, n, n_block;
+	int choice[3] = { 0 };
+	int block_size[3], best_block[3];
+	int *tile_size, *best_tile;
+	int percent;
+	long best_volume = 0;
+	double best = -1;
+	isl_set *size;
+	isl_space *space;
+	isl_map *map;
+
+	if (!gen->device)
+		return isl_stat_ok;
+	size = extract_sizes(gen->sizes, "tile", gen->kernel_id);
+	if (!size)
+		size = extract_sizes(gen->sizes, "block", gen->kernel_id);
+	if (size) {
+		isl_set_free(size);
+		return isl_stat_ok;
+	}
+
+	n = isl_schedule_node_band_n_member(node);
+	n_block = n_outer_coincidence(node);
+	if (n_block > 3)
+		n_block = 3;
+	if (n_block == 0)
+		return isl_stat_ok;
+
+	tile_size = isl_alloc_array(gen->ctx, int, n);
+	best_tile = isl_alloc_array(gen->ctx, int, n);
+	if (!tile_size || !best_tile)
+		goto error;
+	for (i = 0; i < n; ++i)
+		tile_size[i] = best_tile[i] = gen->options->tile_size;
+
+	for (;;) {
+		long shared, volume = 1;
+		double occupancy;
+
+		for (i = 0; i < n_block; ++i) {
+			tile_size[i] = candidates[choice[i]];
+			volume *= tile_size[i];
+		}
+		shared = estimate_shared_memory(gen, node, n, tile_size);
+		occupancy = select_block_sizes(gen, n_block, tile_size,
+						shared, block_size);
+		if (occupancy > best ||
+		    (occupancy == best && volume > best_volume)) {
+			best = occupancy;
+			best_volume = volume;
+			for (i = 0; i < n; ++i)
+				best_tile[i] = tile_size[i];
+			for (i = 0; i < n_block; ++i)
+				best_block[i] = block_size[i];
+		}
+
+		for (i = n_block - 1; i >= 0; --i)
+			if (++choice[i] < 3)
+				break;
+			else
+				choice[i] = 0;
+		if (i < 0)
+			break;
+	}
+
+	if (!gen->sizes)
+		gen->sizes = isl_union_map_empty(isl_space_params_alloc(
+							gen->ctx, 0));
+	space = isl_union_map_get_space(gen->sizes);
+	map = kernel_sizes(isl_space_copy(space), "tile", gen->kernel_id,
+				best_tile, n);
+	gen->sizes = isl_union_map_add_map(gen->sizes, map);
+	map = kernel_sizes(space, "block", gen->kernel_id,
+				best_block, n_block);
+	gen->sizes = isl_union_map_add_map(gen->sizes, map);
+	percent = (int) (100 * best + 0.5);
+	set_used_sizes(gen, "occupancy", gen->kernel_id, &percent, 1);
+
+	free(tile_size);
+	free(best_tile);
+	return gen->sizes ? isl_stat_ok : isl_stat_error;
+error:
+	free(tile_size);
+	free(best_tile);
+	return isl_stat_error;
+}
+
+/* If "node" is the outermost permutable band that can be mapped to block and
+ * thread identifiers in its branch (or the root of a subtree with
+ * no such outer bands),
+ * then mark the band as such, attaching a ppcg_kernel to the mark.
+ *
+ * If hybrid tiling is allowed, then first try and apply it
+ * to "node" and its parent.
+ * If split or overlapped tiling is requested, then apply it instead
+ * of the tiling below.  If the "tiling" option is set to "auto",
+ * then the kind of tiling is chosen by ppcg_stencil_choose_tiling instead.
+ *
+ * If "node" is the root of a subtree without permutable bands,
+ * then insert a zero-dimensional permutable band such that
+ * we can assume that "node" always points to a band node.
+ * This includes the case where "node" already points to a band node,
+ * but one without any coincident dimension.  In this case,
+ * the extra node ensures that this original node does not get tiled.
+ *
+ * Tile "node" using user specified tile sizes, after splitting the band
+ * if the number of specified tile sizes is smaller than the dimension
+ * of the band.  If no tile or block sizes were specified by the user,
+ * then they may first be selected by select_sizes.
+ * Mark the point band of this tiling as the band that
+ * needs to be mapped to threads and instruct the AST generator to unroll
+ * the band if the "unroll_gpu_tile" option is set.
+ * Create a kernel representing the domain instances that reach "node" and
+ * insert a mark node pointing to the ppcg_kernel before the band node.
+ */
+static __isl_give isl_schedule_node *mark_outer_permutable(
+	__isl_take isl_schedule_node *node, void *user)
+{
+    struct ppcg_mark_outer_data *user_data = user;
+
+	struct gpu_gen *gen = user_data->gen;
+	struct ppcg_scop *scop = user_data->scop;
+	int outer;
+	int scale;
+	int tile_len;
+	int hybrid, split, overlapped;
+	int *tile_size;
+	isl_id *id;
+	isl_multi_val *sizes;
+
+	outer = is_outer_tilable(node);
 	if (outer < 0)
 		return isl_schedule_node_free(node);
 	if (!outer)
 		return node;
 
-	if (gen->options->hybrid) {
+	hybrid = gen->options->hybrid;
+	split = gen->options->split_tile;
+	overlapped = gen->options->rectangle;
+	if (gen->options->tiling == PPCG_TILING_AUTO &&
+	    isl_schedule_node_get_type(node) == isl_schedule_node_band) {
+		enum ppcg_tiling_type type;
+		const char *reason;
+
+		if (ppcg_stencil_choose_tiling(scop, node, 1,
+						&type, &reason) < 0)
+			return isl_schedule_node_free(node);
+		if (gen->options->debug->verbose)
+			ppcg_stencil_report_tiling(node, type, reason);
+		hybrid = type == ppcg_tiling_hybrid;
+		split = type == ppcg_tiling_split;
+		overlapped = type == ppcg_tiling_overlapped;
+	}
+
+	if (hybrid) {
 		isl_schedule_node *saved = isl_schedule_node_copy(node);
 		node = try_hybrid_tile(gen, node);
 		isl_schedule_node_free(saved);
@@ -4397,18 +5885,18 @@ static __isl_give isl_schedule_node *mark_outer_permutable(
 			return node;
 	}
 
-	//TODO: check stencil_partern before scheduling
-	int stencil_partern = 1;
-	if(stencil_partern && gen->options->split_tile)
+	if (split)
 		return try_split_tile(gen, node);
 
-	if(stencil_partern && gen->options->rectangle)
+	if (overlapped)
 		return try_overlapped_tile(gen, node);
 
 	if (isl_schedule_node_get_type(node) != isl_schedule_node_band ||
 	    !isl_schedule_node_band_member_get_coincident(node, 0))
 		node = insert_empty_permutable_band(node);
 
+	if (select_sizes(gen, node) < 0)
+		return isl_schedule_node_free(node);
 	tile_len = isl_schedule_node_band_n_member(node);
 	tile_size = read_tile_sizes(gen, &tile_len);
 	if (!tile_size)
@@ -4429,165 +5917,732 @@ static __isl_give isl_schedule_node *mark_outer_permutable(
 	isl_multi_val_free(sizes);
 	free(tile_size);
 
-	return node;
+	return node;
+}
+
+/* Given a set or sequence node, return the union the filters of either all
+ * (if "only_initial" is not set) or the initial (if "only_initial" is set)
+ * direct subtrees that do not contain any suitably permutable bands
+ * (according to subtree_has_permutable_bands).
+ */
+static __isl_give isl_union_set *get_non_parallel_subtree_filters(
+	__isl_keep isl_schedule_node *node, int only_initial)
+{
+	isl_space *space;
+	isl_union_set *filter;
+	int i, n;
+
+	n = isl_schedule_node_n_children(node);
+	if (n < 0)
+		return NULL;
+
+	node = isl_schedule_node_copy(node);
+	node = isl_schedule_node_child(node, 0);
+	filter = isl_schedule_node_filter_get_filter(node);
+	node = isl_schedule_node_parent(node);
+	space = isl_union_set_get_space(filter);
+	isl_union_set_free(filter);
+	filter = isl_union_set_empty(space);
+
+	for (i = 0; i < n; ++i) {
+		int parallelism;
+
+		node = isl_schedule_node_child(node, i);
+		parallelism = subtree_has_permutable_bands(node);
+		if (parallelism < 0) {
+			filter = isl_union_set_free(filter);
+		} else if (!parallelism) {
+			isl_union_set *filter_i;
+			filter_i = isl_schedule_node_filter_get_filter(node);
+			filter = isl_union_set_union(filter, filter_i);
+		} else if (only_initial)
+			break;
+		node = isl_schedule_node_parent(node);
+	}
+
+	isl_schedule_node_free(node);
+
+	return filter;
+}
+
+/* Given a set or sequence node, return the union of the filters of
+ * the direct subtrees that do not contain any suitably permutable bands
+ * (according to subtree_has_permutable_bands).
+ */
+static __isl_give isl_union_set *get_all_non_parallel_subtree_filters(
+	__isl_keep isl_schedule_node *node)
+{
+	return get_non_parallel_subtree_filters(node, 0);
+}
+
+/* Given a set or sequence node, return the union of the filters of
+ * the initial direct subtrees that do not contain any suitably permutable
+ * bands (according to subtree_has_permutable_bands).
+ */
+static __isl_give isl_union_set *get_initial_non_parallel_subtree_filters(
+	__isl_keep isl_schedule_node *node)
+{
+	return get_non_parallel_subtree_filters(node, 1);
+}
+
+/* Mark all variables that are accessed by the statement instances in "domain"
+ * and that are local to "prog" as requiring a declaration in the host code.
+ * The statement instances in "domain" correspond to (a subset of)
+ * the active instances at "node".
+ * "node" is not modified by this function, except that NULL is returned
+ * in case of error.
+ */
+static __isl_give isl_schedule_node *declare_accessed_local_variables(
+	__isl_take isl_schedule_node *node, struct gpu_prog *prog,
+	__isl_keep isl_union_set *domain)
+{
+	isl_union_pw_multi_aff *contraction;
+	isl_union_set *arrays;
+	int i;
+
+	if (!ppcg_scop_any_hidden_declarations(prog->scop))
+		return node;
+	contraction = isl_schedule_node_get_subtree_contraction(node);
+	domain = isl_union_set_copy(domain);
+	domain = isl_union_set_preimage_union_pw_multi_aff(domain, contraction);
+	arrays = accessed_by_domain(domain, prog);
+
+	for (i = 0; i < prog->n_array; ++i) {
+		isl_space *space;
+		isl_set *set;
+		int empty;
+
+		if (!prog->array[i].local)
+			continue;
+		space = isl_set_get_space(prog->array[i].extent);
+		set = isl_union_set_extract_set(arrays, space);
+		empty = isl_set_plain_is_empty(set);
+		isl_set_free(set);
+		if (empty < 0)
+			goto error;
+		if (!empty)
+			prog->array[i].declare_local = 1;
+	}
+
+	isl_union_set_free(arrays);
+	return node;
+error:
+	isl_union_set_free(arrays);
+	return isl_schedule_node_free(node);
+}
+
+/* If "node" points to a set node, then separate its children
+ * into subtrees that have suitably permutable bands and
+ * those that do not.
+ * Adjust the schedule tree in order to execute the second group
+ * after the first group and return a pointer to the first group,
+ * assuming there are any such subtrees.
+ * If "node" points to a sequence node, then separate the initial
+ * children that do not have suitably permutable bands and
+ * return a pointer to the subsequence of children that do have such bands,
+ * assuming there are any such subtrees.
+ *
+ * In both cases, mark all local variables in "prog" that are accessed by
+ * the group without permutable bands as requiring a declaration on the host.
+ */
+static __isl_give isl_schedule_node *isolate_permutable_subtrees(
+	__isl_take isl_schedule_node *node, struct gpu_prog *prog)
+{
+	isl_union_set *filter;
+	enum isl_schedule_node_type type;
+
+	if (!node)
+		return NULL;
+	type = isl_schedule_node_get_type(node);
+	if (type == isl_schedule_node_set) {
+		filter = get_all_non_parallel_subtree_filters(node);
+		node = declare_accessed_local_variables(node, prog, filter);
+		node = isl_schedule_node_order_after(node, filter);
+	} else if (type == isl_schedule_node_sequence) {
+		filter = get_initial_non_parallel_subtree_filters(node);
+		node = declare_accessed_local_variables(node, prog, filter);
+		node = isl_schedule_node_order_before(node, filter);
+	}
+
+	return node;
+}
+
+/* Return the partial schedule of the band node "node" as a relation
+ * on the statement instances that reach "node", i.e., expanded
+ * with respect to any grouping, and with an anonymous range
+ * such that it can be compared to the partial schedules of other bands.
+ */
+static __isl_give isl_union_map *band_instance_schedule(
+	__isl_keep isl_schedule_node *node)
+{
+	isl_multi_union_pw_aff *mupa;
+	isl_union_set *domain;
+	isl_union_map *schedule;
+	isl_union_pw_multi_aff *contraction;
+
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	mupa = isl_multi_union_pw_aff_reset_tuple_id(mupa, isl_dim_set);
+	schedule = isl_union_map_from_multi_union_pw_aff(mupa);
+	domain = isl_schedule_node_get_domain(node);
+	schedule = isl_union_map_intersect_domain(schedule, domain);
+	contraction = isl_schedule_node_get_subtree_contraction(node);
+	schedule = isl_union_map_preimage_domain_union_pw_multi_aff(schedule,
+								contraction);
+
+	return schedule;
+}
+
+/* Return the set of schedule points of the instance schedule "schedule"
+ * within the context of "prog", i.e., the grid of the corresponding kernel
+ * before tiling.
+ */
+static __isl_give isl_set *schedule_range(struct gpu_prog *prog,
+	__isl_keep isl_union_map *schedule)
+{
+	isl_union_set *range;
+
+	range = isl_union_map_range(isl_union_map_copy(schedule));
+	range = isl_union_set_intersect_params(range,
+					isl_set_copy(prog->context));
+	return isl_set_from_union_set(range);
+}
+
+/* Internal data structure for fuse_kernels_in_sequence.
+ *
+ * "prog" is the program that is being mapped to the device.
+ * "verbose" is set if the fusion decisions should be reported.
+ * "dep" collects all dependences between statement instances.
+ * "local_dep" are the dependences in "dep" that are not carried
+ * by any of the outer nodes of the sequence node that is being considered.
+ *
+ * The remaining fields describe the current run of fusable kernels.
+ * "schedule" is the union of their instance schedules,
+ * "range" is the grid of the first kernel in the run,
+ * "n_member" is the number of members of the bands and
+ * "coincident" keeps track of the members that are coincident
+ * in all of these bands.
+ */
+struct ppcg_fuse_kernels_data {
+	struct gpu_prog *prog;
+	int verbose;
+	isl_union_map *dep;
+	isl_union_map *local_dep;
+
+	isl_union_map *schedule;
+	isl_set *range;
+	int n_member;
+	int *coincident;
+};
+
+/* Report that the kernel with band "node" was (if "reason" is NULL)
+ * or was not fused with the preceding kernel(s).
+ */
+static void report_fusion(__isl_keep isl_schedule_node *node,
+	const char *reason)
+{
+	isl_ctx *ctx;
+	isl_printer *p;
+	isl_multi_union_pw_aff *mupa;
+
+	ctx = isl_schedule_node_get_ctx(node);
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	p = isl_printer_to_file(ctx, stdout);
+	p = isl_printer_print_str(p, "Kernel band ");
+	p = isl_printer_print_multi_union_pw_aff(p, mupa);
+	if (reason) {
+		p = isl_printer_print_str(p, " not fused with preceding kernel: ");
+		p = isl_printer_print_str(p, reason);
+	} else {
+		p = isl_printer_print_str(p, " fused with preceding kernel");
+	}
+	p = isl_printer_end_line(p);
+	isl_printer_free(p);
+	isl_multi_union_pw_aff_free(mupa);
+}
+
+/* Report that the band "node" is the result of fusing "n" kernels.
+ */
+static void report_fused_kernel(__isl_keep isl_schedule_node *node, int n)
+{
+	isl_ctx *ctx;
+	isl_printer *p;
+	isl_multi_union_pw_aff *mupa;
+
+	ctx = isl_schedule_node_get_ctx(node);
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	p = isl_printer_to_file(ctx, stdout);
+	p = isl_printer_print_int(p, n);
+	p = isl_printer_print_str(p, " kernels fused into kernel band ");
+	p = isl_printer_print_multi_union_pw_aff(p, mupa);
+	p = isl_printer_end_line(p);
+	isl_printer_free(p);
+	isl_multi_union_pw_aff_free(mupa);
+}
+
+/* Drop the description of the current run of fusable kernels from "data".
+ */
+static void fuse_kernels_data_clear(struct ppcg_fuse_kernels_data *data)
+{
+	data->schedule = isl_union_map_free(data->schedule);
+	data->range = isl_set_free(data->range);
+	free(data->coincident);
+	data->coincident = NULL;
+	data->n_member = 0;
+}
+
+/* Start a new run of fusable kernels in "data" with the kernel
+ * with band "node", where "schedule" is the instance schedule of "node".
+ */
+static isl_stat start_kernel_run(struct ppcg_fuse_kernels_data *data,
+	__isl_keep isl_schedule_node *node, __isl_take isl_union_map *schedule)
+{
+	int i;
+
+	fuse_kernels_data_clear(data);
+	data->n_member = isl_schedule_node_band_n_member(node);
+	data->coincident = isl_alloc_array(isl_schedule_node_get_ctx(node),
+					int, data->n_member);
+	data->range = schedule_range(data->prog, schedule);
+	data->schedule = schedule;
+	if (!data->coincident || !data->range || !data->schedule)
+		return isl_stat_error;
+	for (i = 0; i < data->n_member; ++i)
+		data->coincident[i] = isl_schedule_node_band_member_get_coincident(
+								node, i);
+
+	return isl_stat_ok;
+}
+
+/* Is it possible to fuse the kernel with band "node" and instance schedule
+ * "schedule" with the current run of kernels in "data"?
+ * If not, then set "reason" to a description of the reason.
+ *
+ * The kernels need to have the same grid, i.e., the bands need to have
+ * the same number of members and the same set of schedule points.
+ * Furthermore, all dependences between the kernels in the run and
+ * the kernel with band "node" need to have a zero distance
+ * in the members that are coincident in all of them,
+ * such that the dependent statement instances are executed
+ * by the same thread in the fused kernel, and a non-negative distance
+ * in the other members, such that the fused band is still permutable.
+ * The first member needs to remain coincident for the fused band
+ * to be mapped to the device.
+ */
+static isl_bool can_fuse_kernel(struct ppcg_fuse_kernels_data *data,
+	__isl_keep isl_schedule_node *node, __isl_keep isl_union_map *schedule,
+	const char **reason)
+{
+	int i;
+	isl_bool equal, subset;
+	isl_set *range, *allowed;
+	isl_union_map *dist;
+	isl_union_set *deltas, *allowed_deltas;
+
+	if (isl_schedule_node_band_n_member(node) != data->n_member) {
+		*reason = "different number of band members";
+		return isl_bool_false;
+	}
+	if (!data->coincident[0] ||
+	    !isl_schedule_node_band_member_get_coincident(node, 0)) {
+		*reason = "outer member not coincident in both kernels";
+		return isl_bool_false;
+	}
+
+	range = schedule_range(data->prog, schedule);
+	equal = isl_set_is_equal(range, data->range);
+	if (equal < 0 || !equal) {
+		isl_set_free(range);
+		*reason = "different grid";
+		return equal;
+	}
+
+	allowed = isl_set_universe(isl_set_get_space(range));
+	isl_set_free(range);
+	for (i = 0; i < data->n_member; ++i) {
+		if (data->coincident[i] &&
+		    isl_schedule_node_band_member_get_coincident(node, i))
+			allowed = isl_set_fix_si(allowed, isl_dim_set, i, 0);
+		else
+			allowed = isl_set_lower_bound_si(allowed,
+							isl_dim_set, i, 0);
+	}
+
+	dist = isl_union_map_copy(data->local_dep);
+	dist = isl_union_map_apply_domain(dist,
+					isl_union_map_copy(data->schedule));
+	dist = isl_union_map_apply_range(dist, isl_union_map_copy(schedule));
+	deltas = isl_union_map_deltas(dist);
+	deltas = isl_union_set_intersect_params(deltas,
+					isl_set_copy(data->prog->context));
+	allowed_deltas = isl_union_set_from_set(allowed);
+	subset = isl_union_set_is_subset(deltas, allowed_deltas);
+	isl_union_set_free(allowed_deltas);
+	isl_union_set_free(deltas);
+	if (subset < 0 || !subset)
+		*reason = "dependences cross thread boundaries";
+
+	return subset;
+}
+
+/* Add the kernel with band "node" and instance schedule "schedule"
+ * to the current run of kernels in "data".
+ */
+static isl_stat extend_kernel_run(struct ppcg_fuse_kernels_data *data,
+	__isl_keep isl_schedule_node *node, __isl_take isl_union_map *schedule)
+{
+	int i;
+
+	for (i = 0; i < data->n_member; ++i)
+		if (!isl_schedule_node_band_member_get_coincident(node, i))
+			data->coincident[i] = 0;
+	data->schedule = isl_union_map_union(data->schedule, schedule);
+
+	return data->schedule ? isl_stat_ok : isl_stat_error;
+}
+
+/* Return the union of the filters of the children of the sequence node
+ * "node" at positions "first" up to (but not including) "last".
+ */
+static __isl_give isl_union_set *union_child_filters(
+	__isl_keep isl_schedule_node *node, int first, int last)
+{
+	int i;
+	isl_union_set *filter = NULL;
+
+	for (i = first; i < last; ++i) {
+		isl_schedule_node *child;
+		isl_union_set *filter_i;
+
+		child = isl_schedule_node_get_child(node, i);
+		filter_i = isl_schedule_node_filter_get_filter(child);
+		isl_schedule_node_free(child);
+		filter = filter ? isl_union_set_union(filter, filter_i)
+				: filter_i;
+	}
+
+	return filter;
+}
+
+/* If the child of the filter at position "pos" of the sequence node "node"
+ * is itself a sequence node, then splice its children into "node".
+ */
+static __isl_give isl_schedule_node *splice_child_sequence(
+	__isl_take isl_schedule_node *node, int pos)
+{
+	enum isl_schedule_node_type type;
+
+	node = isl_schedule_node_child(node, pos);
+	node = isl_schedule_node_child(node, 0);
+	type = isl_schedule_node_get_type(node);
+	node = isl_schedule_node_parent(node);
+	node = isl_schedule_node_parent(node);
+	if (type == isl_schedule_node_sequence)
+		node = isl_schedule_node_sequence_splice_child(node, pos);
+
+	return node;
+}
+
+/* Fuse the kernels in the children of the sequence node "node"
+ * at positions "first" up to and including "last" into a single kernel,
+ * where "coincident" describes the coincident members of the fused band.
+ *
+ * If these are not all the children of "node", then first separate them
+ * into a subsequence of their own, keeping the other children in "node".
+ * Then remove the band nodes at the top of these children and
+ * insert a single band node with the union of their partial schedules
+ * on top of the subsequence.
+ * Return a pointer to the position of "node" in the modified tree.
+ * If all children were fused, then this position now contains
+ * the fused band.  Otherwise, it still contains a sequence node,
+ * with the fused kernel as the child at position "first".
+ */
+static __isl_give isl_schedule_node *fuse_kernel_run(
+	__isl_take isl_schedule_node *node, int first, int last,
+	int *coincident, int verbose)
+{
+	int i, n, separate;
+	isl_ctx *ctx;
+	isl_union_set_list *filters;
+	isl_multi_union_pw_aff *mupa = NULL;
+
+	n = isl_schedule_node_n_children(node);
+	if (n < 0)
+		return isl_schedule_node_free(node);
+	ctx = isl_schedule_node_get_ctx(node);
+	separate = first > 0 || last < n - 1;
+	if (separate) {
+		filters = isl_union_set_list_alloc(ctx, 3);
+		if (first > 0)
+			filters = isl_union_set_list_add(filters,
+				    union_child_filters(node, 0, first));
+		filters = isl_union_set_list_add(filters,
+				    union_child_filters(node, first, last + 1));
+		if (last < n - 1)
+			filters = isl_union_set_list_add(filters,
+				    union_child_filters(node, last + 1, n));
+		node = isl_schedule_node_insert_sequence(node, filters);
+		if (last < n - 1)
+			node = splice_child_sequence(node, first > 0 ? 2 : 1);
+		if (first > 0)
+			node = splice_child_sequence(node, 0);
+		node = isl_schedule_node_child(node, first);
+		node = isl_schedule_node_child(node, 0);
+	}
+
+	for (i = 0; i <= last - first; ++i) {
+		isl_multi_union_pw_aff *mupa_i;
+
+		node = isl_schedule_node_child(node, i);
+		node = isl_schedule_node_child(node, 0);
+		mupa_i = isl_schedule_node_band_get_partial_schedule(node);
+		mupa_i = isl_multi_union_pw_aff_reset_tuple_id(mupa_i,
+								isl_dim_set);
+		mupa = mupa ? isl_multi_union_pw_aff_union_add(mupa, mupa_i)
+			    : mupa_i;
+		node = isl_schedule_node_delete(node);
+		node = isl_schedule_node_parent(node);
+		node = isl_schedule_node_parent(node);
+	}
+
+	node = isl_schedule_node_insert_partial_schedule(node, mupa);
+	node = isl_schedule_node_band_set_permutable(node, 1);
+	n = isl_schedule_node_band_n_member(node);
+	for (i = 0; i < n; ++i)
+		node = isl_schedule_node_band_member_set_coincident(node, i,
+								coincident[i]);
+	if (verbose && node)
+		report_fused_kernel(node, last - first + 1);
+
+	if (separate) {
+		node = isl_schedule_node_parent(node);
+		node = isl_schedule_node_parent(node);
+	}
+
+	return node;
+}
+
+/* Return the dependences in "dep" between statement instances
+ * that reach "node" and that have the same prefix schedule at "node",
+ * i.e., that are not carried by any outer node.
+ */
+static __isl_give isl_union_map *local_dependences(
+	__isl_keep isl_schedule_node *node, __isl_keep isl_union_map *dep)
+{
+	isl_union_map *prefix, *same;
+	isl_union_pw_multi_aff *contraction;
+
+	prefix = isl_schedule_node_get_prefix_schedule_union_map(node);
+	contraction = isl_schedule_node_get_subtree_contraction(node);
+	prefix = isl_union_map_preimage_domain_union_pw_multi_aff(prefix,
+								contraction);
+	same = isl_union_map_reverse(isl_union_map_copy(prefix));
+	same = isl_union_map_apply_range(prefix, same);
+	return isl_union_map_intersect(isl_union_map_copy(dep), same);
 }
 
-/* Given a set or sequence node, return the union the filters of either all
- * (if "only_initial" is not set) or the initial (if "only_initial" is set)
- * direct subtrees that do not contain any suitably permutable bands
- * (according to subtree_has_permutable_bands).
+/* Fuse maximal runs of adjacent children of the sequence node "node"
+ * that consist of a kernel (a suitably permutable band) such that
+ * each of these kernels can be fused with the preceding kernels in the run
+ * according to can_fuse_kernel.
+ * Return a pointer to the position of "node" in the modified tree.
+ *
+ * "first" is the position of the first kernel in the current run or -1
+ * if there is no current run.
+ * After fusing a run, the children at positions "first" up to
+ * (but not including) "i" have been replaced by a single child
+ * at position "first".
  */
-static __isl_give isl_union_set *get_non_parallel_subtree_filters(
-	__isl_keep isl_schedule_node *node, int only_initial)
+static __isl_give isl_schedule_node *fuse_kernels_in_sequence(
+	__isl_take isl_schedule_node *node,
+	struct ppcg_fuse_kernels_data *data)
 {
-	isl_space *space;
-	isl_union_set *filter;
-	int i, n;
+	int i, n, first = -1;
+	isl_schedule_node *child = NULL;
+	isl_union_map *schedule = NULL;
 
 	n = isl_schedule_node_n_children(node);
 	if (n < 0)
-		return NULL;
-
-	node = isl_schedule_node_copy(node);
-	node = isl_schedule_node_child(node, 0);
-	filter = isl_schedule_node_filter_get_filter(node);
-	node = isl_schedule_node_parent(node);
-	space = isl_union_set_get_space(filter);
-	isl_union_set_free(filter);
-	filter = isl_union_set_empty(space);
+		return isl_schedule_node_free(node);
 
+	data->local_dep = local_dependences(node, data->dep);
 	for (i = 0; i < n; ++i) {
-		int parallelism;
-
-		node = isl_schedule_node_child(node, i);
-		parallelism = subtree_has_permutable_bands(node);
-		if (parallelism < 0) {
-			filter = isl_union_set_free(filter);
-		} else if (!parallelism) {
-			isl_union_set *filter_i;
-			filter_i = isl_schedule_node_filter_get_filter(node);
-			filter = isl_union_set_union(filter, filter_i);
-		} else if (only_initial)
-			break;
-		node = isl_schedule_node_parent(node);
+		isl_bool permutable, fuse = isl_bool_false;
+		isl_stat r;
+		const char *reason;
+
+		child = isl_schedule_node_get_child(node, i);
+		child = isl_schedule_node_child(child, 0);
+		permutable = is_permutable(child);
+		if (permutable < 0)
+			goto error;
+		if (permutable)
+			schedule = band_instance_schedule(child);
+		if (permutable && first >= 0) {
+			fuse = can_fuse_kernel(data, child, schedule, &reason);
+			if (fuse < 0)
+				goto error;
+			if (data->verbose)
+				report_fusion(child, fuse ? NULL : reason);
+		}
+		if (fuse) {
+			r = extend_kernel_run(data, child, schedule);
+		} else {
+			if (first >= 0 && i - 1 > first) {
+				node = fuse_kernel_run(node, first, i - 1,
+					data->coincident, data->verbose);
+				n -= i - 1 - first;
+				i = first + 1;
+			}
+			first = -1;
+			r = isl_stat_ok;
+			if (permutable) {
+				r = start_kernel_run(data, child, schedule);
+				first = i;
+			}
+		}
+		schedule = NULL;
+		child = isl_schedule_node_free(child);
+		if (r < 0 || !node)
+			goto error;
 	}
 
-	isl_schedule_node_free(node);
+	if (first >= 0 && n - 1 > first)
+		node = fuse_kernel_run(node, first, n - 1,
+					data->coincident, data->verbose);
+	fuse_kernels_data_clear(data);
+	data->local_dep = isl_union_map_free(data->local_dep);
 
-	return filter;
+	return node;
+error:
+	isl_union_map_free(schedule);
+	isl_schedule_node_free(child);
+	fuse_kernels_data_clear(data);
+	data->local_dep = isl_union_map_free(data->local_dep);
+	return isl_schedule_node_free(node);
 }
 
-/* Given a set or sequence node, return the union of the filters of
- * the direct subtrees that do not contain any suitably permutable bands
- * (according to subtree_has_permutable_bands).
+/* Fuse adjacent kernels in the sequence nodes in the subtree at "node"
+ * that are not themselves inside a kernel.
  */
-static __isl_give isl_union_set *get_all_non_parallel_subtree_filters(
-	__isl_keep isl_schedule_node *node)
+static __isl_give isl_schedule_node *fuse_kernels_in_subtree(
+	__isl_take isl_schedule_node *node,
+	struct ppcg_fuse_kernels_data *data)
 {
-	return get_non_parallel_subtree_filters(node, 0);
-}
+	int i, n;
+	isl_bool permutable;
 
-/* Given a set or sequence node, return the union of the filters of
- * the initial direct subtrees that do not contain any suitably permutable
- * bands (according to subtree_has_permutable_bands).
- */
-static __isl_give isl_union_set *get_initial_non_parallel_subtree_filters(
-	__isl_keep isl_schedule_node *node)
-{
-	return get_non_parallel_subtree_filters(node, 1);
+	permutable = is_permutable(node);
+	if (permutable < 0)
+		return isl_schedule_node_free(node);
+	if (permutable)
+		return node;
+
+	if (isl_schedule_node_get_type(node) == isl_schedule_node_sequence) {
+		node = fuse_kernels_in_sequence(node, data);
+		permutable = is_permutable(node);
+		if (permutable < 0)
+			return isl_schedule_node_free(node);
+		if (permutable)
+			return node;
+	}
+
+	n = isl_schedule_node_n_children(node);
+	if (n < 0)
+		return isl_schedule_node_free(node);
+	for (i = 0; i < n; ++i) {
+		node = isl_schedule_node_child(node, i);
+		node = fuse_kernels_in_subtree(node, data);
+		node = isl_schedule_node_parent(node);
+	}
+
+	return node;
 }
 
-/* Mark all variables that are accessed by the statement instances in "domain"
- * and that are local to "prog" as requiring a declaration in the host code.
- * The statement instances in "domain" correspond to (a subset of)
- * the active instances at "node".
- * "node" is not modified by this function, except that NULL is returned
- * in case of error.
+/* If the "fuse_kernels" option is set, then fuse adjacent kernels
+ * in the subtree at "node" that have the same grid and
+ * that only depend on each other within a single thread.
+ * This removes kernel launches and allows the intermediate results
+ * that are passed between the fused kernels to be kept
+ * in private or shared memory by the memory promotion in each kernel.
+ * The dependences that are taken into account are the flow and
+ * the false dependences, irrespective of whether
+ * live range reordering is allowed.
  */
-static __isl_give isl_schedule_node *declare_accessed_local_variables(
-	__isl_take isl_schedule_node *node, struct gpu_prog *prog,
-	__isl_keep isl_union_set *domain)
+static __isl_give isl_schedule_node *fuse_kernels(struct gpu_gen *gen,
+	__isl_take isl_schedule_node *node)
 {
-	isl_union_pw_multi_aff *contraction;
-	isl_union_set *arrays;
-	int i;
+	struct ppcg_fuse_kernels_data data = { gen->prog, 0, NULL, NULL,
+						NULL, NULL, 0, NULL };
 
-	if (!ppcg_scop_any_hidden_declarations(prog->scop))
+	if (!gen->options->fuse_kernels)
 		return node;
-	contraction = isl_schedule_node_get_subtree_contraction(node);
-	domain = isl_union_set_copy(domain);
-	domain = isl_union_set_preimage_union_pw_multi_aff(domain, contraction);
-	arrays = accessed_by_domain(domain, prog);
-
-	for (i = 0; i < prog->n_array; ++i) {
-		isl_space *space;
-		isl_set *set;
-		int empty;
 
-		if (!prog->array[i].local)
-			continue;
-		space = isl_set_get_space(prog->array[i].extent);
-		set = isl_union_set_extract_set(arrays, space);
-		empty = isl_set_plain_is_empty(set);
-		isl_set_free(set);
-		if (empty < 0)
-			goto error;
-		if (!empty)
-			prog->array[i].declare_local = 1;
-	}
+	data.verbose = gen->options->debug->verbose;
+	data.dep = isl_union_map_union(
+			isl_union_map_copy(gen->prog->scop->dep_flow),
+			isl_union_map_copy(gen->prog->scop->dep_false));
+	node = fuse_kernels_in_subtree(node, &data);
+	fuse_kernels_data_clear(&data);
+	isl_union_map_free(data.dep);
 
-	isl_union_set_free(arrays);
 	return node;
-error:
-	isl_union_set_free(arrays);
-	return isl_schedule_node_free(node);
 }
 
-/* If "node" points to a set node, then separate its children
- * into subtrees that have suitably permutable bands and
- * those that do not.
- * Adjust the schedule tree in order to execute the second group
- * after the first group and return a pointer to the first group,
- * assuming there are any such subtrees.
- * If "node" points to a sequence node, then separate the initial
- * children that do not have suitably permutable bands and
- * return a pointer to the subsequence of children that do have such bands,
- * assuming there are any such subtrees.
- *
- * In both cases, mark all local variables in "prog" that are accessed by
- * the group without permutable bands as requiring a declaration on the host.
+/* Return the rectangular hull of "set", i.e., the smallest box
+ * (with bounds that are piecewise affine in the parameters)
+ * that contains "set".
  */
-static __isl_give isl_schedule_node *isolate_permutable_subtrees(
-	__isl_take isl_schedule_node *node, struct gpu_prog *prog)
+static __isl_give isl_set *box_hull(__isl_take isl_set *set)
 {
-	isl_union_set *filter;
-	enum isl_schedule_node_type type;
+	int i, n;
+	isl_space *space;
+	isl_local_space *ls;
+	isl_multi_aff *ma;
+	isl_set *box;
 
-	if (!node)
-		return NULL;
-	type = isl_schedule_node_get_type(node);
-	if (type == isl_schedule_node_set) {
-		filter = get_all_non_parallel_subtree_filters(node);
-		node = declare_accessed_local_variables(node, prog, filter);
-		node = isl_schedule_node_order_after(node, filter);
-	} else if (type == isl_schedule_node_sequence) {
-		filter = get_initial_non_parallel_subtree_filters(node);
-		node = declare_accessed_local_variables(node, prog, filter);
-		node = isl_schedule_node_order_before(node, filter);
+	n = isl_set_dim(set, isl_dim_set);
+	space = isl_set_get_space(set);
+	box = isl_set_universe(isl_space_copy(space));
+	ls = isl_local_space_from_space(isl_space_copy(space));
+	ma = isl_multi_aff_zero(isl_space_from_domain(space));
+	for (i = 0; i < n; ++i) {
+		isl_pw_aff *lb, *ub, *var;
+
+		lb = isl_set_dim_min(isl_set_copy(set), i);
+		ub = isl_set_dim_max(isl_set_copy(set), i);
+		lb = isl_pw_aff_from_range(lb);
+		ub = isl_pw_aff_from_range(ub);
+		lb = isl_pw_aff_pullback_multi_aff(lb, isl_multi_aff_copy(ma));
+		ub = isl_pw_aff_pullback_multi_aff(ub, isl_multi_aff_copy(ma));
+		var = isl_pw_aff_var_on_domain(isl_local_space_copy(ls),
+						isl_dim_set, i);
+		box = isl_set_intersect(box,
+				isl_pw_aff_ge_set(isl_pw_aff_copy(var), lb));
+		box = isl_set_intersect(box, isl_pw_aff_le_set(var, ub));
 	}
+	isl_multi_aff_free(ma);
+	isl_local_space_free(ls);
+	isl_set_free(set);
 
-	return node;
+	return box;
 }
 
 /* Replace any reference to an array element in the range of "copy"
  * by a reference to all array elements (defined by the extent of the array).
+ *
+ * If the sub_box_transfers option is set, then only the rectangular hull
+ * of the referenced elements of an array will be copied out.
+ * Replace the references by references to all elements in this hull instead.
+ * Persistent arrays are always copied in their entirety.
  */
 static __isl_give isl_union_map *approximate_copy_out(
 	__isl_take isl_union_map *copy, struct gpu_prog *prog)
 {
 	int i;
+	int sub_box;
 	isl_union_map *res;
 
+	sub_box = prog->scop->options->sub_box_transfers;
 	res = isl_union_map_empty(isl_union_map_get_space(copy));
 
 	for (i = 0; i < prog->n_array; ++i) {
@@ -4601,6 +6656,17 @@ static __isl_give isl_union_map *approximate_copy_out(
 		copy_i = isl_union_map_copy(copy);
 		copy_i = isl_union_map_intersect_range(copy_i, extent);
 		set = isl_set_copy(prog->array[i].extent);
+		if (sub_box && prog->array[i].n_index > 0 &&
+		    !prog->array[i].persistent) {
+			isl_union_set *range;
+
+			space = isl_space_copy(prog->array[i].space);
+			range = isl_union_map_range(isl_union_map_copy(copy_i));
+			set = isl_set_intersect(set,
+				    isl_union_set_extract_set(range, space));
+			isl_union_set_free(range);
+			set = box_hull(set);
+		}
 		extent = isl_union_set_from_set(set);
 		domain = isl_union_map_domain(copy_i);
 		copy_i = isl_union_map_from_domain_and_range(domain, extent);
@@ -4612,6 +6678,118 @@ static __isl_give isl_union_map *approximate_copy_out(
 	return res;
 }
 
+/* Set the offset and size of "box" to those of the rectangular hull
+ * of "set".  For parameter values where "set" is empty,
+ * both the offset and the size are set to zero.
+ * The lower bounds on the elements of "set" are assumed
+ * to be non-negative.
+ */
+static isl_stat set_array_box(struct gpu_array_box *box,
+	__isl_take isl_set *set)
+{
+	int i, n;
+	isl_space *space;
+
+	n = isl_set_dim(set, isl_dim_set);
+	space = isl_set_get_space(set);
+	box->offset = isl_multi_pw_aff_zero(isl_space_copy(space));
+	box->size = isl_multi_pw_aff_zero(space);
+	for (i = 0; i < n; ++i) {
+		isl_local_space *ls;
+		isl_aff *aff;
+		isl_pw_aff *lb, *ub, *zero, *one;
+
+		lb = isl_set_dim_min(isl_set_copy(set), i);
+		ub = isl_set_dim_max(isl_set_copy(set), i);
+		ls = isl_local_space_from_space(isl_pw_aff_get_domain_space(lb));
+		aff = isl_aff_zero_on_domain(ls);
+		zero = isl_pw_aff_from_aff(isl_aff_copy(aff));
+		one = isl_pw_aff_from_aff(isl_aff_add_constant_si(aff, 1));
+		ub = isl_pw_aff_sub(ub, isl_pw_aff_copy(lb));
+		ub = isl_pw_aff_add(ub, one);
+		lb = isl_pw_aff_union_max(lb, isl_pw_aff_copy(zero));
+		ub = isl_pw_aff_union_max(ub, zero);
+		box->offset = isl_multi_pw_aff_set_pw_aff(box->offset, i, lb);
+		box->size = isl_multi_pw_aff_set_pw_aff(box->size, i, ub);
+	}
+	isl_set_free(set);
+
+	if (!box->offset || !box->size)
+		return isl_stat_error;
+	return isl_stat_ok;
+}
+
+/* Print the box of elements of "array" that is copied
+ * in the direction described by "dir".
+ */
+static void dump_array_box(struct gpu_array_info *array,
+	struct gpu_array_box *box, const char *dir)
+{
+	isl_printer *p;
+
+	p = isl_printer_to_file(isl_multi_pw_aff_get_ctx(box->offset), stdout);
+	p = isl_printer_print_str(p, dir);
+	p = isl_printer_print_str(p, " ");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, ": offset ");
+	p = isl_printer_print_multi_pw_aff(p, box->offset);
+	p = isl_printer_print_str(p, ", size ");
+	p = isl_printer_print_multi_pw_aff(p, box->size);
+	p = isl_printer_print_str(p, ", element size ");
+	p = isl_printer_print_int(p, array->size);
+	p = isl_printer_print_str(p, " bytes, full size ");
+	p = isl_printer_print_multi_pw_aff(p, array->bound);
+	p = isl_printer_end_line(p);
+	isl_printer_free(p);
+}
+
+/* For each non-scalar, non-persistent array in "prog"
+ * with elements in "copy",
+ * keep track of the rectangular hull of those elements
+ * in array->copy_in (if "to_host" is not set) or
+ * array->copy_out (if "to_host" is set).
+ * The copying code will then only copy the elements in this hull.
+ * The hull is computed within the extent of the array
+ * to ensure that it is bounded.
+ * If the dump_transfers debug option is set, then print
+ * the hulls as well as the full array sizes for comparison.
+ */
+static isl_stat set_copy_boxes(struct gpu_prog *prog,
+	__isl_keep isl_union_set *copy, int to_host)
+{
+	int i;
+	int dump = prog->scop->options->debug->dump_transfers;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+		struct gpu_array_box *box;
+		isl_set *set;
+		int empty;
+
+		if (array->n_index == 0 || array->persistent)
+			continue;
+		set = isl_union_set_extract_set(copy,
+					isl_space_copy(array->space));
+		empty = isl_set_plain_is_empty(set);
+		if (empty < 0 || empty) {
+			isl_set_free(set);
+			if (empty < 0)
+				return isl_stat_error;
+			continue;
+		}
+		set = isl_set_intersect(set, isl_set_copy(array->extent));
+		box = to_host ? &array->copy_out : &array->copy_in;
+		gpu_array_box_clear(box);
+		if (set_array_box(box, set) < 0)
+			return isl_stat_error;
+		if (dump)
+			dump_array_box(array, box,
+				to_host ? "copy from device" : "copy to device");
+	}
+
+	return isl_stat_ok;
+}
+
 /* Insert "kernel" marks that point to a ppcg_kernel structure
  * in front of all outermost tilable band that (by construction)
  * have at least one parallel loop.
@@ -5434,6 +7612,10 @@ static __isl_give isl_union_set *node_may_persist(
  * the subtree "node" and that may be used after "node"
  * or that may be visible outside the corresponding scop,
  * we copy out its entire extent.
+ * If the sub_box_transfers option is set, then we only copy out
+ * the rectangular hull of the elements that are possibly written and
+ * we only copy in the rectangular hull of the elements
+ * that need to be copied in.
  *
  * Any array elements that is read without first being written inside
  * the subtree "node" needs to be copied in.
@@ -5465,6 +7647,7 @@ static __isl_give isl_schedule_node *add_to_from_device(
 	isl_union_set *may_persist;
 	isl_union_map *may_write, *must_write, *copy_out, *not_written;
 	isl_union_map *read, *copy_in;
+	isl_union_set *copy_in_range, *copy_out_range;
 	isl_union_map *tagged;
 	isl_union_map *local_uninitialized;
 	isl_schedule_node *graft;
@@ -5516,11 +7699,16 @@ static __isl_give isl_schedule_node *add_to_from_device(
 	copy_in = isl_union_map_apply_range(copy_in,
 				    isl_union_map_copy(prog->to_outer));
 
-	graft = create_copy_device(prog, node, "to_device",
-						isl_union_map_range(copy_in));
+	copy_in_range = isl_union_map_range(copy_in);
+	copy_out_range = isl_union_map_range(copy_out);
+	if (prog->scop->options->sub_box_transfers &&
+	    (set_copy_boxes(prog, copy_in_range, 0) < 0 ||
+	     set_copy_boxes(prog, copy_out_range, 1) < 0))
+		node = isl_schedule_node_free(node);
+
+	graft = create_copy_device(prog, node, "to_device", copy_in_range);
 	node = isl_schedule_node_graft_before(node, graft);
-	graft = create_copy_device(prog, node, "from_device",
-						isl_union_map_range(copy_out));
+	graft = create_copy_device(prog, node, "from_device", copy_out_range);
 	node = isl_schedule_node_graft_after(node, graft);
 
 	return node;
@@ -5595,6 +7783,7 @@ static __isl_give isl_schedule *map_to_device(struct gpu_gen *gen,
 	node = isl_schedule_node_child(node, 0);
 	node = isl_schedule_node_child(node, 0);
 	node = isolate_permutable_subtrees(node, gen->prog);
+	node = fuse_kernels(gen, node);
 	domain = isl_schedule_node_get_domain(node);
 	contraction = isl_schedule_node_get_subtree_contraction(node);
 	domain = isl_union_set_preimage_union_pw_multi_aff(domain,
@@ -5884,33 +8073,79 @@ static struct gpu_stmt *extract_stmts(isl_ctx *ctx, struct ppcg_scop *scop,
 	return stmts;
 }
 
-/*
- * Change all coincidents to "1" when split tiling is applied and
- * the input satisfies the stencil partern.
+/* Change all coincidents of the band node "node" to "1"
+ * if it satisfies the stencil partern.
+ * If the kind of tiling is selected automatically or if "node" is
+ * one of several outermost bands (each of which may result
+ * in a separate kernel), then only do so if the band is selected
+ * for split or overlapped tiling, since other bands are tiled
+ * in the usual way.  Otherwise, the user is assumed to have checked
+ * that the outermost band is a stencil.
  */
-static __isl_give isl_schedule *force_coincidents(__isl_take isl_schedule *schedule)
+static __isl_give isl_schedule_node *force_coincident_band(
+	struct gpu_gen *gen, __isl_take isl_schedule_node *node, int nested)
 {
 	int i;
-	isl_schedule_node *node;
-	
-	node = isl_schedule_get_root(schedule);
 
-	while (isl_schedule_node_get_type(node) != isl_schedule_node_band){
-		node = isl_schedule_node_child(node, 0);
-		//We currently assume a sequence/set node does not hold stencil properties
-		if(isl_schedule_node_get_type(node) == isl_schedule_node_sequence ||
-				isl_schedule_node_get_type(node) == isl_schedule_node_set ||
-				isl_schedule_node_get_type(node) == isl_schedule_node_leaf){
-			isl_schedule_node_free(node);
-			return schedule;
-		}
+	if (nested || gen->options->tiling == PPCG_TILING_AUTO) {
+		enum ppcg_tiling_type type;
+		const char *reason;
+
+		if (ppcg_stencil_choose_tiling(gen->prog->scop, node, 0,
+						&type, &reason) < 0)
+			return isl_schedule_node_free(node);
+		if (type != ppcg_tiling_split &&
+		    type != ppcg_tiling_overlapped)
+			return node;
 	}
 
 	for (i=0; i<isl_schedule_node_band_n_member(node); i++)
 		if(!isl_schedule_node_band_member_get_coincident(node, i))
 			node = isl_schedule_node_band_member_set_coincident(node, i, 1);
-	
+
+	return node;
+}
+
+/* Call force_coincident_band on each outermost band node
+ * in the subtree rooted at "node".
+ * "nested" is set if "node" appears underneath a sequence or set node.
+ */
+static __isl_give isl_schedule_node *force_coincident_bands(
+	struct gpu_gen *gen, __isl_take isl_schedule_node *node, int nested)
+{
+	int i, n;
+	enum isl_schedule_node_type type;
+
+	type = isl_schedule_node_get_type(node);
+	if (type == isl_schedule_node_band)
+		return force_coincident_band(gen, node, nested);
+	if (type == isl_schedule_node_sequence || type == isl_schedule_node_set)
+		nested = 1;
+
+	n = isl_schedule_node_n_children(node);
+	for (i = 0; i < n; ++i) {
+		node = isl_schedule_node_child(node, i);
+		node = force_coincident_bands(gen, node, nested);
+		node = isl_schedule_node_parent(node);
+	}
+
+	return node;
+}
+
+/*
+ * Change all coincidents to "1" when split tiling is applied and
+ * the input satisfies the stencil partern.
+ * Each outermost band may be mapped to a separate kernel,
+ * so all of them are considered.
+ */
+static __isl_give isl_schedule *force_coincidents(struct gpu_gen *gen,
+	__isl_take isl_schedule *schedule)
+{
+	isl_schedule_node *node;
+
+	node = isl_schedule_get_root(schedule);
 	isl_schedule_free(schedule);
+	node = force_coincident_bands(gen, node, 0);
 	schedule = isl_schedule_node_get_schedule(node);
 	isl_schedule_node_free(node);
 
@@ -5996,11 +8231,9 @@ static __isl_give isl_printer *generate(__isl_take isl_printer *p,
 	gen->prog = prog;
 	schedule = get_schedule(gen);
 
-	//TODO: handle more complex cases or check stencil partern
-	int stencil_partern = 1;
-	if(stencil_partern && 
-		(gen->options->split_tile || gen->options->rectangle))
-		schedule = force_coincidents(schedule);
+	if (gen->options->split_tile || gen->options->rectangle ||
+	    gen->options->tiling == PPCG_TILING_AUTO)
+		schedule = force_coincidents(gen, schedule);
 
 	any_permutable = has_any_permutable_node(schedule);
 	if (any_permutable < 0 || !any_permutable) {
@@ -6050,8 +8283,17 @@ int generate_gpu(isl_ctx *ctx, const char *input, FILE *out,
 
 	gen.ctx = ctx;
 	gen.sizes = extract_sizes_from_str(ctx, options->sizes);
+	gen.device = NULL;
+	if (options->device) {
+		gen.device = gpu_device_read(ctx, options->device);
+		if (!gen.device) {
+			isl_union_map_free(gen.sizes);
+			return -1;
+		}
+	}
 	gen.options = options;
 	gen.kernel_id = 0;
+	gen.warp_kernel = 0;
 	gen.print = print;
 	gen.print_user = user;
 	gen.types.n = 0;
@@ -6070,6 +8312,7 @@ int generate_gpu(isl_ctx *ctx, const char *input, FILE *out,
 	}
 
 	isl_union_map_free(gen.sizes);
+	gpu_device_free(gen.device);
 	for (i = 0; i < gen.types.n; ++i)
 		free(gen.types.name[i]);
 	free(gen.types.name);
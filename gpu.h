@@ -55,6 +55,21 @@ struct gpu_stmt {
 	struct gpu_stmt_access *accesses;
 };
 
+/* A rectangular box of array elements that is copied between
+ * the host and the device.
+ * "offset" and "size" are the offset and the size of the box
+ * in each dimension, expressed in terms of the parameters.
+ * "offset_expr" and "size_expr" are the corresponding access
+ * AST expressions.
+ * If "offset" is NULL, then the entire array is copied.
+ */
+struct gpu_array_box {
+	isl_multi_pw_aff *offset;
+	isl_multi_pw_aff *size;
+	isl_ast_expr *offset_expr;
+	isl_ast_expr *size_expr;
+};
+
 /* Represents an outer array possibly accessed by a gpu_prog.
  */
 struct gpu_array_info {
@@ -105,9 +120,18 @@ struct gpu_array_info {
 	/* Is the corresponding global device memory accessed in any way? */
 	int global;
 
+	/* Is the device copy of the array kept across scops? */
+	int persistent;
+
 	/* Should the array be linearized? */
 	int linearize;
 
+	/* Boxes of elements that are copied to and from the device.
+	 * Only used if the sub_box_transfers option is set.
+	 */
+	struct gpu_array_box copy_in;
+	struct gpu_array_box copy_out;
+
 	/* Order dependences on this array.
 	 * Only used if live_range_reordering option is set.
 	 * It is set to NULL otherwise.
@@ -221,8 +245,14 @@ struct gpu_gen {
 	/* Effectively used tile, grid and block sizes for each kernel */
 	isl_union_map *used_sizes;
 
+	/* Description of the target device, NULL if not specified */
+	struct gpu_device *device;
+
 	/* Identifier of the next kernel. */
 	int kernel_id;
+
+	/* Is the kernel that is being created mapped to a single warp? */
+	int warp_kernel;
 };
 
 enum ppcg_group_access_type {
@@ -248,6 +278,10 @@ enum ppcg_kernel_stmt_type {
  * read is set if the statement should copy data from global memory
  * to shared memory or registers.
  *
+ * vector is the number of consecutive elements copied by the statement
+ * using a single vector access, or 0 if the statement copies
+ * a single element.
+ *
  * index expresses an access to the array element that needs to be copied
  * local_index expresses the corresponding element in the tile
  *
@@ -262,6 +296,12 @@ enum ppcg_kernel_stmt_type {
  *
  * n_access is the number of accesses in stmt
  * access is an array of local information about the accesses
+ *
+ *
+ * for ppcg_kernel_sync statements we have
+ *
+ * warp is set if the synchronization only needs to involve
+ * the threads of a single warp
  */
 struct ppcg_kernel_stmt {
 	enum ppcg_kernel_stmt_type type;
@@ -269,6 +309,7 @@ struct ppcg_kernel_stmt {
 	union {
 		struct {
 			int read;
+			int vector;
 			isl_ast_expr *index;
 			isl_ast_expr *local_index;
 			struct gpu_array_info *array;
@@ -278,16 +319,23 @@ struct ppcg_kernel_stmt {
 			struct gpu_stmt *stmt;
 			isl_id_to_ast_expr *ref2expr;
 		} d;
+		struct {
+			int warp;
+		} s;
 	} u;
 };
 
 /* Representation of a local variable in a kernel.
+ *
+ * If "align" is not zero, then the variable needs to be aligned
+ * to "align" bytes.
  */
 struct ppcg_kernel_var {
 	struct gpu_array_info *array;
 	enum ppcg_group_access_type type;
 	char *name;
 	isl_vec *size;
+	int align;
 };
 
 /* Representation of a kernel.
@@ -303,6 +351,10 @@ struct ppcg_kernel_var {
  * of the grid.
  * the first n_block elements of block_dim represent the specified or
  * effective size of the block.
+ * coarsened is set if the block size has been reduced in order
+ * for each thread to compute several points of the band mapped to threads.
+ * warp_sync is set if each block consists of a single warp,
+ * such that synchronization only needs to be performed at warp level.
  * Note that in the input file, the sizes of the grid and the blocks
  * are specified in the order x, y, z, but internally, the sizes
  * are stored in reverse order, so that the last element always
@@ -379,6 +431,8 @@ struct ppcg_kernel {
 	int n_block;
 	int grid_dim[2];
 	int block_dim[3];
+	int coarsened;
+	int warp_sync;
 
 	isl_multi_pw_aff *grid_size;
 	isl_ast_expr *grid_size_expr;
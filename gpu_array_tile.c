@@ -1,5 +1,6 @@
 #include <isl/aff.h>
 #include <isl/map.h>
+#include <isl/space.h>
 
 #include "gpu_array_tile.h"
 
@@ -18,6 +19,7 @@ struct gpu_array_tile *gpu_array_tile_free(struct gpu_array_tile *tile)
 	}
 	free(tile->bound);
 	isl_multi_aff_free(tile->tiling);
+	isl_aff_free(tile->buffer);
 	free(tile);
 
 	return NULL;
@@ -52,7 +54,7 @@ struct gpu_array_tile *gpu_array_tile_create(isl_ctx *ctx, int n_index)
 }
 
 /* Compute the size of the tile specified by "tile"
- * in number of elements and return the result.
+ * in number of elements, including any padding, and return the result.
  */
 __isl_give isl_val *gpu_array_tile_size(struct gpu_array_tile *tile)
 {
@@ -64,8 +66,53 @@ __isl_give isl_val *gpu_array_tile_size(struct gpu_array_tile *tile)
 
 	size = isl_val_one(tile->ctx);
 
-	for (i = 0; i < tile->n; ++i)
-		size = isl_val_mul(size, isl_val_copy(tile->bound[i].size));
+	for (i = 0; i < tile->n; ++i) {
+		isl_val *bound = isl_val_copy(tile->bound[i].size);
+
+		if (i == tile->n - 1)
+			bound = isl_val_add_ui(bound, tile->padding);
+		size = isl_val_mul(size, bound);
+	}
 
 	return size;
 }
+
+/* Return the tiling of "tile", extended with the buffer selection
+ * in case the tile is double buffered.
+ * That is, return
+ *
+ *	{ [D[i] -> A[a]] -> T[t] }
+ *
+ * if "tile" is not double buffered and
+ *
+ *	{ [D[i] -> A[a]] -> T[b(i), t] }
+ *
+ * if it is.
+ */
+__isl_give isl_multi_aff *gpu_array_tile_get_buffered_tiling(
+	struct gpu_array_tile *tile)
+{
+	isl_space *space;
+	isl_id *id;
+	isl_aff *buffer;
+	isl_multi_aff *tiling;
+
+	if (!tile)
+		return NULL;
+
+	tiling = isl_multi_aff_copy(tile->tiling);
+	if (!tile->buffer)
+		return tiling;
+
+	space = isl_space_domain(isl_multi_aff_get_space(tiling));
+	space = isl_space_unwrap(space);
+	buffer = isl_aff_copy(tile->buffer);
+	buffer = isl_aff_pullback_multi_aff(buffer,
+					    isl_multi_aff_domain_map(space));
+	id = isl_multi_aff_get_tuple_id(tiling, isl_dim_out);
+	tiling = isl_multi_aff_flat_range_product(
+				    isl_multi_aff_from_aff(buffer), tiling);
+	tiling = isl_multi_aff_set_tuple_id(tiling, isl_dim_out, id);
+
+	return tiling;
+}
@@ -40,6 +40,24 @@ struct gpu_array_bound {
  *
  * where D represents the initial "depth" dimensions
  * of the computed schedule.
+ *
+ * double_buffer is set if room has been reserved for a second copy
+ * of the (shared memory) tile.
+ * If the tile is effectively double buffered, then "buffer" maps
+ * the outer "depth" dimensions to the copy that holds the tile
+ * at that point, i.e., it is of the form
+ *
+ *	{ D[i] -> [b(i)] }
+ *
+ * with 0 <= b(i) <= 1.  Otherwise, "buffer" is NULL.
+ *
+ * vector is the number of consecutive elements that are copied
+ * into the (shared memory) tile by a single vector access
+ * or 0 if the copying is not vectorized.
+ *
+ * padding is the number of unused elements that are added
+ * to the innermost dimension of the declared (shared memory) tile.
+ * It does not affect the tiling.
  */
 struct gpu_array_tile {
 	isl_ctx *ctx;
@@ -48,11 +66,17 @@ struct gpu_array_tile {
 	int n;
 	struct gpu_array_bound *bound;
 	isl_multi_aff *tiling;
+	int double_buffer;
+	isl_aff *buffer;
+	int vector;
+	int padding;
 };
 
 struct gpu_array_tile *gpu_array_tile_create(isl_ctx *ctx, int n_index);
 struct gpu_array_tile *gpu_array_tile_free(struct gpu_array_tile *tile);
 
 __isl_give isl_val *gpu_array_tile_size(struct gpu_array_tile *tile);
+__isl_give isl_multi_aff *gpu_array_tile_get_buffered_tiling(
+	struct gpu_array_tile *tile);
 
 #endif
@@ -0,0 +1,133 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_device.h"
+
+/* Set the field of "device" called "key" to "value".
+ * Return 0 on success and -1 if there is no such field.
+ */
+static int gpu_device_set(struct gpu_device *device, const char *key,
+	int value)
+{
+	if (!strcmp(key, "warp_size"))
+		device->warp_size = value;
+	else if (!strcmp(key, "max_threads_per_block"))
+		device->max_threads_per_block = value;
+	else if (!strcmp(key, "max_threads_per_sm"))
+		device->max_threads_per_sm = value;
+	else if (!strcmp(key, "max_blocks_per_sm"))
+		device->max_blocks_per_sm = value;
+	else if (!strcmp(key, "registers_per_sm"))
+		device->registers_per_sm = value;
+	else if (!strcmp(key, "registers_per_thread"))
+		device->registers_per_thread = value;
+	else if (!strcmp(key, "shared_memory_per_sm"))
+		device->shared_memory_per_sm = value;
+	else if (!strcmp(key, "shared_memory_per_block"))
+		device->shared_memory_per_block = value;
+	else
+		return -1;
+	return 0;
+}
+
+/* Read a description of the target device from the file
+ * called "filename".
+ * Each line of the file is either empty, a comment starting with '#'
+ * or of the form
+ *
+ *	key value
+ *
+ * with "key" the name of one of the fields of struct gpu_device
+ * and "value" a positive integer.
+ * Fields that are not set in the file keep their default values,
+ * which correspond to a device of compute capability 7.0.
+ */
+struct gpu_device *gpu_device_read(isl_ctx *ctx, const char *filename)
+{
+	FILE *file;
+	char line[256];
+	struct gpu_device *device;
+
+	device = isl_calloc_type(ctx, struct gpu_device);
+	if (!device)
+		return NULL;
+	device->warp_size = 32;
+	device->max_threads_per_block = 1024;
+	device->max_threads_per_sm = 2048;
+	device->max_blocks_per_sm = 32;
+	device->registers_per_sm = 65536;
+	device->registers_per_thread = 32;
+	device->shared_memory_per_sm = 98304;
+	device->shared_memory_per_block = 49152;
+
+	file = fopen(filename, "r");
+	if (!file) {
+		free(device);
+		isl_die(ctx, isl_error_invalid,
+			"unable to open device description", return NULL);
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char key[256];
+		int value;
+		int n;
+
+		n = sscanf(line, " %255s %d", key, &value);
+		if (n <= 0 || key[0] == '#')
+			continue;
+		if (n == 2 && value > 0 &&
+		    gpu_device_set(device, key, value) >= 0)
+			continue;
+		fclose(file);
+		free(device);
+		isl_die(ctx, isl_error_invalid,
+			"invalid line in device description", return NULL);
+	}
+
+	fclose(file);
+	return device;
+}
+
+void gpu_device_free(struct gpu_device *device)
+{
+	free(device);
+}
+
+/* Return the theoretical occupancy of a multiprocessor of "device",
+ * i.e., the ratio of the number of resident warps to the maximal
+ * number of resident warps, for a kernel with "threads" threads
+ * per block, each using device->registers_per_thread registers,
+ * and using "shared_memory" bytes of shared memory per block.
+ * Return 0 if such blocks cannot be executed on "device" at all.
+ */
+double gpu_device_occupancy(struct gpu_device *device, int threads,
+	long shared_memory)
+{
+	int warps, blocks, max_warps;
+	long registers;
+
+	if (threads <= 0 || threads > device->max_threads_per_block)
+		return 0;
+	if (shared_memory > device->shared_memory_per_block)
+		return 0;
+
+	warps = (threads + device->warp_size - 1) / device->warp_size;
+	max_warps = device->max_threads_per_sm / device->warp_size;
+	blocks = device->max_blocks_per_sm;
+	if (max_warps / warps < blocks)
+		blocks = max_warps / warps;
+	if (shared_memory > 0 &&
+	    device->shared_memory_per_sm / shared_memory < blocks)
+		blocks = device->shared_memory_per_sm / shared_memory;
+	registers = (long) device->registers_per_thread *
+			warps * device->warp_size;
+	if (device->registers_per_sm / registers < blocks)
+		blocks = device->registers_per_sm / registers;
+
+	return (double) (blocks * warps) / max_warps;
+}
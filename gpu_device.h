@@ -0,0 +1,45 @@
+/*
+ * Use of this software is governed by the MIT license
+ */
+
+#ifndef GPU_DEVICE_H
+#define GPU_DEVICE_H
+
+#include <isl/ctx.h>
+
+/* A description of the target device, used for estimating
+ * the occupancy of the streaming multiprocessors.
+ *
+ * warp_size is the number of threads in a warp.
+ * max_threads_per_block is the maximal number of threads in a block.
+ * max_threads_per_sm is the maximal number of threads that can
+ * be resident on a multiprocessor.
+ * max_blocks_per_sm is the maximal number of blocks that can
+ * be resident on a multiprocessor.
+ * registers_per_sm is the number of (32 bit) registers
+ * on a multiprocessor.
+ * registers_per_thread is the (assumed) number of registers
+ * used by each thread.
+ * shared_memory_per_sm is the amount of shared memory (in bytes)
+ * on a multiprocessor.
+ * shared_memory_per_block is the maximal amount of shared memory
+ * (in bytes) that can be used by a block.
+ */
+struct gpu_device {
+	int warp_size;
+	int max_threads_per_block;
+	int max_threads_per_sm;
+	int max_blocks_per_sm;
+	int registers_per_sm;
+	int registers_per_thread;
+	int shared_memory_per_sm;
+	int shared_memory_per_block;
+};
+
+struct gpu_device *gpu_device_read(isl_ctx *ctx, const char *filename);
+void gpu_device_free(struct gpu_device *device);
+
+double gpu_device_occupancy(struct gpu_device *device, int threads,
+	long shared_memory);
+
+#endif
@@ -705,6 +705,7 @@ struct gpu_array_ref_group *gpu_array_ref_group_free(
 	gpu_array_tile_free(group->shared_tile);
 	gpu_array_tile_free(group->private_tile);
 	isl_map_free(group->access);
+	isl_set_free(group->thread_x_delta);
 	if (group->n_ref > 1)
 		free(group->refs);
 	free(group);
@@ -1265,6 +1266,185 @@ static int join_all_groups(int n, struct gpu_array_ref_group **groups)
 	return n;
 }
 
+/* Return the difference between the array elements accessed by "access"
+ * for consecutive values of the innermost thread identifier
+ * (and fixed values of all other schedule dimensions) as a set
+ * containing a single element, if this difference is fixed.
+ * Otherwise, return an empty set.
+ */
+static __isl_give isl_set *thread_x_delta(struct gpu_group_data *data,
+	__isl_keep isl_map *access)
+{
+	int i, n;
+	isl_space *space;
+	isl_union_map *umap;
+	isl_map *map, *next_thread_x;
+	isl_set *delta;
+	isl_bool empty;
+
+	umap = isl_union_map_from_map(isl_map_copy(access));
+	umap = isl_union_map_apply_domain(umap,
+				isl_union_map_copy(data->full_sched));
+	map = isl_map_from_union_map(umap);
+
+	space = isl_space_domain(isl_map_get_space(map));
+	next_thread_x = next(space, data->thread_depth + data->n_thread - 1);
+	next_thread_x = isl_map_apply_domain(next_thread_x, isl_map_copy(map));
+	next_thread_x = isl_map_apply_range(next_thread_x, map);
+	delta = isl_map_deltas(next_thread_x);
+	delta = isl_set_detect_equalities(delta);
+
+	empty = isl_set_is_empty(delta);
+	if (empty < 0 || empty)
+		return delta;
+
+	n = isl_set_dim(delta, isl_dim_set);
+	for (i = 0; i < n; ++i) {
+		isl_val *v;
+		isl_bool fixed;
+
+		v = isl_set_plain_get_val_if_fixed(delta, isl_dim_set, i);
+		fixed = v ? !isl_val_is_nan(v) : isl_bool_error;
+		isl_val_free(v);
+		if (fixed < 0)
+			return isl_set_free(delta);
+		if (!fixed) {
+			space = isl_set_get_space(delta);
+			isl_set_free(delta);
+			return isl_set_empty(space);
+		}
+	}
+
+	return delta;
+}
+
+/* Compute group->thread_x_delta for the group "group" with
+ * a shared memory tile, for use in the detection of bank conflicts.
+ * Each reference in the group is considered separately
+ * since the threads in a warp execute the same reference together.
+ * Since the differences are fixed, the parameters can be projected out,
+ * leaving a finite set of points.
+ */
+static isl_stat compute_thread_x_delta(struct gpu_array_ref_group *group,
+	struct gpu_group_data *data)
+{
+	int i, n;
+
+	if (!group->shared_tile || data->n_thread == 0)
+		return isl_stat_ok;
+
+	group->thread_x_delta =
+		isl_set_empty(isl_space_copy(group->array->space));
+	for (i = 0; i < group->n_ref; ++i) {
+		isl_set *delta;
+
+		delta = thread_x_delta(data, group->refs[i]->access);
+		group->thread_x_delta = isl_set_union(group->thread_x_delta,
+							delta);
+	}
+	n = isl_set_dim(group->thread_x_delta, isl_dim_param);
+	group->thread_x_delta = isl_set_project_out(group->thread_x_delta,
+						isl_dim_param, 0, n);
+	group->thread_x_delta = isl_set_coalesce(group->thread_x_delta);
+
+	return group->thread_x_delta ? isl_stat_ok : isl_stat_error;
+}
+
+/* Return the extents of the schedule dimensions of "sched"
+ * (a map from schedule points to array elements) after the first "depth",
+ * for fixed values of these first "depth" dimensions.
+ * Return NULL if these extents cannot be determined.
+ */
+static __isl_give isl_multi_val *inner_extents(__isl_keep isl_map *sched,
+	int depth)
+{
+	isl_map *map;
+	isl_fixed_box *box;
+	isl_multi_val *size = NULL;
+	isl_bool valid;
+
+	map = isl_map_from_range(isl_map_domain(isl_map_copy(sched)));
+	map = isl_map_move_dims(map, isl_dim_in, 0, isl_dim_out, 0, depth);
+	box = isl_map_get_range_simple_fixed_box_hull(map);
+	isl_map_free(map);
+	valid = isl_fixed_box_is_valid(box);
+	if (valid >= 0 && valid)
+		size = isl_fixed_box_get_size(box);
+	isl_fixed_box_free(box);
+
+	return size;
+}
+
+/* Estimate the number of times the array element accessed by "access"
+ * at a given point of the schedule is accessed again by "access"
+ * inside the same iteration of the first "depth" schedule dimensions.
+ * That is, compute the product of the extents of the inner schedule
+ * dimensions that do not affect the accessed element.
+ * If these extents cannot be determined, then return 1.
+ */
+static long access_reuse(struct gpu_group_data *data,
+	__isl_keep isl_map *access, int depth)
+{
+	int i, n;
+	long reuse = 1;
+	isl_space *space;
+	isl_union_map *umap;
+	isl_map *map;
+	isl_multi_val *size;
+
+	umap = isl_union_map_from_map(isl_map_copy(access));
+	umap = isl_union_map_apply_domain(umap,
+				isl_union_map_copy(data->full_sched));
+	map = isl_map_from_union_map(umap);
+	n = isl_map_dim(map, isl_dim_in);
+
+	size = inner_extents(map, depth);
+	for (i = depth; size && i < n; ++i) {
+		isl_map *same, *next_i;
+		isl_bool invariant;
+		isl_val *v;
+
+		space = isl_space_domain(isl_map_get_space(map));
+		next_i = next(space, i);
+		next_i = isl_map_apply_domain(next_i, isl_map_copy(map));
+		next_i = isl_map_apply_range(next_i, isl_map_copy(map));
+		space = isl_space_range(isl_map_get_space(map));
+		same = isl_map_identity(isl_space_map_from_set(space));
+		invariant = isl_map_is_subset(next_i, same);
+		isl_map_free(next_i);
+		isl_map_free(same);
+		if (invariant <= 0)
+			continue;
+		v = isl_multi_val_get_val(size, i - depth);
+		reuse *= isl_val_get_num_si(v);
+		isl_val_free(v);
+	}
+	isl_multi_val_free(size);
+	isl_map_free(map);
+
+	return reuse;
+}
+
+/* Compute group->shared_reuse for the group "group" with
+ * a shared memory tile, for use in the selection of the groups
+ * that are effectively mapped to shared memory.
+ * The reuse of each reference is estimated within
+ * a single iteration of the schedule dimensions that affect the tile.
+ */
+static void compute_shared_reuse(struct gpu_array_ref_group *group,
+	struct gpu_group_data *data)
+{
+	int i;
+
+	if (!group->shared_tile)
+		return;
+
+	group->shared_reuse = 0;
+	for (i = 0; i < group->n_ref; ++i)
+		group->shared_reuse += access_reuse(data,
+			group->refs[i]->access, group->shared_tile->depth);
+}
+
 /* Group array references that should be considered together when
  * deciding whether to access them from private, shared or global memory.
  * Return -1 on error.
@@ -1279,6 +1459,9 @@ static int join_all_groups(int n, struct gpu_array_ref_group **groups)
  * Furthermore, if two groups admit a shared memory tile and if the
  * combination of the two also admits a shared memory tile, we merge
  * the two groups.
+ * Finally, we collect the information needed to detect bank conflicts
+ * on the resulting shared memory tiles and to decide which of them
+ * to keep if they do not all fit in shared memory.
  *
  * If the array contains structures, then we compute a single
  * reference group without trying to find any tiles
@@ -1318,6 +1501,13 @@ static int group_array_references(struct ppcg_kernel *kernel,
 	n = group_common_shared_memory_tile(kernel, local->array,
 					    n, groups, data);
 
+	for (i = 0; i < n; ++i) {
+		if (compute_thread_x_delta(groups[i], data) < 0)
+			n = -1;
+		else
+			compute_shared_reuse(groups[i], data);
+	}
+
 	set_array_groups(local, n, groups);
 
 	if (n >= 0)
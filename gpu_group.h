@@ -35,6 +35,18 @@ struct gpu_array_ref_group {
 	int slice;
 	int min_depth;
 
+	/* The differences between the array elements accessed by
+	 * threads with consecutive values of the innermost thread identifier,
+	 * for those accesses in the group where this difference is fixed.
+	 * Only computed for groups with a shared memory tile.
+	 */
+	isl_set *thread_x_delta;
+	/* An estimate of the number of accesses to each element
+	 * of the shared memory tile, summed over all references in the group.
+	 * Only computed for groups with a shared memory tile.
+	 */
+	long shared_reuse;
+
 	/* The shared memory tile, NULL if none. */
 	struct gpu_array_tile *shared_tile;
 
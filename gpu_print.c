@@ -62,6 +62,275 @@ __isl_give isl_printer *gpu_array_info_print_size(__isl_take isl_printer *prn,
 	return prn;
 }
 
+/* Print argument "pos" of the access AST expression "expr"
+ * in parentheses.
+ */
+static __isl_give isl_printer *print_expr_arg(__isl_take isl_printer *p,
+	__isl_keep isl_ast_expr *expr, int pos)
+{
+	isl_ast_expr *arg;
+
+	arg = isl_ast_expr_get_op_arg(expr, 1 + pos);
+	p = isl_printer_print_str(p, "(");
+	p = isl_printer_print_ast_expr(p, arg);
+	p = isl_printer_print_str(p, ")");
+	isl_ast_expr_free(arg);
+
+	return p;
+}
+
+/* Print the name of the iterator over dimension "pos"
+ * of a box that is copied row by row.
+ */
+static __isl_give isl_printer *print_box_iterator(__isl_take isl_printer *p,
+	int pos)
+{
+	p = isl_printer_print_str(p, "ppcg_c");
+	p = isl_printer_print_int(p, pos);
+
+	return p;
+}
+
+/* Print definitions of the macros used in the expressions
+ * for the offset and size of "box".
+ */
+__isl_give isl_printer *gpu_array_box_print_macros(__isl_take isl_printer *p,
+	struct gpu_array_box *box)
+{
+	p = ppcg_ast_expr_print_macros(box->offset_expr, p);
+	p = ppcg_ast_expr_print_macros(box->size_expr, p);
+
+	return p;
+}
+
+/* Print a condition that is satisfied if "box" of "array"
+ * is not empty.
+ */
+__isl_give isl_printer *gpu_array_box_print_non_empty(
+	__isl_take isl_printer *p, struct gpu_array_info *array,
+	struct gpu_array_box *box)
+{
+	int i;
+
+	for (i = 0; i < array->n_index; ++i) {
+		if (i)
+			p = isl_printer_print_str(p, " && ");
+		p = print_expr_arg(p, box->size_expr, i);
+		p = isl_printer_print_str(p, " > 0");
+	}
+
+	return p;
+}
+
+/* Print "for" loops iterating over all but the last two dimensions
+ * of "box" of "array", such that the box can be copied row by row.
+ * The iterators run from zero to the size of the box in the corresponding
+ * dimension.  The body of the loops is indented and the caller
+ * is expected to call gpu_array_box_print_end_loops afterwards.
+ */
+__isl_give isl_printer *gpu_array_box_print_loops(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box)
+{
+	int i;
+
+	for (i = 0; i + 2 < array->n_index; ++i) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "for (int ");
+		p = print_box_iterator(p, i);
+		p = isl_printer_print_str(p, " = 0; ");
+		p = print_box_iterator(p, i);
+		p = isl_printer_print_str(p, " < ");
+		p = print_expr_arg(p, box->size_expr, i);
+		p = isl_printer_print_str(p, "; ++");
+		p = print_box_iterator(p, i);
+		p = isl_printer_print_str(p, ")");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, 2);
+	}
+
+	return p;
+}
+
+/* Undo the indentation of gpu_array_box_print_loops.
+ */
+__isl_give isl_printer *gpu_array_box_print_end_loops(
+	__isl_take isl_printer *p, struct gpu_array_info *array)
+{
+	if (array->n_index > 2)
+		p = isl_printer_indent(p, -2 * (array->n_index - 2));
+
+	return p;
+}
+
+/* Print the linear index of the first element of the current row
+ * of "box" of "array" in the first "n" dimensions of the array.
+ * The index in dimension "i" is the offset of the box in that
+ * dimension, incremented by the iterator printed by gpu_array_box_print_loops
+ * if there is such an iterator.
+ */
+static __isl_give isl_printer *print_box_linear_index(
+	__isl_take isl_printer *p, struct gpu_array_info *array,
+	struct gpu_array_box *box, int n)
+{
+	int i;
+
+	for (i = 1; i < n; ++i)
+		p = isl_printer_print_str(p, "(");
+	for (i = 0; i < n; ++i) {
+		if (i) {
+			p = isl_printer_print_str(p, " * ");
+			p = print_expr_arg(p, array->bound_expr, i);
+			p = isl_printer_print_str(p, " + ");
+		}
+		if (i + 2 < array->n_index)
+			p = isl_printer_print_str(p, "(");
+		p = print_expr_arg(p, box->offset_expr, i);
+		if (i + 2 < array->n_index) {
+			p = isl_printer_print_str(p, " + ");
+			p = print_box_iterator(p, i);
+			p = isl_printer_print_str(p, ")");
+		}
+		if (i)
+			p = isl_printer_print_str(p, ")");
+	}
+
+	return p;
+}
+
+/* Print the linear index of the first row of the current slice of "box"
+ * of "array", i.e., the linear index in all but the last dimension
+ * of the array.
+ */
+__isl_give isl_printer *gpu_array_box_print_row(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box)
+{
+	return print_box_linear_index(p, array, box, array->n_index - 1);
+}
+
+/* Print the offset in bytes of the first element of the current row
+ * of "box" of "array" with respect to the start of the array.
+ */
+__isl_give isl_printer *gpu_array_box_print_offset(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box)
+{
+	p = isl_printer_print_str(p, "(");
+	p = print_box_linear_index(p, array, box, array->n_index);
+	p = isl_printer_print_str(p, ") * sizeof(");
+	p = isl_printer_print_str(p, array->type);
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
+
+/* Print the offset in bytes of the first element of "box" of "array"
+ * within a row of the array.
+ */
+__isl_give isl_printer *gpu_array_box_print_column(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box)
+{
+	p = print_expr_arg(p, box->offset_expr, array->n_index - 1);
+	p = isl_printer_print_str(p, " * sizeof(");
+	p = isl_printer_print_str(p, array->type);
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
+
+/* Print the size in bytes of a row of "box" of "array".
+ */
+__isl_give isl_printer *gpu_array_box_print_width(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box)
+{
+	p = print_expr_arg(p, box->size_expr, array->n_index - 1);
+	p = isl_printer_print_str(p, " * sizeof(");
+	p = isl_printer_print_str(p, array->type);
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
+
+/* Print the number of rows in a slice of "box" of "array",
+ * i.e., the size of the box in the next to last dimension.
+ * The array is assumed to have at least two dimensions.
+ */
+__isl_give isl_printer *gpu_array_box_print_height(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box)
+{
+	return print_expr_arg(p, box->size_expr, array->n_index - 2);
+}
+
+/* Print the size in bytes of "box" of "array".
+ */
+static __isl_give isl_printer *gpu_array_box_print_size(
+	__isl_take isl_printer *p, struct gpu_array_info *array,
+	struct gpu_array_box *box)
+{
+	int i;
+
+	for (i = 0; i < array->n_index; ++i) {
+		p = print_expr_arg(p, box->size_expr, i);
+		p = isl_printer_print_str(p, " * ");
+	}
+	p = isl_printer_print_str(p, "sizeof(");
+	p = isl_printer_print_str(p, array->type);
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
+
+/* Print a call that adds the number of bytes of "array" that are copied
+ * from the host to the device (to_host = 0) or back from the device
+ * to the host (to_host = 1) to the instrumented region of the copy
+ * in the code generated for the --instrument option.
+ * If only a box of the array is copied, then only the bytes
+ * in this (non-empty) box are counted.
+ * The macros used in the box have already been printed along with
+ * the copy itself.
+ */
+__isl_give isl_printer *gpu_array_print_instrument_bytes(
+	__isl_take isl_printer *p, struct gpu_array_info *array, int to_host)
+{
+	struct gpu_array_box *box;
+
+	box = to_host ? &array->copy_out : &array->copy_in;
+	if (box->offset) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "if (");
+		p = gpu_array_box_print_non_empty(p, array, box);
+		p = isl_printer_print_str(p, ")");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, 2);
+	}
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "ppcg_instrument_add_bytes(\"");
+	p = isl_printer_print_str(p, to_host ? "from_device_" : "to_device_");
+	p = isl_printer_print_str(p, array->name);
+	p = isl_printer_print_str(p, "\", ");
+	if (box->offset)
+		p = gpu_array_box_print_size(p, array, box);
+	else
+		p = gpu_array_info_print_size(p, array);
+	p = isl_printer_print_str(p, ");");
+	p = isl_printer_end_line(p);
+	if (box->offset)
+		p = isl_printer_indent(p, -2);
+
+	return p;
+}
+
+/* Print the size in bytes of a row of "array".
+ */
+__isl_give isl_printer *gpu_array_info_print_pitch(__isl_take isl_printer *p,
+	struct gpu_array_info *array)
+{
+	p = print_expr_arg(p, array->bound_expr, array->n_index - 1);
+	p = isl_printer_print_str(p, " * sizeof(");
+	p = isl_printer_print_str(p, array->type);
+	p = isl_printer_print_str(p, ")");
+
+	return p;
+}
+
 /* Print the declaration of a non-linearized array argument.
  */
 static __isl_give isl_printer *print_non_linearized_declaration_argument(
@@ -183,6 +452,42 @@ __isl_give isl_printer *ppcg_kernel_print_copy(__isl_take isl_printer *p,
 	return p;
 }
 
+/* Print a vector copy statement, i.e., a read copy statement
+ * that copies stmt->u.c.vector consecutive elements at once.
+ * The statement is printed as
+ *
+ *	*(local_space typeN *) &local = *(global_space typeN *) &global;
+ *
+ * with N the number of elements in the vector and "local_space" and
+ * "global_space" the (possibly empty) address space qualifiers
+ * of the shared and global memory of the target.
+ */
+__isl_give isl_printer *ppcg_kernel_print_vector_copy(
+	__isl_take isl_printer *p, struct ppcg_kernel_stmt *stmt,
+	const char *local_space, const char *global_space)
+{
+	const char *type = stmt->u.c.array->type;
+	int n = stmt->u.c.vector;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "*(");
+	p = isl_printer_print_str(p, local_space);
+	p = isl_printer_print_str(p, type);
+	p = isl_printer_print_int(p, n);
+	p = isl_printer_print_str(p, " *) &");
+	p = stmt_print_local_index(p, stmt);
+	p = isl_printer_print_str(p, " = *(");
+	p = isl_printer_print_str(p, global_space);
+	p = isl_printer_print_str(p, type);
+	p = isl_printer_print_int(p, n);
+	p = isl_printer_print_str(p, " *) &");
+	p = stmt_print_global_index(p, stmt);
+	p = isl_printer_print_str(p, ";");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
 __isl_give isl_printer *ppcg_kernel_print_domain(__isl_take isl_printer *p,
 	struct ppcg_kernel_stmt *stmt)
 {
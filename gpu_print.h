@@ -14,14 +14,41 @@ __isl_give isl_printer *gpu_print_macros(__isl_take isl_printer *p,
 
 __isl_give isl_printer *gpu_array_info_print_size(__isl_take isl_printer *prn,
 	struct gpu_array_info *array);
+__isl_give isl_printer *gpu_array_info_print_pitch(__isl_take isl_printer *p,
+	struct gpu_array_info *array);
 __isl_give isl_printer *gpu_array_info_print_declaration_argument(
 	__isl_take isl_printer *p, struct gpu_array_info *array,
 	const char *memory_space);
 __isl_give isl_printer *gpu_array_info_print_call_argument(
 	__isl_take isl_printer *p, struct gpu_array_info *array);
 
+__isl_give isl_printer *gpu_array_box_print_macros(__isl_take isl_printer *p,
+	struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_non_empty(
+	__isl_take isl_printer *p, struct gpu_array_info *array,
+	struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_loops(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_end_loops(
+	__isl_take isl_printer *p, struct gpu_array_info *array);
+__isl_give isl_printer *gpu_array_box_print_row(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_offset(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_column(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_width(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_box_print_height(__isl_take isl_printer *p,
+	struct gpu_array_info *array, struct gpu_array_box *box);
+__isl_give isl_printer *gpu_array_print_instrument_bytes(
+	__isl_take isl_printer *p, struct gpu_array_info *array, int to_host);
+
 __isl_give isl_printer *ppcg_kernel_print_copy(__isl_take isl_printer *p,
 	struct ppcg_kernel_stmt *stmt);
+__isl_give isl_printer *ppcg_kernel_print_vector_copy(
+	__isl_take isl_printer *p, struct ppcg_kernel_stmt *stmt,
+	const char *local_space, const char *global_space);
 __isl_give isl_printer *ppcg_kernel_print_domain(__isl_take isl_printer *p,
 	struct ppcg_kernel_stmt *stmt);
 
@@ -638,3 +638,34 @@ __isl_give isl_schedule_node *gpu_tree_move_right_to_sync(
 
 	return node;
 }
+
+/* Move right in the sequence on top of "node" to the element
+ * that contains the core computation of "kernel".
+ * If "node" is not part of a sequence or if it contains
+ * the core computation itself, then return "node" itself.
+ *
+ * This allows a caller that has positioned itself at
+ * a synchronization node preceding the core computation to
+ * insert statements in between this synchronization and
+ * the core computation.
+ */
+__isl_give isl_schedule_node *gpu_tree_move_right_to_core(
+	__isl_take isl_schedule_node *node, struct ppcg_kernel *kernel)
+{
+	int is_core;
+
+	if (!node)
+		return NULL;
+	if (!isl_schedule_node_has_parent(node))
+		return node;
+	node = isl_schedule_node_parent(node);
+	if (isl_schedule_node_get_type(node) != isl_schedule_node_filter)
+		return isl_schedule_node_child(node, 0);
+	while ((is_core = node_is_core(node, kernel->core)) == 0)
+		node = isl_schedule_node_next_sibling(node);
+	if (is_core < 0)
+		node = isl_schedule_node_free(node);
+	node = isl_schedule_node_child(node, 0);
+
+	return node;
+}
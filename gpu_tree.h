@@ -29,5 +29,7 @@ __isl_give isl_schedule_node *gpu_tree_move_left_to_sync(
 	__isl_take isl_schedule_node *node, struct ppcg_kernel *kernel);
 __isl_give isl_schedule_node *gpu_tree_move_right_to_sync(
 	__isl_take isl_schedule_node *node, struct ppcg_kernel *kernel);
+__isl_give isl_schedule_node *gpu_tree_move_right_to_core(
+	__isl_take isl_schedule_node *node, struct ppcg_kernel *kernel);
 
 #endif
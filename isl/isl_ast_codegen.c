@@ -5453,6 +5453,13 @@ static __isl_give isl_ast_graft_list *build_ast_from_extension(
  * relation, then keep the original representation since the intersection
  * may have unnecessarily broken up the relation into a greater number
  * of disjuncts.
+ * The intersection removes any parts that become empty, so if
+ * the result consists of fewer parts than the original, then
+ * (assuming the parts of the original are non-empty) it cannot be
+ * equal to the original.  This is the common case for the children
+ * of a sequence or set node with many children, e.g., one for each
+ * kernel in a program, and it avoids comparing each of the parts
+ * that are kept in the intersection to the original.
  */
 static __isl_give isl_ast_graft_list *build_ast_from_filter(
 	__isl_take isl_ast_build *build, __isl_take isl_schedule_node *node,
@@ -5483,7 +5490,14 @@ static __isl_give isl_ast_graft_list *build_ast_from_filter(
 			"filter node is not allowed to introduce "
 			"new parameters", goto error);
 
-	unchanged = isl_union_map_is_subset(orig, executed);
+	n1 = isl_union_map_n_map(orig);
+	n2 = isl_union_map_n_map(executed);
+	if (n1 < 0 || n2 < 0)
+		goto error;
+	if (n2 < n1)
+		unchanged = isl_bool_false;
+	else
+		unchanged = isl_union_map_is_subset(orig, executed);
 	empty = isl_union_map_is_empty(executed);
 	if (unchanged < 0 || empty < 0)
 		goto error;
@@ -21,7 +21,7 @@ uint32_t isl_hash_string(uint32_t hash, const char *s)
 
 uint32_t isl_hash_mem(uint32_t hash, const void *p, size_t len)
 {
-	int i;
+	size_t i;
 	const char *s = p;
 	for (i = 0; i < len; ++i)
 		isl_hash_byte(hash, s[i]);
@@ -61,29 +61,89 @@ int isl_hash_table_init(struct isl_ctx *ctx, struct isl_hash_table *table,
 	return 0;
 }
 
-/* Dummy comparison function that always returns false.
+/* Return the position in "table" where an entry with hash value "hash"
+ * would ideally be stored.
  */
-static int no(const void *entry, const void *val)
+static uint32_t home_pos(struct isl_hash_table *table, uint32_t hash)
 {
-	return 0;
+	return (isl_hash_bits(hash, table->bits));
+}
+
+/* Return the distance between position "h" in "table" and
+ * the ideal position of the entry stored at "h".
+ */
+static uint32_t probe_distance(struct isl_hash_table *table, uint32_t h)
+{
+	uint32_t mask = ((uint32_t) 1 << table->bits) - 1;
+
+	return (h - home_pos(table, table->entries[h].hash)) & mask;
+}
+
+/* Return the position in "table" where an entry with hash value "hash"
+ * that does not appear in "table" should be inserted.
+ *
+ * The entries in "table" are kept in "Robin Hood" order.
+ * That is, along a sequence of occupied positions, the distance
+ * of each entry to its ideal position never decreases by more than one
+ * from one position to the next.  This means that the new entry
+ * should be placed at the first position that is either empty or
+ * that contains an entry that is closer to its ideal position
+ * than the new entry would be.
+ */
+static uint32_t insert_pos(struct isl_hash_table *table, uint32_t hash)
+{
+	uint32_t h, d, mask;
+
+	mask = ((uint32_t) 1 << table->bits) - 1;
+	h = home_pos(table, hash);
+	for (d = 0; table->entries[h].data; h = (h + 1) & mask, ++d)
+		if (probe_distance(table, h) < d)
+			break;
+
+	return h;
+}
+
+/* Make room for a new entry at position "h" of "table" and return
+ * a pointer to this entry.
+ *
+ * The entries starting at "h" up to the first empty position
+ * are moved up by one position.  The caller is responsible
+ * for ensuring that there is such an empty position.
+ */
+static struct isl_hash_table_entry *make_room(struct isl_hash_table *table,
+	uint32_t h)
+{
+	uint32_t e, mask;
+
+	mask = ((uint32_t) 1 << table->bits) - 1;
+	for (e = h; table->entries[e].data; e = (e + 1) & mask)
+		;
+	while (e != h) {
+		uint32_t prev = (e - 1) & mask;
+
+		table->entries[e] = table->entries[prev];
+		e = prev;
+	}
+	table->entries[h].data = NULL;
+
+	return &table->entries[h];
 }
 
 /* Extend "table" to twice its size.
  * Return 0 on success and -1 on error.
  *
- * We reuse isl_hash_table_find to create entries in the extended table.
  * Since all entries in the original table are assumed to be different,
- * there is no need to compare them against each other.
+ * there is no need to compare them against each other and
+ * they can be inserted into the extended table directly.
  */
 static int grow_table(struct isl_ctx *ctx, struct isl_hash_table *table)
 {
-	int n;
 	size_t old_size, size;
 	struct isl_hash_table_entry *entries;
 	uint32_t h;
 
 	entries = table->entries;
-	old_size = 1 << table->bits;
+	old_size = (size_t) 1 << table->bits;
 	size = 2 * old_size;
 	table->entries = isl_calloc_array(ctx, struct isl_hash_table_entry,
 					  size);
@@ -92,8 +152,6 @@ static int grow_table(struct isl_ctx *ctx, struct isl_hash_table *table)
 		return -1;
 	}
 
-	n = table->n;
-	table->n = 0;
 	table->bits++;
 
 	for (h = 0; h < old_size; ++h) {
@@ -102,16 +160,7 @@ static int grow_table(struct isl_ctx *ctx, struct isl_hash_table *table)
 		if (!entries[h].data)
 			continue;
 
-		entry = isl_hash_table_find(ctx, table, entries[h].hash,
-					    &no, NULL, 1);
-		if (!entry) {
-			table->bits--;
-			free(table->entries);
-			table->entries = entries;
-			table->n = n;
-			return -1;
-		}
-
+		entry = make_room(table, insert_pos(table, entries[h].hash));
 		*entry = entries[h];
 	}
 
@@ -155,6 +204,20 @@ void isl_hash_table_free(struct isl_ctx *ctx, struct isl_hash_table *table)
 static struct isl_hash_table_entry none = { 0, NULL };
 struct isl_hash_table_entry *isl_hash_table_entry_none = &none;
 
+/* Look for an entry in "table" with hash value "key_hash" for which
+ * "eq" returns true when called on the data of the entry and "val".
+ * If there is no such entry and "reserve" is set, then create
+ * an entry with hash value "key_hash" and return it.
+ * The data of this entry is set to NULL and is expected to be
+ * filled in by the caller.  If the caller fails to do so,
+ * then the entry needs to be removed using isl_hash_table_remove.
+ *
+ * The entries are kept in "Robin Hood" order (see insert_pos), meaning
+ * that the search can be stopped as soon as an entry is found
+ * that is closer to its ideal position than the sought entry would be.
+ * Since the hash values are stored in the entries,
+ * "eq" only needs to be called on entries with the same hash value.
+ */
 struct isl_hash_table_entry *isl_hash_table_find(struct isl_ctx *ctx,
 				struct isl_hash_table *table,
 				uint32_t key_hash,
@@ -162,14 +225,19 @@ struct isl_hash_table_entry *isl_hash_table_find(struct isl_ctx *ctx,
 				const void *val, int reserve)
 {
 	size_t size;
-	uint32_t h, key_bits;
-
-	key_bits = isl_hash_bits(key_hash, table->bits);
-	size = 1 << table->bits;
-	for (h = key_bits; table->entries[h].data; h = (h+1) % size)
-		if (table->entries[h].hash == key_hash &&
-		    eq(table->entries[h].data, val))
-			return &table->entries[h];
+	uint32_t h, d, mask;
+	struct isl_hash_table_entry *entry;
+
+	size = (size_t) 1 << table->bits;
+	mask = size - 1;
+	h = home_pos(table, key_hash);
+	for (d = 0; table->entries[h].data; h = (h + 1) & mask, ++d) {
+		entry = &table->entries[h];
+		if (entry->hash == key_hash && eq(entry->data, val))
+			return entry;
+		if (probe_distance(table, h) < d)
+			break;
+	}
 
 	if (!reserve)
 		return NULL;
@@ -177,13 +245,14 @@ struct isl_hash_table_entry *isl_hash_table_find(struct isl_ctx *ctx,
 	if (4 * table->n >= 3 * size) {
 		if (grow_table(ctx, table) < 0)
 			return NULL;
-		return isl_hash_table_find(ctx, table, key_hash, eq, val, 1);
+		h = insert_pos(table, key_hash);
 	}
 
 	table->n++;
-	table->entries[h].hash = key_hash;
+	entry = make_room(table, h);
+	entry->hash = key_hash;
 
-	return &table->entries[h];
+	return entry;
 }
 
 isl_stat isl_hash_table_foreach(isl_ctx *ctx, struct isl_hash_table *table,
@@ -204,32 +273,39 @@ isl_stat isl_hash_table_foreach(isl_ctx *ctx, struct isl_hash_table *table,
 	return isl_stat_ok;
 }
 
+/* Remove "entry" from "table".
+ *
+ * The subsequent entries that are not stored at their ideal positions
+ * are moved down by one position to fill the hole, such that
+ * the "Robin Hood" order is preserved.
+ * Note that this means that "entry" may refer to a different entry
+ * after this function returns.
+ */
 void isl_hash_table_remove(struct isl_ctx *ctx,
 				struct isl_hash_table *table,
 				struct isl_hash_table_entry *entry)
 {
-	int h, h2;
+	int h;
+	uint32_t next, mask;
 	size_t size;
 
 	if (!table || !entry)
 		return;
 
-	size = 1 << table->bits;
+	size = (size_t) 1 << table->bits;
+	mask = size - 1;
 	h = entry - table->entries;
 	isl_assert(ctx, h >= 0 && h < size, return);
 
-	for (h2 = h+1; table->entries[h2 % size].data; h2++) {
-		uint32_t bits = isl_hash_bits(table->entries[h2 % size].hash,
-						table->bits);
-		uint32_t offset = (size + bits - (h+1)) % size;
-		if (offset <= h2 - (h+1))
-			continue;
-		*entry = table->entries[h2 % size];
-		h = h2;
-		entry = &table->entries[h % size];
+	for (next = (h + 1) & mask; table->entries[next].data;
+	     next = (next + 1) & mask) {
+		if (probe_distance(table, next) == 0)
+			break;
+		table->entries[h] = table->entries[next];
+		h = next;
 	}
 
-	entry->hash = 0;
-	entry->data = NULL;
+	table->entries[h].hash = 0;
+	table->entries[h].data = NULL;
 	table->n--;
 }
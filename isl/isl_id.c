@@ -117,8 +117,10 @@ __isl_give isl_id *isl_id_alloc(isl_ctx *ctx, const char *name, void *user)
 	if (entry->data)
 		return isl_id_copy(entry->data);
 	entry->data = id_alloc(ctx, name, user);
-	if (!entry->data)
-		ctx->id_table.n--;
+	if (!entry->data) {
+		isl_hash_table_remove(ctx, &ctx->id_table, entry);
+		return NULL;
+	}
 	return entry->data;
 }
 
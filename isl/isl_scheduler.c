@@ -315,6 +315,15 @@ static int is_multi_edge_type(struct isl_sched_edge *edge)
  * if compression is involved then the key for these maps
  * is the original, uncompressed dependence relation, while
  * the value is the dual of the compressed dependence relation.
+ * These caches are only allocated for the original dependence graph and
+ * they are shared by all graphs derived from it through splitting
+ * (see intra_coefficients and inter_coefficients), such that
+ * the dual of a dependence relation that is carried over unmodified
+ * into a subgraph does not need to be recomputed.
+ * coef_hits and coef_misses count the number of hits and misses
+ * in these caches.  They are only updated in the original
+ * dependence graph and they are printed when that graph is freed
+ * if the print_stats option is set.
  *
  * n is the number of nodes
  * node is the list of nodes
@@ -334,7 +343,9 @@ static int is_multi_edge_type(struct isl_sched_edge *edge)
  * n_edge is the number of edges
  * edge is the list of edges
  * max_edge contains the maximal number of edges of each type;
- *	in particular, it contains the number of edges in the inital graph.
+ *	in particular, it contains the number of edges of each type
+ *	in the inital graph or, for a graph obtained through splitting,
+ *	the number of edges of each type that were selected for the subgraph.
  * edge_table contains pointers into the edge array, hashed on the source
  *	and sink spaces; there is one such table for each type;
  *	a given edge may be referenced from more than one table
@@ -362,6 +373,8 @@ struct isl_sched_graph {
 	isl_map_to_basic_set *intra_hmap;
 	isl_map_to_basic_set *intra_hmap_param;
 	isl_map_to_basic_set *inter_hmap;
+	long coef_hits;
+	long coef_misses;
 
 	struct isl_sched_node *node;
 	int n;
@@ -676,10 +689,6 @@ static isl_stat graph_alloc(isl_ctx *ctx, struct isl_sched_graph *graph,
 	graph->edge = isl_calloc_array(ctx,
 					struct isl_sched_edge, graph->n_edge);
 
-	graph->intra_hmap = isl_map_to_basic_set_alloc(ctx, 2 * n_edge);
-	graph->intra_hmap_param = isl_map_to_basic_set_alloc(ctx, 2 * n_edge);
-	graph->inter_hmap = isl_map_to_basic_set_alloc(ctx, 2 * n_edge);
-
 	if (!graph->node || !graph->region || (graph->n_edge && !graph->edge) ||
 	    !graph->sorted)
 		return isl_stat_error;
@@ -717,6 +726,12 @@ static void graph_free(isl_ctx *ctx, struct isl_sched_graph *graph)
 {
 	int i;
 
+	if (graph->root == graph && graph->intra_hmap &&
+	    ctx->opt->print_stats)
+		fprintf(stderr,
+			"scheduler coefficient cache: %ld hits, %ld misses\n",
+			graph->coef_hits, graph->coef_misses);
+
 	isl_map_to_basic_set_free(graph->intra_hmap);
 	isl_map_to_basic_set_free(graph->intra_hmap_param);
 	isl_map_to_basic_set_free(graph->inter_hmap);
@@ -1421,6 +1436,12 @@ static isl_stat graph_init(struct isl_sched_graph *graph,
 	n = isl_schedule_constraints_n_map(sc);
 	if (n < 0 || graph_alloc(ctx, graph, graph->n, n) < 0)
 		return isl_stat_error;
+	graph->intra_hmap = isl_map_to_basic_set_alloc(ctx, 2 * n);
+	graph->intra_hmap_param = isl_map_to_basic_set_alloc(ctx, 2 * n);
+	graph->inter_hmap = isl_map_to_basic_set_alloc(ctx, 2 * n);
+	if (!graph->intra_hmap || !graph->intra_hmap_param ||
+	    !graph->inter_hmap)
+		return isl_stat_error;
 
 	if (compute_max_row(graph, sc) < 0)
 		return isl_stat_error;
@@ -1624,6 +1645,26 @@ static __isl_give isl_set *drop_coalescing_constraints(
 	return delta;
 }
 
+/* Look up "map" in the cache "hmap" of a dual of dependence relations,
+ * keeping track of the number of hits and misses in the root of "graph".
+ */
+static isl_maybe_isl_basic_set coef_cache_try_get(
+	struct isl_sched_graph *graph,
+	__isl_keep isl_map_to_basic_set *hmap, __isl_keep isl_map *map)
+{
+	isl_maybe_isl_basic_set m;
+
+	m = isl_map_to_basic_set_try_get(hmap, map);
+	if (m.valid < 0 || !map)
+		return m;
+	if (m.valid)
+		graph->root->coef_hits++;
+	else
+		graph->root->coef_misses++;
+
+	return m;
+}
+
 /* Given a dependence relation R from "node" to itself,
  * construct the set of coefficients of valid constraints for elements
  * in that dependence relation.
@@ -1664,7 +1705,7 @@ static __isl_give isl_basic_set *intra_coefficients(
 	isl_map *key;
 	isl_basic_set *coef;
 	isl_maybe_isl_basic_set m;
-	isl_map_to_basic_set **hmap = &graph->intra_hmap;
+	isl_map_to_basic_set **hmap = &graph->root->intra_hmap;
 	int treat;
 
 	if (!map)
@@ -1673,8 +1714,8 @@ static __isl_give isl_basic_set *intra_coefficients(
 	ctx = isl_map_get_ctx(map);
 	treat = !need_param && isl_options_get_schedule_treat_coalescing(ctx);
 	if (!treat)
-		hmap = &graph->intra_hmap_param;
-	m = isl_map_to_basic_set_try_get(*hmap, map);
+		hmap = &graph->root->intra_hmap_param;
+	m = coef_cache_try_get(graph, *hmap, map);
 	if (m.valid < 0 || m.valid) {
 		isl_map_free(map);
 		return m.value;
@@ -1717,7 +1758,7 @@ static __isl_give isl_basic_set *inter_coefficients(
 	isl_basic_set *coef;
 	isl_maybe_isl_basic_set m;
 
-	m = isl_map_to_basic_set_try_get(graph->inter_hmap, map);
+	m = coef_cache_try_get(graph, graph->root->inter_hmap, map);
 	if (m.valid < 0 || m.valid) {
 		isl_map_free(map);
 		return m.value;
@@ -1732,8 +1773,8 @@ static __isl_give isl_basic_set *inter_coefficients(
 				    isl_multi_aff_copy(edge->dst->decompress));
 	set = isl_map_wrap(isl_map_remove_divs(map));
 	coef = isl_set_coefficients(set);
-	graph->inter_hmap = isl_map_to_basic_set_set(graph->inter_hmap, key,
-					isl_basic_set_copy(coef));
+	graph->root->inter_hmap = isl_map_to_basic_set_set(
+			graph->root->inter_hmap, key, isl_basic_set_copy(coef));
 
 	return coef;
 }
@@ -2840,6 +2881,21 @@ static isl_stat setup_lp(isl_ctx *ctx, struct isl_sched_graph *graph,
 	return isl_stat_ok;
 }
 
+/* Update the linear independence information of all nodes in "graph"
+ * to take into account the schedule rows that have been computed so far.
+ * This is the part of setup_lp that depends on those schedule rows.
+ */
+static isl_stat update_vmaps(struct isl_sched_graph *graph)
+{
+	int i;
+
+	for (i = 0; i < graph->n; ++i)
+		if (node_update_vmap(&graph->node[i]) < 0)
+			return isl_stat_error;
+
+	return isl_stat_ok;
+}
+
 /* Analyze the conflicting constraint found by
  * isl_tab_basic_set_non_trivial_lexmin.  If it corresponds to the validity
  * constraint of one of the edges between distinct nodes, living, moreover
@@ -3639,6 +3695,12 @@ static int compute_maxvar(struct isl_sched_graph *graph)
 /* Extract the subgraph of "graph" that consists of the nodes satisfying
  * "node_pred" and the edges satisfying "edge_pred" and store
  * the result in "sub".
+ *
+ * The edge tables of "sub" are sized according to the number of edges
+ * of each type that satisfy "edge_pred" rather than according to
+ * the number of edges in "graph".  Otherwise, splitting a graph
+ * into many components would allocate (and clear) tables that are
+ * as large as those of the original graph for each of the components.
  */
 static isl_stat extract_sub_graph(isl_ctx *ctx, struct isl_sched_graph *graph,
 	int (*node_pred)(struct isl_sched_node *node, int data),
@@ -3647,13 +3709,21 @@ static isl_stat extract_sub_graph(isl_ctx *ctx, struct isl_sched_graph *graph,
 {
 	int i, n = 0, n_edge = 0;
 	int t;
+	int max_edge[isl_edge_last + 1] = { 0 };
 
 	for (i = 0; i < graph->n; ++i)
 		if (node_pred(&graph->node[i], data))
 			++n;
-	for (i = 0; i < graph->n_edge; ++i)
-		if (edge_pred(&graph->edge[i], data))
-			++n_edge;
+	for (i = 0; i < graph->n_edge; ++i) {
+		struct isl_sched_edge *edge = &graph->edge[i];
+
+		if (!edge_pred(edge, data))
+			continue;
+		++n_edge;
+		for (t = isl_edge_first; t <= isl_edge_last; ++t)
+			if (is_type(edge, t))
+				++max_edge[t];
+	}
 	if (graph_alloc(ctx, sub, n, n_edge) < 0)
 		return isl_stat_error;
 	sub->root = graph->root;
@@ -3662,7 +3732,7 @@ static isl_stat extract_sub_graph(isl_ctx *ctx, struct isl_sched_graph *graph,
 	if (graph_init_table(ctx, sub) < 0)
 		return isl_stat_error;
 	for (t = 0; t <= isl_edge_last; ++t)
-		sub->max_edge[t] = graph->max_edge[t];
+		sub->max_edge[t] = max_edge[t];
 	if (graph_init_edge_tables(ctx, sub) < 0)
 		return isl_stat_error;
 	if (copy_edges(ctx, sub, graph, edge_pred, data) < 0)
@@ -5685,6 +5755,17 @@ static __isl_give isl_schedule_node *compute_schedule_finish_band(
  * until we are no longer able to compute a schedule.
  * Since there are only a finite number of dependences,
  * there will only be a finite number of iterations.
+ *
+ * The constraints constructed by setup_lp only depend on the edges
+ * in "graph", their local status and whether the coincidence
+ * constraints are being used.  In particular, they do not depend
+ * on the rows that have already been computed within the current band.
+ * The linear independence of the next row from these earlier rows
+ * is only enforced by solve_lp.
+ * The LP is therefore only reconstructed when use_coincidence changes or
+ * when the band is reset after marking some edges local.
+ * Otherwise, only the linear independence information is updated
+ * and the LP constructed for the previous row is reused.
  */
 static isl_stat compute_schedule_wcc_band(isl_ctx *ctx,
 	struct isl_sched_graph *graph)
@@ -5693,6 +5774,7 @@ static isl_stat compute_schedule_wcc_band(isl_ctx *ctx,
 	int use_coincidence;
 	int force_coincidence = 0;
 	int check_conditional;
+	int lp_coincidence = -1;
 
 	if (sort_sccs(graph) < 0)
 		return isl_stat_error;
@@ -5713,8 +5795,13 @@ static isl_stat compute_schedule_wcc_band(isl_ctx *ctx,
 		graph->src_scc = -1;
 		graph->dst_scc = -1;
 
-		if (setup_lp(ctx, graph, use_coincidence) < 0)
+		if (lp_coincidence != use_coincidence) {
+			if (setup_lp(ctx, graph, use_coincidence) < 0)
+				return isl_stat_error;
+			lp_coincidence = use_coincidence;
+		} else if (update_vmaps(graph) < 0) {
 			return isl_stat_error;
+		}
 		sol = solve_lp(ctx, graph);
 		if (!sol)
 			return isl_stat_error;
@@ -5742,6 +5829,7 @@ static isl_stat compute_schedule_wcc_band(isl_ctx *ctx,
 		if (reset_band(graph) < 0)
 			return isl_stat_error;
 		use_coincidence = has_coincidence;
+		lp_coincidence = -1;
 	}
 
 	return isl_stat_ok;
@@ -54,16 +54,19 @@ enum isl_token_type isl_stream_register_keyword(__isl_keep isl_stream *s,
 
 	keyword = isl_calloc_type(s->ctx, struct isl_keyword);
 	if (!keyword)
-		return ISL_TOKEN_ERROR;
+		goto error;
 	keyword->type = s->next_type++;
 	keyword->name = strdup(name);
 	if (!keyword->name) {
 		free(keyword);
-		return ISL_TOKEN_ERROR;
+		goto error;
 	}
 	entry->data = keyword;
 
 	return keyword->type;
+error:
+	isl_hash_table_remove(s->ctx, s->keywords, entry);
+	return ISL_TOKEN_ERROR;
 }
 
 struct isl_token *isl_token_new(isl_ctx *ctx,
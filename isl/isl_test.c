@@ -39,6 +39,7 @@
 #include <isl/ilp.h>
 #include <isl_ast_build_expr.h>
 #include <isl/options.h>
+#include <isl/hash.h>
 
 #include "isl_srcdir.c"
 
@@ -9247,6 +9248,153 @@ static int test_tile(isl_ctx *ctx)
 	return 0;
 }
 
+/* Is the integer pointed to by "entry" equal to the one pointed to by "val"?
+ */
+static int int_eq(const void *entry, const void *val)
+{
+	return *(const int *) entry == *(const int *) val;
+}
+
+/* Look for "v" in "table", creating an entry if "reserve" is set.
+ * Only the lower bits of "v" are used to compute the hash value
+ * in order to create long sequences of entries with the same hash value.
+ */
+static struct isl_hash_table_entry *find_int(isl_ctx *ctx,
+	struct isl_hash_table *table, int *v, int reserve)
+{
+	uint32_t hash;
+	int key = *v % 1024;
+
+	hash = isl_hash_init();
+	hash = isl_hash_builtin(hash, key);
+	return isl_hash_table_find(ctx, table, hash, &int_eq, v, reserve);
+}
+
+/* Check that the elements in the range [first, last) with a step of "step"
+ * are (if "present" is set) or are not (if "present" is not set)
+ * contained in "table".
+ */
+static int check_hash_table_range(isl_ctx *ctx, struct isl_hash_table *table,
+	int *v, int first, int last, int step, int present)
+{
+	int i;
+
+	for (i = first; i < last; i += step) {
+		struct isl_hash_table_entry *entry;
+
+		entry = find_int(ctx, table, &v[i], 0);
+		if (present && (!entry || entry->data != &v[i]))
+			isl_die(ctx, isl_error_unknown,
+				"element not found", return -1);
+		if (!present && entry)
+			isl_die(ctx, isl_error_unknown,
+				"unexpected element found", return -1);
+	}
+
+	return 0;
+}
+
+/* Perform some basic tests on isl_hash_table.
+ * In particular, insert a large number of elements,
+ * forcing the table to grow several times,
+ * remove half of them again and check that the remaining
+ * elements can still be found.
+ */
+static int test_hash_table(isl_ctx *ctx)
+{
+	int i;
+	int n = 20000;
+	int *v;
+	struct isl_hash_table *table;
+	int r = -1;
+
+	v = isl_alloc_array(ctx, int, n);
+	table = isl_hash_table_alloc(ctx, 1);
+	if (!v || !table)
+		goto error;
+
+	for (i = 0; i < n; ++i) {
+		struct isl_hash_table_entry *entry;
+
+		v[i] = i;
+		entry = find_int(ctx, table, &v[i], 1);
+		if (!entry)
+			goto error;
+		if (entry->data)
+			isl_die(ctx, isl_error_unknown,
+				"unexpected element found", goto error);
+		entry->data = &v[i];
+	}
+	if (table->n != n)
+		isl_die(ctx, isl_error_unknown,
+			"unexpected number of elements", goto error);
+	if (check_hash_table_range(ctx, table, v, 0, n, 1, 1) < 0)
+		goto error;
+
+	for (i = 0; i < n; i += 2) {
+		struct isl_hash_table_entry *entry;
+
+		entry = find_int(ctx, table, &v[i], 0);
+		if (!entry)
+			isl_die(ctx, isl_error_unknown,
+				"element not found", goto error);
+		isl_hash_table_remove(ctx, table, entry);
+	}
+	if (table->n != n / 2)
+		isl_die(ctx, isl_error_unknown,
+			"unexpected number of elements", goto error);
+	if (check_hash_table_range(ctx, table, v, 0, n, 2, 0) < 0)
+		goto error;
+	if (check_hash_table_range(ctx, table, v, 1, n, 2, 1) < 0)
+		goto error;
+
+	r = 0;
+error:
+	isl_hash_table_free(ctx, table);
+	free(v);
+	return r;
+}
+
+/* Check that a union map with many different spaces,
+ * similar to the tagged dependence relations computed by PPCG,
+ * can be constructed and taken apart again.
+ */
+static int test_hash_union_map(isl_ctx *ctx)
+{
+	int i;
+	int n = 2000;
+	isl_size n_map;
+	isl_union_map *umap;
+	char buffer[100];
+
+	umap = isl_union_map_empty(isl_space_params_alloc(ctx, 0));
+	for (i = 0; i < n; ++i) {
+		isl_map *map;
+
+		snprintf(buffer, sizeof(buffer),
+			"{ [S_%d[i] -> ref_%d[]] -> [S_%d[i + 1] -> ref_%d[]] }",
+			i, i, (i + 1) % n, n + i);
+		map = isl_map_read_from_str(ctx, buffer);
+		umap = isl_union_map_add_map(umap, map);
+	}
+	umap = isl_union_map_coalesce(umap);
+	n_map = isl_union_map_n_map(umap);
+	umap = isl_union_map_domain_factor_domain(umap);
+	umap = isl_union_map_range_factor_domain(umap);
+	umap = isl_union_map_intersect(umap, isl_union_map_copy(umap));
+	if (!umap)
+		n_map = isl_size_error;
+	isl_union_map_free(umap);
+
+	if (n_map < 0)
+		return -1;
+	if (n_map != n)
+		isl_die(ctx, isl_error_unknown,
+			"unexpected number of maps", return -1);
+
+	return 0;
+}
+
 /* Check that the domain hash of a space is equal to the hash
  * of the domain of the space.
  */
@@ -9391,6 +9539,8 @@ struct {
 } tests [] = {
 	{ "universe", &test_universe },
 	{ "domain hash", &test_domain_hash },
+	{ "hash table", &test_hash_table },
+	{ "hash union map", &test_hash_union_map },
 	{ "dual", &test_dual },
 	{ "dependence analysis", &test_flow },
 	{ "val", &test_val },
@@ -239,6 +239,8 @@ static int FN(UNION,group_has_domain_space)(const void *entry, const void *val)
  *
  * First look for the group of expressions with the same domain space,
  * creating one if needed.
+ * If the new group cannot be allocated, then the entry reserved for it
+ * is removed again since it would otherwise be left without data.
  * Then look for the expression living in the specified space in that group.
  */
 static struct isl_hash_table_entry *FN(UNION,find_part_entry)(
@@ -261,6 +263,10 @@ static struct isl_hash_table_entry *FN(UNION,find_part_entry)(
 	if (reserve && !group_entry->data) {
 		isl_space *domain = isl_space_domain(isl_space_copy(space));
 		group = FN(UNION,group_alloc)(domain, 1);
+		if (!group) {
+			isl_hash_table_remove(ctx, &u->table, group_entry);
+			return NULL;
+		}
 		group_entry->data = group;
 	} else {
 		group = group_entry->data;
@@ -126,13 +126,15 @@ static __isl_give UNION *FN(UNION,remove_part_entry)(__isl_take UNION *u,
 	struct isl_hash_table_entry *part_entry)
 {
 	isl_ctx *ctx;
+	PART *part;
 
 	if (!u || !part_entry)
 		return FN(UNION,free)(u);
 
 	ctx = FN(UNION,get_ctx)(u);
+	part = part_entry->data;
 	isl_hash_table_remove(ctx, &u->table, part_entry);
-	FN(PART,free)(part_entry->data);
+	FN(PART,free)(part);
 
 	return u;
 }
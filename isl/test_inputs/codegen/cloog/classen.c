@@ -1,8 +1,8 @@
 if (m >= 1) {
   S1(0, 1, 1, 1);
   if (m >= 2) {
-    S2(0, 1, 1, 1, 1, 1, 2, 1);
     S3(0, 1, 1, 2, 1, 1, 1, 2);
+    S2(0, 1, 1, 1, 1, 1, 2, 1);
     S4(0, 1, 2, 2, 1, 1, 2, 2);
   }
   S8(0, 1);
@@ -1,7 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ocl_utilities.h"
 
+/* The directory in which program binaries are cached or NULL.
+ */
+static const char *binary_cache_dir;
+
 /* Return the OpenCL error string for a given error number.
  */
 const char *opencl_error_string(cl_int error)
@@ -106,7 +111,312 @@ cl_device_id opencl_create_device(int use_gpu)
 	return dev;
 }
 
+void opencl_set_binary_cache(const char *dir)
+{
+	binary_cache_dir = dir;
+}
+
+/* Return the directory in which program binaries should be cached
+ * or NULL if they should not be cached.
+ */
+static const char *get_binary_cache(void)
+{
+	const char *dir;
+
+	dir = getenv("PPCG_OPENCL_BINARY_CACHE");
+	return dir ? dir : binary_cache_dir;
+}
+
+/* Update the (64-bit FNV-1a) hash "hash" with the "size" bytes at "data".
+ */
+static unsigned long long hash_bytes(unsigned long long hash,
+	const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *) data;
+	size_t i;
+
+	for (i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/* Update "hash" with the string valued information "param" about "dev".
+ */
+static unsigned long long hash_device_info(unsigned long long hash,
+	cl_device_id dev, cl_device_info param)
+{
+	size_t size;
+	char *info;
+
+	if (clGetDeviceInfo(dev, param, 0, NULL, &size) < 0)
+		return hash;
+	info = (char *) malloc(size);
+	if (!info)
+		return hash;
+	if (clGetDeviceInfo(dev, param, size, info, NULL) >= 0)
+		hash = hash_bytes(hash, info, size);
+	free(info);
+
+	return hash;
+}
+
+/* Read the file called "name" into a newly allocated buffer
+ * and store its size in *size.
+ * Return NULL if the file cannot be read.
+ */
+static char *read_file(const char *name, size_t *size)
+{
+	FILE *file;
+	long n;
+	char *contents;
+
+	file = fopen(name, "rb");
+	if (!file)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	n = ftell(file);
+	rewind(file);
+	contents = n >= 0 ? (char *) malloc(n + 1) : NULL;
+	if (contents && fread(contents, 1, n, file) != (size_t) n) {
+		free(contents);
+		contents = NULL;
+	}
+	fclose(file);
+	if (!contents)
+		return NULL;
+	contents[n] = '\0';
+	*size = n;
+
+	return contents;
+}
+
+/* Update "*hash" with the names and the contents of the files included
+ * through #include directives by the "size" bytes of source at "source",
+ * and, recursively, of the files included by those files,
+ * up to a nesting depth of "depth".
+ * The included files are looked up relative to the current directory,
+ * which is where the OpenCL compiler finds the files specified
+ * through --opencl-include-file when it is passed "-I.".
+ * Return 0 on success and -1 if any of the included files cannot be read
+ * or if they are nested too deeply.  The program should then not
+ * be cached since changes to those files would go unnoticed.
+ */
+static int hash_included_files(unsigned long long *hash,
+	const char *source, size_t size, int depth)
+{
+	const char *line, *end = source + size;
+
+	for (line = source; line < end; ++line) {
+		const char *eol, *p, *name_end;
+		char close, *name, *contents;
+		size_t contents_size;
+		int r;
+
+		eol = (const char *) memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+		p = line;
+		line = eol;
+		while (p < eol && (*p == ' ' || *p == '\t'))
+			++p;
+		if (p >= eol || *p != '#')
+			continue;
+		for (++p; p < eol && (*p == ' ' || *p == '\t'); ++p)
+			;
+		if (eol - p < 7 || strncmp(p, "include", 7))
+			continue;
+		for (p += 7; p < eol && (*p == ' ' || *p == '\t'); ++p)
+			;
+		if (depth <= 0 || p >= eol || (*p != '<' && *p != '"'))
+			return -1;
+		close = *p++ == '<' ? '>' : '"';
+		name_end = (const char *) memchr(p, close, eol - p);
+		if (!name_end)
+			return -1;
+
+		name = (char *) malloc(name_end - p + 1);
+		if (!name)
+			return -1;
+		memcpy(name, p, name_end - p);
+		name[name_end - p] = '\0';
+		contents = read_file(name, &contents_size);
+		if (contents) {
+			*hash = hash_bytes(*hash, name, strlen(name) + 1);
+			*hash = hash_bytes(*hash, contents, contents_size);
+		}
+		free(name);
+		if (!contents)
+			return -1;
+		r = hash_included_files(hash, contents, contents_size,
+					depth - 1);
+		free(contents);
+		if (r < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Return the name of the file in "dir" that caches the binary
+ * of the program with source "program_source" of size "program_size"
+ * compiled for "dev" with options "opencl_options".
+ * The name is derived from a hash of the source, the files it includes,
+ * the options and the identification of the device and its driver.
+ * Return NULL if the included files cannot be read, in which case
+ * the program is not cached.
+ * The result needs to be freed by the caller.
+ */
+static char *binary_cache_file(const char *dir, cl_device_id dev,
+	const char *program_source, size_t program_size,
+	const char *opencl_options)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	char *name;
+
+	hash = hash_bytes(hash, program_source, program_size);
+	if (hash_included_files(&hash, program_source, program_size, 8) < 0)
+		return NULL;
+	hash = hash_bytes(hash, opencl_options, strlen(opencl_options) + 1);
+	hash = hash_device_info(hash, dev, CL_DEVICE_VENDOR);
+	hash = hash_device_info(hash, dev, CL_DEVICE_NAME);
+	hash = hash_device_info(hash, dev, CL_DEVICE_VERSION);
+	hash = hash_device_info(hash, dev, CL_DRIVER_VERSION);
+
+	name = (char *) malloc(strlen(dir) + sizeof("/ppcg_.bin") + 16);
+	if (!name)
+		return NULL;
+	sprintf(name, "%s/ppcg_%016llx.bin", dir, hash);
+
+	return name;
+}
+
+/* Try and create an OpenCL program for "dev" from the binary
+ * stored in the file called "name" and build it with options
+ * "opencl_options".
+ * Return NULL if there is no such file or if the binary cannot be used,
+ * e.g., because the file is corrupt.  The caller then falls back
+ * to building the program from source.
+ */
+static cl_program load_binary(cl_context ctx, cl_device_id dev,
+	const char *name, const char *opencl_options)
+{
+	FILE *file;
+	long size;
+	size_t read;
+	unsigned char *binary;
+	cl_int err, status;
+	cl_program program;
+
+	file = fopen(name, "rb");
+	if (!file)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	binary = size > 0 ? (unsigned char *) malloc(size) : NULL;
+	read = binary ? fread(binary, 1, size, file) : 0;
+	fclose(file);
+	if (!binary || read != (size_t) size) {
+		free(binary);
+		return NULL;
+	}
+
+	read = size;
+	program = clCreateProgramWithBinary(ctx, 1, &dev, &read,
+			(const unsigned char **) &binary, &status, &err);
+	free(binary);
+	if (err < 0 || status < 0) {
+		if (err >= 0)
+			clReleaseProgram(program);
+		return NULL;
+	}
+	err = clBuildProgram(program, 1, &dev, opencl_options, NULL, NULL);
+	if (err < 0) {
+		clReleaseProgram(program);
+		return NULL;
+	}
+
+	return program;
+}
+
+/* Store the binary of "program" for "dev" in the file called "name".
+ * The binary is first written to a temporary file, which is then
+ * renamed, such that other processes do not see a partially written file.
+ * Failing to store the binary is not an error.
+ */
+static void save_binary(cl_program program, cl_device_id dev,
+	const char *name)
+{
+	cl_uint i, n;
+	cl_device_id *devices = NULL;
+	size_t *sizes = NULL;
+	unsigned char **binaries = NULL;
+	char *tmp = NULL;
+	FILE *file;
+
+	if (clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(n),
+			&n, NULL) < 0 || n == 0)
+		return;
+	devices = (cl_device_id *) malloc(n * sizeof(cl_device_id));
+	sizes = (size_t *) malloc(n * sizeof(size_t));
+	binaries = (unsigned char **) calloc(n, sizeof(unsigned char *));
+	if (!devices || !sizes || !binaries)
+		goto done;
+	if (clGetProgramInfo(program, CL_PROGRAM_DEVICES,
+			n * sizeof(cl_device_id), devices, NULL) < 0)
+		goto done;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES,
+			n * sizeof(size_t), sizes, NULL) < 0)
+		goto done;
+	for (i = 0; i < n; ++i) {
+		binaries[i] = (unsigned char *) malloc(sizes[i] + 1);
+		if (!binaries[i])
+			goto done;
+	}
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES,
+			n * sizeof(unsigned char *), binaries, NULL) < 0)
+		goto done;
+
+	for (i = 0; i < n; ++i)
+		if (devices[i] == dev)
+			break;
+	if (i >= n || sizes[i] == 0)
+		goto done;
+
+	tmp = (char *) malloc(strlen(name) + sizeof(".tmp"));
+	if (!tmp)
+		goto done;
+	sprintf(tmp, "%s.tmp", name);
+	file = fopen(tmp, "wb");
+	if (!file)
+		goto done;
+	if (fwrite(binaries[i], 1, sizes[i], file) != sizes[i]) {
+		fclose(file);
+		remove(tmp);
+		goto done;
+	}
+	if (fclose(file) != 0 || rename(tmp, name) != 0)
+		remove(tmp);
+
+done:
+	if (binaries)
+		for (i = 0; i < n; ++i)
+			free(binaries[i]);
+	free(binaries);
+	free(sizes);
+	free(devices);
+	free(tmp);
+}
+
 /* Create an OpenCL program from a string and compile it.
+ *
+ * If a binary cache has been set, then first try and load
+ * the program from the cache, falling back to compiling the source
+ * if the cache does not contain a usable binary.  In the latter case,
+ * the binary of the compiled program is added to the cache.
  */
 cl_program opencl_build_program_from_string(cl_context ctx, cl_device_id dev,
 	const char *program_source, size_t program_size,
@@ -116,6 +426,22 @@ cl_program opencl_build_program_from_string(cl_context ctx, cl_device_id dev,
 	cl_program program;
 	char *program_log;
 	size_t log_size;
+	const char *dir;
+	char *cache = NULL;
+
+	if (!opencl_options)
+		opencl_options = "";
+	dir = get_binary_cache();
+	if (dir)
+		cache = binary_cache_file(dir, dev, program_source,
+					program_size, opencl_options);
+	if (cache) {
+		program = load_binary(ctx, dev, cache, opencl_options);
+		if (program) {
+			free(cache);
+			return program;
+		}
+	}
 
 	program = clCreateProgramWithSource(ctx, 1,
 			&program_source, &program_size, &err);
@@ -136,6 +462,10 @@ cl_program opencl_build_program_from_string(cl_context ctx, cl_device_id dev,
 		free(program_log);
 		exit(1);
 	}
+	if (cache) {
+		save_binary(program, dev, cache);
+		free(cache);
+	}
 	return program;
 }
 
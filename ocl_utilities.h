@@ -18,7 +18,20 @@ const char *opencl_error_string(cl_int error);
  */
 cl_device_id opencl_create_device(int use_gpu);
 
+/* Cache the binaries of the programs built by the functions below
+ * in the directory "dir", keyed by the program source,
+ * the files it includes, the compiler options and the device.
+ * Programs including files that cannot be found relative
+ * to the current directory are not cached.
+ * If the PPCG_OPENCL_BINARY_CACHE environment variable is set,
+ * then it specifies the directory instead.
+ * A NULL "dir" disables caching (unless the environment variable is set).
+ */
+void opencl_set_binary_cache(const char *dir);
+
 /* Create an OpenCL program from a string and compile it.
+ * If a binary cache has been set, then first try to load
+ * the compiled program from the cache and otherwise add it to the cache.
  */
 cl_program opencl_build_program_from_string(cl_context ctx, cl_device_id dev,
 	const char *program_source, size_t program_size,
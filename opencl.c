@@ -97,6 +97,8 @@ static int opencl_open_files(struct opencl_info *info)
 	fprintf(info->host_c, "#include <assert.h>\n");
 	fprintf(info->host_c, "#include <stdio.h>\n");
 	fprintf(info->host_c, "#include \"ocl_utilities.h\"\n");
+	if (info->options->instrument)
+		fprintf(info->host_c, "#include \"ppcg_instrument.h\"\n");
 	if (info->options->opencl_embed_kernel_code) {
 		fprintf(info->host_c, "#include \"%s\"\n\n",
 			info->kernel_c_name);
@@ -130,6 +132,32 @@ static void opencl_print_escaped(const char *str, const char *end, FILE *file)
 		fwrite(prev, 1, end - prev, file);
 }
 
+/* Print "str" to "p" as the contents of a C string literal,
+ * escaping the special characters in the same way
+ * as opencl_print_escaped.
+ */
+static __isl_give isl_printer *print_escaped_str(__isl_take isl_printer *p,
+	const char *str)
+{
+	char *escaped;
+	int i, j;
+
+	escaped = isl_alloc_array(isl_printer_get_ctx(p), char,
+					2 * strlen(str) + 1);
+	if (!escaped)
+		return isl_printer_free(p);
+	for (i = 0, j = 0; str[i]; ++i) {
+		if (str[i] == '"' || str[i] == '\\')
+			escaped[j++] = '\\';
+		escaped[j++] = str[i];
+	}
+	escaped[j] = '\0';
+	p = isl_printer_print_str(p, escaped);
+	free(escaped);
+
+	return p;
+}
+
 /* Write text to a file as a C string literal.
  *
  * This function also prints any characters after the last newline, although
@@ -219,6 +247,103 @@ static __isl_give isl_printer *opencl_print_host_macros(
 	return p;
 }
 
+/* Print the macro used for keeping track of the last command
+ * accessing an array in the code generated for the --async-transfers option.
+ * The macro replaces the event stored in "var" by "ev",
+ * releasing the previously stored event (if any).
+ */
+static __isl_give isl_printer *opencl_print_async_macros(
+	__isl_take isl_printer *p)
+{
+	const char *macros =
+		"#define openclSetEvent(var, ev) \\\n"
+		"  do { \\\n"
+		"    if (var) \\\n"
+		"      openclCheckReturn(clReleaseEvent(var)); \\\n"
+		"    openclCheckReturn(clRetainEvent(ev)); \\\n"
+		"    var = ev; \\\n"
+		"  } while(0)\n";
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, macros);
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print the name of the event of the last command accessing "array"
+ * in the code generated for the --async-transfers option.
+ */
+static __isl_give isl_printer *print_array_event(__isl_take isl_printer *p,
+	struct gpu_array_info *array)
+{
+	p = isl_printer_print_str(p, "ppcg_event_");
+	p = isl_printer_print_str(p, array->name);
+
+	return p;
+}
+
+/* Print declarations of the events keeping track of the last command
+ * accessing each of the arrays allocated on the device.
+ * The events are initialized to NULL, meaning that there is no
+ * pending command accessing the array.
+ */
+static __isl_give isl_printer *opencl_declare_array_events(
+	__isl_take isl_printer *p, struct gpu_prog *prog)
+{
+	int i;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cl_event ");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, " = NULL;");
+		p = isl_printer_end_line(p);
+	}
+	p = isl_printer_start_line(p);
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
+/* Print code for waiting for all commands in the queue to complete and
+ * for releasing the events declared by opencl_declare_array_events.
+ */
+static __isl_give isl_printer *opencl_release_array_events(
+	__isl_take isl_printer *p, struct gpu_prog *prog)
+{
+	int i;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "openclCheckReturn(clFinish(queue));");
+	p = isl_printer_end_line(p);
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "if (");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, ")");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, 2);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p,
+			"openclCheckReturn(clReleaseEvent(");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, "));");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, -2);
+	}
+
+	return p;
+}
+
 static __isl_give isl_printer *opencl_declare_device_arrays(
 	__isl_take isl_printer *p, struct gpu_prog *prog)
 {
@@ -350,6 +475,10 @@ static __isl_give isl_printer *opencl_release_device_arrays(
 
 /* Create an OpenCL device, context, command queue and build the kernel.
  * input is the name of the input file provided to ppcg.
+ * If the --opencl-out-of-order-queue option is set, then the command queue
+ * is allowed to execute commands out of order.
+ * If the --opencl-binary-cache option is set, then the kernel binaries
+ * are cached in the specified directory.
  */
 static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 	const char *input, struct opencl_info *info)
@@ -383,12 +512,26 @@ static __isl_give isl_printer *opencl_setup(__isl_take isl_printer *p,
 	p = isl_printer_end_line(p);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "queue = clCreateCommandQueue"
-					"(context, device, 0, &err);");
+					"(context, device, ");
+	if (info->options->opencl_out_of_order_queue)
+		p = isl_printer_print_str(p,
+				"CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE");
+	else
+		p = isl_printer_print_str(p, "0");
+	p = isl_printer_print_str(p, ", &err);");
 	p = isl_printer_end_line(p);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(err);");
 	p = isl_printer_end_line(p);
 
+	if (info->options->opencl_binary_cache) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "opencl_set_binary_cache(\"");
+		p = print_escaped_str(p, info->options->opencl_binary_cache);
+		p = isl_printer_print_str(p, "\");");
+		p = isl_printer_end_line(p);
+	}
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "program = ");
 
@@ -695,13 +838,18 @@ static __isl_give isl_printer *opencl_print_kernel_var(
 	p = isl_printer_print_str(p, var->array->type);
 	p = isl_printer_print_str(p, " ");
 	p = isl_printer_print_str(p, var->name);
-	for (j = 0; j < var->array->n_index; ++j) {
+	for (j = 0; j < isl_vec_size(var->size); ++j) {
 		p = isl_printer_print_str(p, "[");
 		v = isl_vec_get_element_val(var->size, j);
 		p = isl_printer_print_val(p, v);
 		p = isl_printer_print_str(p, "]");
 		isl_val_free(v);
 	}
+	if (var->align) {
+		p = isl_printer_print_str(p, " __attribute__((aligned(");
+		p = isl_printer_print_int(p, var->align);
+		p = isl_printer_print_str(p, ")))");
+	}
 	p = isl_printer_print_str(p, ";");
 	p = isl_printer_end_line(p);
 
@@ -830,6 +978,9 @@ static __isl_give isl_printer *opencl_print_kernel_stmt(
 
 	switch (stmt->type) {
 	case ppcg_kernel_copy:
+		if (stmt->u.c.vector)
+			return ppcg_kernel_print_vector_copy(p, stmt,
+							"__local ", "__global ");
 		return ppcg_kernel_print_copy(p, stmt);
 	case ppcg_kernel_sync:
 		return opencl_print_sync(p, stmt);
@@ -1024,57 +1175,240 @@ static __isl_give isl_printer *opencl_print_total_number_of_work_items_as_list(
 	return p;
 }
 
+/* Print the arguments of a clEnqueueReadBufferRect or
+ * clEnqueueWriteBufferRect call for copying the current slice
+ * of "box" of "array", up to the host pointer.
+ * The origin and region are stored in the local variables
+ * "origin" and "region" declared by print_rect_declarations.
+ * The host and the device copy of the array have the same layout.
+ */
+static __isl_give isl_printer *print_rect_arguments(__isl_take isl_printer *p,
+	struct gpu_array_info *array)
+{
+	p = isl_printer_print_str(p, "origin, origin, region, ");
+	p = gpu_array_info_print_pitch(p, array);
+	p = isl_printer_print_str(p, ", 0, ");
+	p = gpu_array_info_print_pitch(p, array);
+	p = isl_printer_print_str(p, ", 0, ");
+
+	return p;
+}
+
+/* Print declarations for the origin and the region of the current slice
+ * of "box" of "array" for use in a clEnqueueReadBufferRect or
+ * clEnqueueWriteBufferRect call.
+ */
+static __isl_give isl_printer *print_rect_declarations(
+	__isl_take isl_printer *p, struct gpu_array_info *array,
+	struct gpu_array_box *box)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "size_t origin[3] = { ");
+	p = gpu_array_box_print_column(p, array, box);
+	p = isl_printer_print_str(p, ", ");
+	p = gpu_array_box_print_row(p, array, box);
+	p = isl_printer_print_str(p, ", 0 };");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "size_t region[3] = { ");
+	p = gpu_array_box_print_width(p, array, box);
+	p = isl_printer_print_str(p, ", ");
+	p = gpu_array_box_print_height(p, array, box);
+	p = isl_printer_print_str(p, ", 1 };");
+	p = isl_printer_end_line(p);
+
+	return p;
+}
+
 /* Copy "array" from the host to the device (to_host = 0) or
  * back from the device to the host (to_host = 1).
+ *
+ * If only a box of the array needs to be copied, then
+ * only copy the elements in that box, provided the box is not empty.
+ * If the array is one-dimensional, then the box is contiguous and
+ * it is copied using a single call to clEnqueueReadBuffer or
+ * clEnqueueWriteBuffer.  Otherwise, the box is copied using
+ * clEnqueueReadBufferRect or clEnqueueWriteBufferRect, one slice
+ * at a time, where a slice is formed by the last two dimensions.
+ *
+ * If "async" is set, then the copy is non-blocking.
+ * It waits for the last command accessing the array (if any) and
+ * replaces it as the last command accessing the array.
  */
 static __isl_give isl_printer *copy_array(__isl_take isl_printer *p,
-	struct gpu_array_info *array, int to_host)
+	struct gpu_array_info *array, int to_host, int async)
 {
+	struct gpu_array_box *box;
+	int rect;
+
+	box = to_host ? &array->copy_out : &array->copy_in;
+	if (!box->offset)
+		box = NULL;
+	rect = box && array->n_index >= 2;
+
+	if (box) {
+		p = gpu_array_box_print_macros(p, box);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "if (");
+		p = gpu_array_box_print_non_empty(p, array, box);
+		p = isl_printer_print_str(p, ")");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, 2);
+		p = gpu_array_box_print_loops(p, array, box);
+	}
+	if (async || rect)
+		p = ppcg_start_block(p);
+	if (async) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "cl_event event;");
+		p = isl_printer_end_line(p);
+	}
+	if (rect)
+		p = print_rect_declarations(p, array, box);
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(");
 	if (to_host)
 		p = isl_printer_print_str(p, "clEnqueueReadBuffer");
 	else
 		p = isl_printer_print_str(p, "clEnqueueWriteBuffer");
+	if (rect)
+		p = isl_printer_print_str(p, "Rect");
 	p = isl_printer_print_str(p, "(queue, dev_");
 	p = isl_printer_print_str(p, array->name);
-	p = isl_printer_print_str(p, ", CL_TRUE, 0, ");
-	p = gpu_array_info_print_size(p, array);
-
-	if (gpu_array_is_scalar(array))
-		p = isl_printer_print_str(p, ", &");
+	if (async)
+		p = isl_printer_print_str(p, ", CL_FALSE, ");
 	else
+		p = isl_printer_print_str(p, ", CL_TRUE, ");
+	if (rect) {
+		p = print_rect_arguments(p, array);
+		p = isl_printer_print_str(p, array->name);
+	} else if (box) {
+		p = gpu_array_box_print_offset(p, array, box);
 		p = isl_printer_print_str(p, ", ");
-	p = isl_printer_print_str(p, array->name);
-	p = isl_printer_print_str(p, ", 0, NULL, NULL));");
+		p = gpu_array_box_print_width(p, array, box);
+		p = isl_printer_print_str(p, ", (char *) ");
+		p = isl_printer_print_str(p, array->name);
+		p = isl_printer_print_str(p, " + ");
+		p = gpu_array_box_print_offset(p, array, box);
+	} else {
+		p = isl_printer_print_str(p, "0, ");
+		p = gpu_array_info_print_size(p, array);
+		if (gpu_array_is_scalar(array))
+			p = isl_printer_print_str(p, ", &");
+		else
+			p = isl_printer_print_str(p, ", ");
+		p = isl_printer_print_str(p, array->name);
+	}
+
+	if (!async) {
+		p = isl_printer_print_str(p, ", 0, NULL, NULL));");
+		p = isl_printer_end_line(p);
+	} else {
+		p = isl_printer_print_str(p, ", ");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, " ? 1 : 0, ");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, " ? &");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, " : NULL, &event));");
+		p = isl_printer_end_line(p);
+
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "openclSetEvent(");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, ", event);");
+		p = isl_printer_end_line(p);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p,
+			"openclCheckReturn(clReleaseEvent(event));");
+		p = isl_printer_end_line(p);
+	}
+
+	if (async || rect)
+		p = ppcg_end_block(p);
+	if (box) {
+		p = gpu_array_box_print_end_loops(p, array);
+		p = isl_printer_indent(p, -2);
+	}
+
+	return p;
+}
+
+/* Print code for waiting for all commands in the queue to complete.
+ */
+static __isl_give isl_printer *opencl_finish(__isl_take isl_printer *p)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "openclCheckReturn(clFinish(queue));");
 	p = isl_printer_end_line(p);
 
 	return p;
 }
 
+/* Print code to "p" for copying "array" to or from the device
+ * as in copy_array, in the code generated for the --instrument option.
+ * The copy is timed from the point where all pending commands
+ * have completed until the copy itself has completed and
+ * the number of copied bytes is recorded.
+ * This means that non-blocking copies no longer overlap
+ * with kernel execution.
+ */
+static __isl_give isl_printer *copy_array_instrumented(
+	__isl_take isl_printer *p, struct gpu_array_info *array, int to_host,
+	int async)
+{
+	const char *prefix = to_host ? "from_device_" : "to_device_";
+
+	p = ppcg_start_block(p);
+	p = opencl_finish(p);
+	p = ppcg_print_instrument_start(p);
+	p = copy_array(p, array, to_host, async);
+	p = opencl_finish(p);
+	p = ppcg_print_instrument_stop(p, prefix, array->name, 0);
+	p = gpu_array_print_instrument_bytes(p, array, to_host);
+	p = ppcg_end_block(p);
+
+	return p;
+}
+
 /* Print code for initializing the device for execution of the transformed
  * code.  This includes declaring locally defined variables as well as
  * declaring and allocating the required copies of arrays on the device.
+ * If the --async-transfers option is set, then also declare
+ * the events keeping track of the last command accessing each array.
  */
 static __isl_give isl_printer *init_device(__isl_take isl_printer *p,
 	struct gpu_prog *prog, struct opencl_info *opencl)
 {
+	int async = opencl->options->async_transfers;
+
 	p = opencl_print_host_macros(p);
+	if (async)
+		p = opencl_print_async_macros(p);
 
 	p = gpu_print_local_declarations(p, prog);
 	p = opencl_declare_device_arrays(p, prog);
 	p = opencl_setup(p, opencl->input, opencl);
 	p = opencl_allocate_device_arrays(p, prog);
+	if (async)
+		p = opencl_declare_array_events(p, prog);
 
 	return p;
 }
 
 /* Print code for clearing the device after execution of the transformed code.
  * In particular, free the memory that was allocated on the device.
+ * If the --async-transfers option is set, then first wait
+ * for all pending commands to complete.  This is the point
+ * where the results copied back from the device become available
+ * on the host.
  */
 static __isl_give isl_printer *clear_device(__isl_take isl_printer *p,
 	struct gpu_prog *prog, struct opencl_info *opencl)
 {
+	if (opencl->options->async_transfers)
+		p = opencl_release_array_events(p, prog);
 	p = opencl_release_device_arrays(p, prog);
 	p = opencl_release_cl_objects(p, opencl);
 
@@ -1091,7 +1425,8 @@ static __isl_give isl_printer *clear_device(__isl_take isl_printer *p,
  * The node for clearing the device is called "clear_device".
  *
  * Extract the array (if any) from the identifier and call
- * init_device, clear_device, copy_array_to_device or copy_array_from_device.
+ * init_device, clear_device or copy_array.
+ * The copies are timed if the --instrument option is set.
  */
 static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
 	__isl_keep isl_ast_node *node, struct gpu_prog *prog,
@@ -1120,10 +1455,111 @@ static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
 	if (!array)
 		return isl_printer_free(p);
 
-	if (!prefixcmp(name, "to_device"))
-		return copy_array(p, array, 0);
-	else
-		return copy_array(p, array, 1);
+	if (opencl->options->instrument)
+		return copy_array_instrumented(p, array,
+				prefixcmp(name, "to_device"),
+				opencl->options->async_transfers);
+	return copy_array(p, array, prefixcmp(name, "to_device"),
+				opencl->options->async_transfers);
+}
+
+/* Return the number of arrays accessed by "kernel" that
+ * are allocated on the device.
+ */
+static int n_kernel_device_arrays(struct gpu_prog *prog,
+	struct ppcg_kernel *kernel)
+{
+	int i;
+	int n = 0;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		if (!ppcg_kernel_requires_array_argument(kernel, i))
+			continue;
+		if (!gpu_array_requires_device_allocation(&prog->array[i]))
+			continue;
+		n++;
+	}
+
+	return n;
+}
+
+/* Print the declaration of the wait list of "kernel", containing
+ * the events of the last commands accessing the arrays accessed
+ * by the kernel, in the code generated for the --async-transfers option.
+ * "n" is the number of such arrays.
+ */
+static __isl_give isl_printer *opencl_print_wait_list(
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct ppcg_kernel *kernel, int n)
+{
+	int i;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cl_event event;");
+	p = isl_printer_end_line(p);
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cl_uint n_wait = 0;");
+	p = isl_printer_end_line(p);
+	if (n == 0)
+		return p;
+
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "cl_event wait_list[");
+	p = isl_printer_print_int(p, n);
+	p = isl_printer_print_str(p, "];");
+	p = isl_printer_end_line(p);
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!ppcg_kernel_requires_array_argument(kernel, i))
+			continue;
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "if (");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, ")");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, 2);
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "wait_list[n_wait++] = ");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, ";");
+		p = isl_printer_end_line(p);
+		p = isl_printer_indent(p, -2);
+	}
+
+	return p;
+}
+
+/* Print code for making the event of the launch of "kernel"
+ * the event of the last command accessing each of the arrays
+ * accessed by the kernel.
+ */
+static __isl_give isl_printer *opencl_update_array_events(
+	__isl_take isl_printer *p, struct gpu_prog *prog,
+	struct ppcg_kernel *kernel)
+{
+	int i;
+
+	for (i = 0; i < prog->n_array; ++i) {
+		struct gpu_array_info *array = &prog->array[i];
+
+		if (!ppcg_kernel_requires_array_argument(kernel, i))
+			continue;
+		if (!gpu_array_requires_device_allocation(array))
+			continue;
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "openclSetEvent(");
+		p = print_array_event(p, array);
+		p = isl_printer_print_str(p, ", event);");
+		p = isl_printer_end_line(p);
+	}
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "openclCheckReturn(clReleaseEvent(event));");
+	p = isl_printer_end_line(p);
+
+	return p;
 }
 
 /* Print the user statement of the host code to "p".
@@ -1155,6 +1591,18 @@ static __isl_give isl_printer *print_device_node(__isl_take isl_printer *p,
  *
  * For more information check:
  * http://www.khronos.org/registry/cl/sdk/1.0/docs/man/xhtml/clEnqueueNDRangeKernel.html
+ *
+ * If the --async-transfers option is set, then the host does not wait
+ * for the kernel to complete.  Instead, the kernel launch waits for
+ * the last commands accessing the arrays accessed by the kernel and
+ * replaces them as the last command accessing those arrays.
+ * Accesses to the same array are therefore executed in order, even
+ * on an out-of-order queue.  Before executing an original user statement
+ * on the host, the host waits for all pending commands to complete.
+ *
+ * If the --instrument option is set, then the kernel launch is timed
+ * from the point where all pending commands have completed
+ * until the kernel itself has completed.
  */
 static __isl_give isl_printer *opencl_print_host_user(
 	__isl_take isl_printer *p,
@@ -1166,10 +1614,14 @@ static __isl_give isl_printer *opencl_print_host_user(
 	struct ppcg_kernel *kernel;
 	struct ppcg_kernel_stmt *stmt;
 	struct print_host_user_data_opencl *data;
+	int async, instrument;
+	int n_wait;
 
 	isl_ast_print_options_free(print_options);
 
 	data = (struct print_host_user_data_opencl *) user;
+	async = data->opencl->options->async_transfers;
+	instrument = data->opencl->options->instrument;
 
 	id = isl_ast_node_get_annotation(node);
 	if (!id)
@@ -1180,8 +1632,15 @@ static __isl_give isl_printer *opencl_print_host_user(
 	stmt = is_user ? isl_id_get_user(id) : NULL;
 	isl_id_free(id);
 
-	if (is_user)
+	if (is_user) {
+		if (async) {
+			p = isl_printer_start_line(p);
+			p = isl_printer_print_str(p,
+					"openclCheckReturn(clFinish(queue));");
+			p = isl_printer_end_line(p);
+		}
 		return ppcg_kernel_print_domain(p, stmt);
+	}
 
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "{");
@@ -1227,6 +1686,15 @@ static __isl_give isl_printer *opencl_print_host_user(
 
 	opencl_set_kernel_arguments(p, data->prog, kernel);
 
+	if (async) {
+		n_wait = n_kernel_device_arrays(data->prog, kernel);
+		p = opencl_print_wait_list(p, data->prog, kernel, n_wait);
+	}
+	if (instrument) {
+		p = opencl_finish(p);
+		p = ppcg_print_instrument_start(p);
+	}
+
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn(clEnqueueNDRangeKernel"
 		"(queue, kernel");
@@ -1238,18 +1706,33 @@ static __isl_give isl_printer *opencl_print_host_user(
 		p = isl_printer_print_int(p, 1);
 
 	p = isl_printer_print_str(p, ", NULL, global_work_size, "
-					"block_size, "
-					"0, NULL, NULL));");
+					"block_size, ");
+	if (!async)
+		p = isl_printer_print_str(p, "0, NULL, NULL));");
+	else if (n_wait == 0)
+		p = isl_printer_print_str(p, "0, NULL, &event));");
+	else
+		p = isl_printer_print_str(p, "n_wait, "
+				"n_wait ? wait_list : NULL, &event));");
 	p = isl_printer_end_line(p);
+	if (async)
+		p = opencl_update_array_events(p, data->prog, kernel);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "openclCheckReturn("
 					"clReleaseKernel(kernel");
 	p = isl_printer_print_int(p, kernel->id);
 	p = isl_printer_print_str(p, "));");
 	p = isl_printer_end_line(p);
-	p = isl_printer_start_line(p);
-	p = isl_printer_print_str(p, "clFinish(queue);");
-	p = isl_printer_end_line(p);
+	if (!async) {
+		p = isl_printer_start_line(p);
+		p = isl_printer_print_str(p, "clFinish(queue);");
+		p = isl_printer_end_line(p);
+	}
+	if (instrument) {
+		if (async)
+			p = opencl_finish(p);
+		p = ppcg_print_instrument_stop(p, "kernel", NULL, kernel->id);
+	}
 	p = isl_printer_indent(p, -2);
 	p = isl_printer_start_line(p);
 	p = isl_printer_print_str(p, "}");
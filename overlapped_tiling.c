@@ -377,6 +377,27 @@ static isl_stat obtain_maxmin_in_bmap(__isl_take isl_basic_map *bmap, void *user
     return isl_stat_ok;
 }
 
+/* Update the maximum and minimum slopes in "user" with those
+ * of the dependences in "map".  "user" should be of maxmin_data type.
+ *
+ * Dependences that do not have enough dimensions in their range,
+ * e.g., because they involve a statement with fewer dimensions,
+ * are ignored.
+ */
+static isl_stat obtain_maxmin_in_map(__isl_take isl_map *map, void *user) {
+    isl_stat r;
+    struct maxmin_data *data = user;
+
+    if (isl_map_dim(map, isl_dim_out) <= data->dim) {
+        isl_map_free(map);
+        return isl_stat_ok;
+    }
+
+    r = isl_map_foreach_basic_map(map, &obtain_maxmin_in_bmap, data);
+    isl_map_free(map);
+
+    return r;
+}
 
 /* Drop "str" from "name".
  */
@@ -572,7 +593,10 @@ __isl_keep isl_multi_val *sizes, int pos) {
     strcat(cst, "*e0 ");
     strcat(cst, " and ");*/
 
-    // todo: multi stmt case
+    // only keep the schedule of the statement of "map"
+    space = isl_space_domain(isl_map_get_space(map));
+    uset = isl_union_set_from_set(isl_set_universe(space));
+    upa = isl_union_pw_aff_intersect_domain(upa, uset);
     list = isl_union_pw_aff_get_pw_aff_list(upa);
     uset = isl_union_pw_aff_domain(upa);
     str1 = isl_union_set_to_str(uset);
@@ -614,6 +638,35 @@ __isl_keep isl_multi_val *sizes, int pos) {
     return map;
 }
 
+/* Return the difference between the maximum and minimum slopes
+ * of the dependences in "dep" along dimension "dim", i.e.,
+ * the number of points by which the left bounding face of a tile
+ * needs to be expanded along this dimension for each time step.
+ * Return zero if there are no dependences.
+ */
+static __isl_give isl_val *expansion_coeff(__isl_keep isl_union_map *dep,
+    int dim)
+{
+    isl_ctx *ctx;
+    isl_val *coeff;
+    isl_val_list *vlist;
+
+    ctx = isl_union_map_get_ctx(dep);
+    vlist = isl_val_list_alloc(ctx, 2);
+    struct maxmin_data vdata = { vlist, dim };
+    isl_union_map_foreach_map(dep, &obtain_maxmin_in_map, &vdata);
+
+    if (isl_val_list_n_val(vdata.list) == 0)
+        coeff = isl_val_zero(ctx);
+    else {
+        coeff = isl_val_list_get_val(vdata.list, 0);
+        coeff = isl_val_sub(coeff, isl_val_list_get_val(vdata.list, 1));
+    }
+    isl_val_list_free(vdata.list);
+
+    return coeff;
+}
+
 struct overlapped_data {
     isl_union_map *expansion;
     isl_union_map *result;
@@ -655,9 +708,12 @@ struct overlapped_data {
  * parallelogram tile, with all dependence sources along the time-tile dimension
  * considered into account.
  * 
- * The dependence relation about the current statement is first extracted from the
- * dependences "data->dep". The maximum and minimum slopes are computed by invoking
- * the obtain_maxmin_in_bmap function. The differences between the maximum and
+ * The maximum and minimum slopes are computed over all the dependences "data->dep"
+ * between the statements of the band by invoking the obtain_maxmin_in_bmap function.
+ * In case of multiple statements, each statement is therefore expanded
+ * according to the union of the dependence cones of all statements,
+ * such that the values it produces are available to all the statements
+ * that consume them within the same tile. The differences between the maximum and
  * minimum slopes determines how much the left bounding face of the original
  * parallelogram tile should be expanded.
  * 
@@ -695,16 +751,12 @@ struct overlapped_data {
  * to "map".
  */
 static isl_stat construct_overlapped_cond(__isl_take isl_map *map, void *user) {
-    int i, j, dim;
-    const char *map_name, *dep_name;
+    int j, dim;
     isl_aff *aff, *sub, *copy, *extent;
     isl_ctx *ctx;
-    isl_map *candidate;
-    isl_set *set, *domain;
+    isl_set *set;
     isl_val *val, *coeff, *rev;
     isl_space *space;
-    isl_map_list *list;
-    isl_val_list *vlist;
     isl_constraint *c;
     isl_local_space *ls;
     isl_union_pw_aff *upa;
@@ -740,28 +792,8 @@ static isl_stat construct_overlapped_cond(__isl_take isl_map *map, void *user) {
         map = isl_set_unwrap(set);
 
         // compute coefficient for lower bounds
-        map_name = isl_map_get_tuple_name(map, isl_dim_in);
-        list = isl_union_map_get_map_list(data->dep);
-        for (i = 0; i < isl_map_list_n_map(list); i++) {
-            candidate = isl_map_list_get_map(list, i);
-            domain = isl_map_domain(candidate);
-            dep_name = isl_set_get_tuple_name(domain);
-            isl_set_free(domain);
-            if(map_name == dep_name)
-                break;
-            else
-                continue;
-        }
-        isl_map_list_free(list);
-
         ctx = isl_union_map_get_ctx(data->dep);
-        vlist = isl_val_list_alloc(ctx, 2);
-        struct maxmin_data vdata = { vlist, j };
-        isl_map_foreach_basic_map(candidate, &obtain_maxmin_in_bmap, &vdata);
-
-        coeff = isl_val_list_get_val(vdata.list, 0);
-        coeff = isl_val_sub(coeff, isl_val_list_get_val(vdata.list, 1));
-        isl_val_list_free(vdata.list);
+        coeff = expansion_coeff(data->dep, j);
 
         // construct lower bound affine expr
         set = isl_map_wrap(map);
@@ -808,6 +840,24 @@ static isl_stat construct_overlapped_cond(__isl_take isl_map *map, void *user) {
     return isl_stat_ok;
 }
 
+/* Return the flow dependences of "scop" between the statement
+ * instances in "domain", simplified with respect to "domain".
+ */
+static __isl_give isl_union_map *band_dependences(struct ppcg_scop *scop,
+    __isl_take isl_union_set *domain)
+{
+    isl_union_map *dep;
+
+    dep = isl_union_map_copy(scop->dep_flow);
+    dep = isl_union_map_intersect_domain(dep, isl_union_set_copy(domain));
+    dep = isl_union_map_intersect_range(dep, isl_union_set_copy(domain));
+    dep = isl_union_map_coalesce(dep);
+    dep = isl_union_map_gist_domain(dep, isl_union_set_copy(domain));
+    dep = isl_union_map_gist_range(dep, domain);
+
+    return dep;
+}
+
 /* Update the identity mapping of "expansion".
  * "expansion" is a union_map. The first step is to remove all equality constraints
  * along the space dimensions that overlapped tiling is to be applied.
@@ -819,7 +869,8 @@ static isl_stat construct_overlapped_cond(__isl_take isl_map *map, void *user) {
  * The starting point of an expansion mapping can be an arbitrary point in a tile, and
  * we are free to choose a point on the left bounding face of a tile.
  * 
- * The final step is to construct the overlapped conditions according to dependences.
+ * The final step is to construct the overlapped conditions according to
+ * the dependences between the statements in "domain".
  */
 static __isl_give isl_union_map* update_expansion(struct ppcg_scop *scop,
     __isl_take isl_union_map *expansion, __isl_take isl_union_set *domain,
@@ -840,7 +891,8 @@ static __isl_give isl_union_map* update_expansion(struct ppcg_scop *scop,
     isl_union_map_foreach_map(expansion, &drop_space_dim_constraints, &mdata);
     isl_union_map_free(expansion);
 
-    struct expansion_data data = { result, domain, scop->options->multi_level_overlapped };
+    struct expansion_data data = { result, isl_union_set_copy(domain),
+        scop->options->multi_level_overlapped };
     isl_union_map_foreach_map(mdata.umap, &add_space_dim_bounds, &data);
     isl_union_map_free(mdata.umap);
     isl_union_set_free(data.domain);
@@ -858,10 +910,7 @@ static __isl_give isl_union_map* update_expansion(struct ppcg_scop *scop,
     // construct overlapped constraints
     space = isl_union_map_get_space(data.expansion);
     umap = isl_union_map_empty(space);
-    dep = isl_union_map_copy(scop->dep_flow);
-    dep = isl_union_map_coalesce(dep);
-    dep = isl_union_map_gist_domain(dep, isl_union_set_copy(domain));
-    dep = isl_union_map_gist_range(dep, isl_union_set_copy(domain));
+    dep = band_dependences(scop, domain);
 
     struct overlapped_data overlap = { data.expansion, umap, dep, sizes, mupa,
         scop->options->isolate_expanded_points, block_sizes, block_len, 
@@ -875,101 +924,238 @@ static __isl_give isl_union_map* update_expansion(struct ppcg_scop *scop,
     return overlap.result;
 }
 
-struct dim_size_data {
-    isl_set *domain;
-    isl_pw_aff *pa;
-};
+/* Obtain the size of schedule dimension "dim" of "mupa" over
+ * the statement instances in "domain" as a function of the parameters.
+ * This size should be compared with parallelogram tiling size.
+ * In case the parallelogram tiling size is greater than this size,
+ * overlapped tiling should not be applied.
+ */
+static __isl_give isl_pw_aff *obtain_space_dim_size(__isl_take isl_set *domain,
+    __isl_take isl_multi_union_pw_aff *mupa, int dim)
+{
+    isl_set *range;
+    isl_union_map *umap;
+    isl_union_pw_aff *upa;
+
+    upa = isl_multi_union_pw_aff_get_union_pw_aff(mupa, dim);
+    isl_multi_union_pw_aff_free(mupa);
+    upa = isl_union_pw_aff_intersect_domain(upa,
+        isl_union_set_from_set(domain));
+    umap = isl_union_map_from_union_pw_aff(upa);
+    range = isl_set_from_union_set(isl_union_map_range(umap));
 
-/* Return the domain name of "pa".
+    return ppcg_set_dim_extent(range, 0);
+}
+
+/* Return the set of parameter values in "context" for which
+ * the tile size along dimension 1 in "sizes" is greater than or equal to
+ * the extent of this dimension of "mupa" for some statement in "domain",
+ * i.e., for which parallelogram tiling should be applied
+ * instead of overlapped tiling.
  */
-static isl_stat get_pw_aff_from_domain(__isl_take isl_pw_aff *pa, void *user) {
-    const char *pa_name, *dom_name;
-    isl_set *domain;
-    struct dim_size_data *data = user;
-
-    dom_name = isl_set_get_tuple_name(data->domain);
-    domain = isl_pw_aff_domain(isl_pw_aff_copy(pa));
-    pa_name = isl_set_get_tuple_name(domain);
-    isl_set_free(domain);
-
-    if (dom_name == pa_name)
-        data->pa = pa;
-    else
-        isl_pw_aff_free(pa);
+static __isl_give isl_set *parallelogram_params(
+    __isl_keep isl_union_set *domain, __isl_keep isl_multi_union_pw_aff *mupa,
+    __isl_keep isl_multi_val *sizes, __isl_keep isl_set *context)
+{
+    int i, n;
+    isl_set *params;
+    isl_set_list *list;
 
-    return isl_stat_ok;
+    params = isl_set_empty(isl_set_get_space(context));
+    list = isl_union_set_get_set_list(domain);
+    n = isl_set_list_n_set(list);
+    for (i = 0; i < n; i++) {
+        isl_set *set, *fits;
+        isl_pw_aff *bound, *size;
+
+        set = isl_set_list_get_set(list, i);
+        bound = obtain_space_dim_size(set, isl_multi_union_pw_aff_copy(mupa), 1);
+        size = isl_pw_aff_val_on_domain(
+            isl_set_universe(isl_pw_aff_get_domain_space(bound)),
+            isl_multi_val_get_val(sizes, 1));
+        fits = isl_pw_aff_le_set(bound, size);
+        params = isl_set_union(params, fits);
+    }
+    isl_set_list_free(list);
+
+    return isl_set_intersect(params, isl_set_copy(context));
 }
 
-/* Obtain the space dimension size of input "domain". This size
- * should be compared with parallelogram tiling size. In case
- * the parallelogram tiling size is greater than this size,
- * overlapped tiling should not be applied.  
+/* Return the tile size at position "pos" of "sizes".
  */
-static int obtain_space_dim_size(__isl_take isl_set *domain,
-    __isl_take isl_multi_union_pw_aff *mupa, int dim)
+static int tile_size(__isl_keep isl_multi_val *sizes, int pos)
 {
-	int i, n, bound;
-    isl_aff *aff;
-    isl_ctx *ctx;
-	isl_val *ub, *lb, *val;
-	isl_set *dom, *points;
-	isl_point *max, *min;
-    isl_pw_aff *pa;
-    isl_val_list *clist;
-    isl_union_pw_aff *upa;
+    int size;
+    isl_val *v;
 
-	if(!domain)
-		return -1;
+    v = isl_multi_val_get_val(sizes, pos);
+    size = isl_val_get_num_si(v);
+    isl_val_free(v);
 
-    n = isl_multi_union_pw_aff_dim(mupa, isl_dim_out);
-    //todo: check n > dim
-    upa = isl_multi_union_pw_aff_get_union_pw_aff(mupa, dim);
-    isl_multi_union_pw_aff_free(mupa);
+    return size;
+}
 
-    struct dim_size_data data = { domain, pa};
-    isl_union_pw_aff_foreach_pw_aff(upa, &get_pw_aff_from_domain, &data);
-    isl_union_pw_aff_free(upa);
-    isl_pw_aff_foreach_piece(data.pa, &extract_single_piece, &aff);
-    isl_pw_aff_free(data.pa);
-    
-    ctx = isl_aff_get_ctx(aff);
-    clist = isl_val_list_alloc(ctx, dim + 2);
-    for (i = 0; i <= dim; i++) {
-        val = isl_aff_get_coefficient_val(aff, isl_dim_in, i);
-        clist = isl_val_list_add(clist, val);
+/* Compute the ratio between the number of points executed by
+ * a full overlapped tile and the number of points in the corresponding
+ * parallelogram tile, for the tile sizes in "sizes" and
+ * the expansion coefficients "coeff" of the first "n" space dimensions.
+ *
+ * A parallelogram tile contains
+ *
+ *      T_t * T_1 * ... * T_n
+ *
+ * points, with "T_t" the tile size of the time dimension and "T_i"
+ * that of the i-th space dimension.  The points at (relative) time step "t"
+ * of an overlapped tile are expanded by coeff_i * (T_t - 1 - t) along
+ * the i-th space dimension (see construct_overlapped_cond), such that
+ * the overlapped tile executes
+ *
+ *      sum_{r = 0}^{T_t - 1} prod_i (T_i + coeff_i * r)
+ *
+ * points.  These numbers only depend on the tile sizes and the slopes
+ * of the dependences and are therefore computed directly rather than
+ * by counting the points in the expansion.
+ */
+static double redundancy_ratio(__isl_keep isl_multi_val *sizes,
+    isl_val **coeff, int n)
+{
+    int i, r, time;
+    double original, expanded;
+
+    time = tile_size(sizes, 0);
+    original = time;
+    for (i = 0; i < n; i++)
+        original *= tile_size(sizes, i + 1);
+
+    expanded = 0;
+    for (r = 0; r < time; r++) {
+        double row = 1;
+
+        for (i = 0; i < n; i++)
+            row *= tile_size(sizes, i + 1) +
+                isl_val_get_d(coeff[i]) * r;
+        expanded += row;
     }
-    val = isl_aff_get_constant_val(aff);
-    clist = isl_val_list_add(clist, val);
-    isl_aff_free(aff);
 
-    bound = 0;
-    for (i = 0; i <= dim; i++) {
-        points = isl_set_lexmax(isl_set_copy(domain));
-        max = isl_set_sample_point(points);
-        ub = isl_point_get_coordinate_val(max, isl_dim_set, i);
-
-        points = isl_set_lexmin(isl_set_copy(domain));
-        min = isl_set_sample_point(points);
-        lb = isl_point_get_coordinate_val(min, isl_dim_set, i);
-
-        val = isl_val_sub(ub, lb);
-        val = isl_val_mul(val, isl_val_list_get_val(clist, i));
-        bound += isl_val_get_num_si(val);
-        isl_val_free(val);
-        isl_point_free(max);
-        isl_point_free(min);
+    return expanded / original;
+}
+
+/* Print the redundancy "ratio" of overlapped tiling the band "node"
+ * with time tile size "time".
+ */
+static void report_redundancy(__isl_keep isl_schedule_node *node,
+    int time, double ratio)
+{
+    isl_ctx *ctx;
+    isl_printer *p;
+    isl_multi_union_pw_aff *mupa;
+
+    ctx = isl_schedule_node_get_ctx(node);
+    mupa = isl_schedule_node_band_get_partial_schedule(node);
+    p = isl_printer_to_file(ctx, stdout);
+    p = isl_printer_print_str(p, "Band ");
+    p = isl_printer_print_multi_union_pw_aff(p, mupa);
+    p = isl_printer_print_str(p, " with time tile size ");
+    p = isl_printer_print_int(p, time);
+    p = isl_printer_print_str(p, " executes ");
+    p = isl_printer_print_double(p, ratio);
+    p = isl_printer_print_str(p, " times the original number of points "
+        "per overlapped tile");
+    p = isl_printer_end_line(p);
+    isl_printer_free(p);
+    isl_multi_union_pw_aff_free(mupa);
+}
+
+/* Limit the redundant computation introduced by overlapped tiling
+ * the band "node" with tile sizes "sizes".
+ *
+ * The redundancy ratio (the number of points executed by a full
+ * overlapped tile over the number of points in the original tile)
+ * grows with the time tile size.  If the "max_overlapped_redundancy" option
+ * is set, then reduce the time tile size until the redundancy ratio
+ * is at most 1 + max_overlapped_redundancy / 100 or
+ * until the time tile size is 1.
+ * The resulting redundancy ratio is reported if the "verbose" option is set.
+ */
+static __isl_give isl_multi_val *limit_redundancy(
+    __isl_keep isl_schedule_node *node, struct ppcg_scop *scop,
+    __isl_take isl_multi_val *sizes)
+{
+    int i, n, time;
+    int max = scop->options->max_overlapped_redundancy;
+    double ratio;
+    isl_val **coeff;
+    isl_union_map *dep;
+
+    n = scop->options->multi_level_overlapped + 1;
+    if (isl_multi_val_dim(sizes, isl_dim_out) <= n)
+        return sizes;
+    if (max <= 0 && !scop->options->debug->verbose)
+        return sizes;
+
+    coeff = isl_alloc_array(isl_schedule_node_get_ctx(node), isl_val *, n);
+    if (!coeff)
+        return isl_multi_val_free(sizes);
+    dep = band_dependences(scop, isl_schedule_node_get_domain(node));
+    for (i = 0; i < n; i++)
+        coeff[i] = expansion_coeff(dep, i + 1);
+    isl_union_map_free(dep);
+
+    ratio = redundancy_ratio(sizes, coeff, n);
+    time = tile_size(sizes, 0);
+    while (max > 0 && time > 1 && ratio > 1 + max / 100.0) {
+        time--;
+        sizes = isl_multi_val_set_val(sizes, 0,
+            isl_val_int_from_si(isl_multi_val_get_ctx(sizes), time));
+        ratio = redundancy_ratio(sizes, coeff, n);
     }
-    val = isl_val_list_get_val(clist, i);
-    bound += isl_val_get_num_si(val);
-    
-    isl_val_free(val);
-    isl_set_free(domain);
-    isl_val_list_free(clist);
+    if (scop->options->debug->verbose)
+        report_redundancy(node, time, ratio);
 
-	if(!bound)
-		return INT32_MAX;
+    for (i = 0; i < n; i++)
+        isl_val_free(coeff[i]);
+    free(coeff);
 
-	return bound + 1;
+    return sizes;
+}
+
+/* Apply overlapped tiling on "node" for the parameter values
+ * outside "params" and parallelogram tiling for those inside "params",
+ * by inserting a sequence of two filters on the parameters
+ * and tiling each copy of "node" accordingly.
+ * The decision is thereby taken at run time.
+ * Return a pointer to the inserted sequence node.
+ */
+static __isl_give isl_schedule_node *overlapped_tile_guarded(
+    __isl_take isl_schedule_node *node, struct ppcg_scop *scop,
+    __isl_take isl_multi_val *sizes, __isl_take isl_set *params)
+{
+    isl_union_set *domain, *overlapped, *parallelogram;
+    isl_union_set_list *filters;
+
+    domain = isl_schedule_node_get_domain(node);
+    parallelogram = isl_union_set_intersect_params(
+        isl_union_set_copy(domain), isl_set_copy(params));
+    overlapped = isl_union_set_intersect_params(domain,
+        isl_set_complement(params));
+    filters = isl_union_set_list_from_union_set(overlapped);
+    filters = isl_union_set_list_add(filters, parallelogram);
+    node = isl_schedule_node_insert_sequence(node, filters);
+
+    node = isl_schedule_node_child(node, 0);
+    node = isl_schedule_node_child(node, 0);
+    node = overlapped_tile(node, scop, isl_multi_val_copy(sizes),
+        NULL, 0, 0);
+    node = isl_schedule_node_parent(node);
+    node = isl_schedule_node_parent(node);
+
+    node = isl_schedule_node_child(node, 1);
+    node = isl_schedule_node_child(node, 0);
+    node = isl_schedule_node_band_tile(node, sizes);
+    node = isl_schedule_node_parent(node);
+    node = isl_schedule_node_parent(node);
+
+    return node;
 }
 
 /* Apply overlapped tiling on demand. "multi_dim" indicates whether multiple level
@@ -981,7 +1167,11 @@ static int obtain_space_dim_size(__isl_take isl_set *domain,
  * 
  * First check whether the tile sizes of those that to be applied overlapped tiling
  * are greater than the extents of these space dimensions. Return parallelogram
- * tiling if this is true.
+ * tiling if this is true for all values of the parameters in the context.
+ * If it only holds for some values of the parameters, then the choice
+ * between overlapped and parallelogram tiling is made at run time,
+ * unless the expansion is inserted after gpu mapping, in which case
+ * overlapped tiling is applied.
  * 
  * Overlapped tiling is applied based on parallelogram tiling. In particular,
  * we first apply parallelogram tiling without shifting point loops, because we will
@@ -996,12 +1186,11 @@ __isl_give isl_schedule_node *overlapped_tile(__isl_take isl_schedule_node *node
 		struct ppcg_scop *scop, __isl_take isl_multi_val *sizes, int *block_sizes,
         int block_len, int after_mapping)
 {
-    int i, j, k, n, n_member;
-    int tile, shift, dim ,bound, overlapped;
+    int n_member;
+    int tile, shift;
+    isl_bool empty, subset;
     isl_ctx *ctx;
-    isl_set *set;
-    isl_val *val, *size;
-    isl_set_list *list;
+    isl_set *params;
     isl_union_set *domain, *universe;
     isl_union_map *expansion, *copy, *identity;
     isl_multi_union_pw_aff *mupa;
@@ -1011,38 +1200,35 @@ __isl_give isl_schedule_node *overlapped_tile(__isl_take isl_schedule_node *node
     mupa = isl_schedule_node_band_get_partial_schedule(node);
 
     // apply parallelogram tiling if tile size is greater than space extent
-    overlapped = 1;
-    ctx = isl_schedule_node_get_ctx(node);
     domain = isl_schedule_node_get_domain(node);
-    list = isl_union_set_get_set_list(domain);
+    params = parallelogram_params(domain, mupa, sizes, scop->context);
     isl_union_set_free(domain);
-    n = isl_set_list_n_set(list);
-    for (i = 0; i < n; i++) {
-        set = isl_set_list_get_set(list, i);
-        dim = isl_set_n_dim(set);
-        //todo: check dim >= 2
-        bound = obtain_space_dim_size(set, isl_multi_union_pw_aff_copy(mupa), 1);
-        val = isl_val_int_from_si(ctx, bound);
-        size = isl_multi_val_get_val(sizes, 1);
-        if(isl_val_ge(size, val)) {
-            overlapped = 0;
-            isl_val_free(val);
-            isl_val_free(size);
-            break;
-        }
-        else {
-            isl_val_free(val);
-            isl_val_free(size);
-        }
+    empty = isl_set_is_empty(params);
+    subset = isl_set_is_subset(scop->context, params);
+    if (empty < 0 || subset < 0) {
+        isl_set_free(params);
+        isl_multi_val_free(sizes);
+        isl_multi_union_pw_aff_free(mupa);
+        return isl_schedule_node_free(node);
     }
-    isl_set_list_free(list);
 
-    if(!overlapped) {
+    if (subset) {
+        isl_set_free(params);
         isl_multi_union_pw_aff_free(mupa);
         return isl_schedule_node_band_tile(node, sizes);
     }
-    
+
+    if (!empty && !after_mapping) {
+        isl_multi_union_pw_aff_free(mupa);
+        return overlapped_tile_guarded(node, scop, sizes, params);
+    }
+    isl_set_free(params);
+
+    // bound the redundant computation by reducing the time tile size
+    sizes = limit_redundancy(node, scop, sizes);
+
     // apply parallelogram tiling without shifting point loops
+    ctx = isl_schedule_node_get_ctx(node);
     n_member = isl_schedule_node_band_n_member(node);
     tile = isl_options_get_tile_scale_tile_loops(ctx);
     shift = isl_options_get_tile_shift_point_loops(ctx);
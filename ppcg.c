@@ -35,6 +35,7 @@
 #include "cuda.h"
 #include "opencl.h"
 #include "cpu.h"
+#include "reduction.h"
 
 struct options {
 	struct pet_options *pet;
@@ -749,6 +750,28 @@ static void compute_dependences(struct ppcg_scop *scop)
 	isl_union_flow_free(flow);
 }
 
+/* If the reductions option is set, then collect the dependences
+ * between instances of reduction statements that update the same
+ * scalar with the same operator in scop->dep_reduction.
+ * These dependences may be ignored by loops that are executed
+ * in parallel with a corresponding reduction clause.
+ */
+static void compute_reduction_dependences(struct ppcg_scop *scop)
+{
+	isl_union_map *dep;
+
+	if (!scop || !scop->options->reductions)
+		return;
+
+	dep = isl_union_map_union(isl_union_map_copy(scop->dep_flow),
+				isl_union_map_copy(scop->dep_false));
+	if (scop->dep_order)
+		dep = isl_union_map_union(dep,
+					isl_union_map_copy(scop->dep_order));
+	scop->dep_reduction = ppcg_reduction_dependences(scop->pet, dep);
+	isl_union_map_free(dep);
+}
+
 /* Eliminate dead code from ps->domain.
  *
  * In particular, intersect both ps->domain and the domain of
@@ -859,6 +882,7 @@ static void *ppcg_scop_free(struct ppcg_scop *ps)
 	isl_union_map_free(ps->dep_forced);
 	isl_union_map_free(ps->tagged_dep_order);
 	isl_union_map_free(ps->dep_order);
+	isl_union_map_free(ps->dep_reduction);
 	isl_schedule_free(ps->schedule);
 	isl_union_pw_multi_aff_free(ps->tagger);
 	isl_union_map_free(ps->independence);
@@ -921,10 +945,12 @@ static struct ppcg_scop *ppcg_scop_from_pet_scop(struct pet_scop *scop,
 	compute_tagger(ps);
 	compute_dependences(ps);
 	eliminate_dead_code(ps);
+	compute_reduction_dependences(ps);
 
 	if (!ps->context || !ps->domain || !ps->call || !ps->reads ||
 	    !ps->may_writes || !ps->must_writes || !ps->tagged_must_kills ||
-	    !ps->must_kills || !ps->schedule || !ps->independence || !ps->names)
+	    !ps->must_kills || !ps->schedule || !ps->independence || !ps->names ||
+	    (options->reductions && !ps->dep_reduction))
 		return ppcg_scop_free(ps);
 
 	return ps;
@@ -64,6 +64,11 @@ int ppcg_extract_base_name(char *name, const char *input);
  *	option is set.  Otherwise it is NULL.
  *	If "dep_order" is used, then "dep_false" only contains a limited
  *	set of anti and output dependences.
+ * "dep_reduction" contains the dependences in "dep_flow", "dep_false" and
+ *	"dep_order" between instances of reduction statements that
+ *	update the same scalar with the same operator.
+ *	It is only used if the reductions option is set.
+ *	Otherwise it is NULL.
  * "schedule" represents the (original) schedule.
  *
  * "names" contains all variable names that are in use by the scop.
@@ -102,6 +107,7 @@ struct ppcg_scop {
 	isl_union_map *dep_forced;
 	isl_union_map *dep_order;
 	isl_union_map *tagged_dep_order;
+	isl_union_map *dep_reduction;
 	isl_schedule *schedule;
 
 	isl_id_to_ast_expr *names;
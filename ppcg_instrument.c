@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ppcg_instrument.h"
+
+/* An entry in the table of instrumented regions.
+ * "name" identifies the region (a kernel, a transfer or a loop nest),
+ * "count" is the number of times it was executed,
+ * "seconds" the accumulated execution time and
+ * "bytes" the accumulated number of bytes moved.
+ */
+struct ppcg_instrument_entry {
+	const char *name;
+	long count;
+	double seconds;
+	unsigned long long bytes;
+};
+
+/* The table of instrumented regions, with "n" entries and
+ * room for "size" entries, and the start time of the current region.
+ */
+static struct {
+	int n;
+	int size;
+	struct ppcg_instrument_entry *entry;
+	double start;
+} ppcg_instrument_table;
+
+/* Return the current (monotonic) time in seconds.
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* Print the table of instrumented regions in CSV format
+ * to the file called by the PPCG_INSTRUMENT_FILE environment variable
+ * or to stderr if this variable is not set, and free the table.
+ */
+static void dump(void)
+{
+	int i;
+	const char *name;
+	FILE *out = stderr;
+
+	name = getenv("PPCG_INSTRUMENT_FILE");
+	if (name) {
+		out = fopen(name, "w");
+		if (!out) {
+			fprintf(stderr, "Unable to open '%s' for writing\n",
+				name);
+			out = stderr;
+		}
+	}
+
+	fprintf(out, "name,count,seconds,bytes\n");
+	for (i = 0; i < ppcg_instrument_table.n; ++i) {
+		struct ppcg_instrument_entry *entry;
+
+		entry = &ppcg_instrument_table.entry[i];
+		fprintf(out, "%s,%ld,%.9f,%llu\n", entry->name, entry->count,
+			entry->seconds, entry->bytes);
+	}
+
+	if (out != stderr)
+		fclose(out);
+	free(ppcg_instrument_table.entry);
+}
+
+/* Return the entry in the table for the region called "name",
+ * creating it if there is no such entry yet.
+ * The table is printed at exit, which is arranged
+ * when the first entry is created.
+ */
+static struct ppcg_instrument_entry *get(const char *name)
+{
+	int i;
+	struct ppcg_instrument_entry *entry;
+
+	for (i = 0; i < ppcg_instrument_table.n; ++i)
+		if (!strcmp(ppcg_instrument_table.entry[i].name, name))
+			return &ppcg_instrument_table.entry[i];
+
+	if (ppcg_instrument_table.n == 0 && ppcg_instrument_table.size == 0)
+		atexit(&dump);
+	if (ppcg_instrument_table.n == ppcg_instrument_table.size) {
+		int size = 2 * ppcg_instrument_table.size + 4;
+		struct ppcg_instrument_entry *grown;
+
+		grown = (struct ppcg_instrument_entry *)
+			realloc(ppcg_instrument_table.entry,
+				size * sizeof(*grown));
+		if (!grown) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		ppcg_instrument_table.entry = grown;
+		ppcg_instrument_table.size = size;
+	}
+
+	entry = &ppcg_instrument_table.entry[ppcg_instrument_table.n++];
+	entry->name = name;
+	entry->count = 0;
+	entry->seconds = 0;
+	entry->bytes = 0;
+
+	return entry;
+}
+
+void ppcg_instrument_start(void)
+{
+	ppcg_instrument_table.start = now();
+}
+
+void ppcg_instrument_stop(const char *name)
+{
+	struct ppcg_instrument_entry *entry;
+	double elapsed;
+
+	elapsed = now() - ppcg_instrument_table.start;
+	entry = get(name);
+	entry->count++;
+	entry->seconds += elapsed;
+}
+
+void ppcg_instrument_add_bytes(const char *name, size_t bytes)
+{
+	get(name)->bytes += bytes;
+}
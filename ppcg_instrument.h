@@ -0,0 +1,31 @@
+#ifndef PPCG_INSTRUMENT_H
+#define PPCG_INSTRUMENT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Record the start of an instrumented region of the generated code.
+ * Instrumented regions are not nested.
+ */
+void ppcg_instrument_start(void);
+
+/* Record the end of the instrumented region called "name",
+ * adding one execution and the time elapsed since the last call
+ * to ppcg_instrument_start to the entry of "name" in the table
+ * that is printed at exit.
+ */
+void ppcg_instrument_stop(const char *name);
+
+/* Add "bytes" bytes moved by the instrumented region called "name"
+ * to the entry of "name" in the table that is printed at exit.
+ */
+void ppcg_instrument_add_bytes(const char *name, size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
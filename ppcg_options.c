@@ -17,6 +17,12 @@ static struct isl_arg_choice target[] = {
 	{0}
 };
 
+static struct isl_arg_choice tiling[] = {
+	{"manual",	PPCG_TILING_MANUAL},
+	{"auto",	PPCG_TILING_AUTO},
+	{0}
+};
+
 /* Set defaults that depend on the target.
  * In particular, set --schedule-outer-coincidence iff target is a GPU.
  */
@@ -59,6 +65,9 @@ ISL_ARG_BOOL(struct ppcg_debug_options, dump_final_schedule, 0,
 ISL_ARG_BOOL(struct ppcg_debug_options, dump_sizes, 0,
 	"dump-sizes", 0,
 	"dump effectively used per kernel tile, grid and block sizes")
+ISL_ARG_BOOL(struct ppcg_debug_options, dump_transfers, 0,
+	"dump-transfers", 0,
+	"dump boxes of array elements copied to and from the device")
 ISL_ARG_BOOL(struct ppcg_debug_options, verbose, 'v', "verbose", 0, NULL)
 ISL_ARGS_END
 
@@ -75,6 +84,13 @@ ISL_ARG_BOOL(struct ppcg_options, opencl_print_kernel_types, 0,
 	"print definitions of types in the kernel file")
 ISL_ARG_BOOL(struct ppcg_options, opencl_embed_kernel_code, 0,
 	"embed-kernel-code", 0, "embed kernel code into host code")
+ISL_ARG_BOOL(struct ppcg_options, opencl_out_of_order_queue, 0,
+	"out-of-order-queue", 0,
+	"create an out-of-order command queue "
+	"(only useful in combination with --async-transfers)")
+ISL_ARG_STR(struct ppcg_options, opencl_binary_cache, 0, "binary-cache",
+	"dir", NULL, "cache the compiled kernel binaries in <dir> "
+	"such that later runs do not need to rebuild the kernels from source")
 ISL_ARGS_END
 
 ISL_ARGS_START(struct ppcg_options, ppcg_options_args)
@@ -104,13 +120,29 @@ ISL_ARG_BOOL(struct ppcg_options, split_tile, 0, "split-tile", 0,
 	"perform split tiling")
 ISL_ARG_BOOL(struct ppcg_options, rectangle, 0, "rectangle", 0,
 	"perform overlapped tiling")
+ISL_ARG_CHOICE(struct ppcg_options, tiling, 0, "tiling", tiling,
+	PPCG_TILING_MANUAL, "select the kind of tiling for each band "
+	"based on the --tile, --split-tile, --rectangle and --hybrid options "
+	"(manual) or based on an analysis of the dependences (auto)")
 ISL_ARG_BOOL(struct ppcg_options, min_sync, 0, "min-sync", 0,
 	"minimize synchronization when performing split tiling"
 	"(only for C target)")
+ISL_ARG_INT(struct ppcg_options, phase_parallelism, 0, "phase-parallelism",
+	"n", 0, "when minimizing synchronization, only enlarge the time tile "
+	"as long as each phase of split tiling keeps at least n tiles "
+	"(0: no minimum)")
 ISL_ARG_BOOL(struct ppcg_options, isolate_expanded_points, 0, "isolate-expanded-points",
 	0, "isolate expanded point loops from original points (overlapped tiling)")
+ISL_ARG_INT(struct ppcg_options, max_overlapped_redundancy, 0,
+	"max-overlapped-redundancy", "percentage", 0,
+	"reduce the time tile size of overlapped tiling until the number of "
+	"redundantly computed points per tile is at most this percentage "
+	"of the original number of points (0: no maximum)")
 ISL_ARG_BOOL(struct ppcg_options, multi_level_overlapped, 0, "multi-level-overlapped",
 	0, "perform multi-level overlapped (overlapped tiling for GPU targets)")
+ISL_ARG_BOOL(struct ppcg_options, warp_overlapped, 0, "warp-overlapped",
+	0, "map each overlapped tile to a single warp and synchronize "
+	"at warp level (overlapped tiling for CUDA target)")
 ISL_ARG_STR(struct ppcg_options, tile_sizes, 0, "tile-sizes", "tile-sizes", NULL,
 	"tile sizes (for different sizes)")
 ISL_ARG_INT(struct ppcg_options, tile_size, 'S', "tile-size", "size", 32, NULL)
@@ -120,6 +152,9 @@ ISL_ARG_STR(struct ppcg_options, sizes, 0, "sizes", "sizes", NULL,
 	"Per kernel tile, grid and block sizes")
 ISL_ARG_INT(struct ppcg_options, max_shared_memory, 0,
 	"max-shared-memory", "size", 8192, "maximal amount of shared memory")
+ISL_ARG_STR(struct ppcg_options, device, 0, "device", "file", NULL,
+	"description of the target device, used for selecting tile and "
+	"block sizes that maximize occupancy (GPU targets)")
 ISL_ARG_BOOL(struct ppcg_options, openmp, 0, "openmp", 0,
 	"Generate OpenMP macros (only for C target)")
 ISL_ARG_USER_OPT_CHOICE(struct ppcg_options, target, 0, "target", target,
@@ -135,13 +170,46 @@ ISL_ARG_BOOL(struct ppcg_options, live_range_reordering, 0,
 	"live-range-reordering", 1,
 	"allow successive live ranges on the same memory element "
 	"to be reordered")
+ISL_ARG_BOOL(struct ppcg_options, reductions, 0, "reductions", 0,
+	"detect updates of scalars with an associative and commutative "
+	"operator and parallelize loops that only carry dependences "
+	"between such updates using reduction clauses (C target)")
 ISL_ARG_BOOL(struct ppcg_options, hybrid, 0, "hybrid", 0,
 	"apply hybrid tiling whenever a suitable input pattern is found "
 	"(GPU targets)")
 ISL_ARG_BOOL(struct ppcg_options, unroll_copy_shared, 0, "unroll-copy-shared",
 	0, "unroll code for copying to/from shared memory")
+ISL_ARG_BOOL(struct ppcg_options, double_buffer_shared, 0,
+	"double-buffer-shared", 0,
+	"use two shared memory buffers for read-only tiles such that "
+	"the next tile is loaded while the current one is being used")
+ISL_ARG_BOOL(struct ppcg_options, vector_copies, 0, "vector-copies", 0,
+	"use aligned 16 byte vector accesses for copying contiguous "
+	"array tiles to shared memory")
+ISL_ARG_BOOL(struct ppcg_options, pad_shared, 0, "pad-shared-memory", 1,
+	"pad the innermost dimension of shared memory tiles "
+	"to avoid bank conflicts")
 ISL_ARG_BOOL(struct ppcg_options, unroll_gpu_tile, 0, "unroll-gpu-tile", 0,
 	"unroll code inside tile on GPU targets")
+ISL_ARG_INT(struct ppcg_options, thread_coarsening, 0, "thread-coarsening",
+	"factor", 1, "number of points computed by each thread "
+	"in each thread dimension (GPU targets)")
+ISL_ARG_BOOL(struct ppcg_options, fuse_kernels, 0, "fuse-kernels", 0,
+	"fuse adjacent kernels with the same grid that only depend "
+	"on each other within a single thread (GPU targets)")
+ISL_ARG_BOOL(struct ppcg_options, async_transfers, 0, "async-transfers", 0,
+	"use asynchronous transfers such that "
+	"host-device transfers can overlap with kernel execution "
+	"(CUDA and OpenCL targets)")
+ISL_ARG_BOOL(struct ppcg_options, sub_box_transfers, 0, "sub-box-transfers",
+	0, "only copy the rectangular hull of the accessed array elements "
+	"to and from the device instead of entire arrays")
+ISL_ARG_BOOL(struct ppcg_options, persistent_arrays, 0, "persistent-arrays",
+	0, "keep device copies of arrays across scops and only transfer them "
+	"when needed (CUDA target)")
+ISL_ARG_BOOL(struct ppcg_options, instrument, 0, "instrument", 0,
+	"measure the time spent in each kernel and transfer (GPU targets) "
+	"or outermost parallel loop (C target) and print a table at exit")
 ISL_ARG_GROUP("opencl", &ppcg_opencl_options_args, "OpenCL options")
 ISL_ARG_STR(struct ppcg_options, save_schedule_file, 0, "save-schedule",
 	"file", NULL, "save isl computed schedule to <file>")
@@ -9,6 +9,7 @@ struct ppcg_debug_options {
 	int dump_schedule;
 	int dump_final_schedule;
 	int dump_sizes;
+	int dump_transfers;
 	int verbose;
 };
 
@@ -36,18 +37,33 @@ struct ppcg_options {
 	/* Perform split tiling. */
 	int split_tile;
 	int min_sync;
+	/* Minimal number of tiles in each phase of split tiling
+	 * when enlarging the time tile for "min_sync" (0: no minimum).
+	 */
+	int phase_parallelism;
 	char *tile_sizes;
 
 	/* Perform overlapped tiling. */
 	int rectangle;
 	int scalene;
 
+	/* Kind of tiling selection (PPCG_TILING_MANUAL or PPCG_TILING_AUTO). */
+	int tiling;
+
 	/* Isolate expanded points from original points. */
 	int isolate_expanded_points;
 
+	/* Maximal percentage of redundant points per overlapped tile
+	 * (0: no maximum).
+	 */
+	int max_overlapped_redundancy;
+
 	/* Perform multi-level overlapped tiling on GPUs*/\
 	int multi_level_overlapped;
 
+	/* Map each overlapped tile to a single warp on GPUs. */
+	int warp_overlapped;
+
 	/* Isolate full tiles from partial tiles. */
 	int isolate_full_tiles;
 
@@ -60,6 +76,9 @@ struct ppcg_options {
 	/* Maximal amount of shared memory. */
 	int max_shared_memory;
 
+	/* Name of file describing the target device. */
+	char *device;
+
 	/* The target we generate code for. */
 	int target;
 
@@ -75,13 +94,43 @@ struct ppcg_options {
 	/* Allow live range to be reordered. */
 	int live_range_reordering;
 
+	/* Parallelize loops that only carry reduction dependences. */
+	int reductions;
+
 	/* Allow hybrid tiling whenever a suitable input pattern is found. */
 	int hybrid;
 
 	/* Unroll the code for copying to/from shared memory. */
 	int unroll_copy_shared;
+	/* Double buffer read-only shared memory tiles. */
+	int double_buffer_shared;
+	/* Use vector accesses for copying to shared memory. */
+	int vector_copies;
+	/* Pad shared memory tiles to avoid bank conflicts. */
+	int pad_shared;
 	/* Unroll code inside tile on GPU targets. */
 	int unroll_gpu_tile;
+	/* Default number of points computed by a thread
+	 * in each thread dimension.
+	 */
+	int thread_coarsening;
+
+	/* Fuse adjacent kernels with the same grid that only depend
+	 * on each other within a single thread.
+	 */
+	int fuse_kernels;
+
+	/* Overlap host-device transfers with kernel execution. */
+	int async_transfers;
+	/* Only copy the rectangular hull of the accessed array elements. */
+	int sub_box_transfers;
+	/* Keep device copies of arrays across scops. */
+	int persistent_arrays;
+
+	/* Measure the time spent in kernels, transfers and
+	 * outermost parallel loops in the generated code.
+	 */
+	int instrument;
 
 	/* Options to pass to the OpenCL compiler.  */
 	char *opencl_compiler_options;
@@ -95,6 +144,10 @@ struct ppcg_options {
 	int opencl_print_kernel_types;
 	/* Embed OpenCL kernel code in host code. */
 	int opencl_embed_kernel_code;
+	/* Create an out-of-order command queue. */
+	int opencl_out_of_order_queue;
+	/* Directory for caching compiled kernel binaries or NULL. */
+	char *opencl_binary_cache;
 
 	/* Name of file for saving isl computed schedule or NULL. */
 	char *save_schedule_file;
@@ -110,6 +163,9 @@ ISL_ARG_DECL(ppcg_options, struct ppcg_options, ppcg_options_args)
 #define		PPCG_TARGET_CUDA	1
 #define		PPCG_TARGET_OPENCL      2
 
+#define		PPCG_TILING_MANUAL	0
+#define		PPCG_TILING_AUTO	1
+
 void ppcg_options_set_target_defaults(struct ppcg_options *options);
 
 #endif
@@ -35,6 +35,36 @@ __isl_give isl_printer *ppcg_end_block(__isl_take isl_printer *p)
 	return p;
 }
 
+/* Print a call that records the start of an instrumented region
+ * in the code generated for the --instrument option.
+ */
+__isl_give isl_printer *ppcg_print_instrument_start(__isl_take isl_printer *p)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "ppcg_instrument_start();");
+	p = isl_printer_end_line(p);
+	return p;
+}
+
+/* Print a call that records the end of the instrumented region
+ * called "prefix" followed by "name", or by "id" if "name" is NULL,
+ * in the code generated for the --instrument option.
+ */
+__isl_give isl_printer *ppcg_print_instrument_stop(__isl_take isl_printer *p,
+	const char *prefix, const char *name, int id)
+{
+	p = isl_printer_start_line(p);
+	p = isl_printer_print_str(p, "ppcg_instrument_stop(\"");
+	p = isl_printer_print_str(p, prefix);
+	if (name)
+		p = isl_printer_print_str(p, name);
+	else
+		p = isl_printer_print_int(p, id);
+	p = isl_printer_print_str(p, "\");");
+	p = isl_printer_end_line(p);
+	return p;
+}
+
 /* Names of notes that keep track of whether min/max
  * macro definitions have already been printed.
  */
@@ -12,6 +12,10 @@ extern const char *ppcg_fdiv_q;
 __isl_give isl_printer *ppcg_start_block(__isl_take isl_printer *p);
 __isl_give isl_printer *ppcg_end_block(__isl_take isl_printer *p);
 
+__isl_give isl_printer *ppcg_print_instrument_start(__isl_take isl_printer *p);
+__isl_give isl_printer *ppcg_print_instrument_stop(__isl_take isl_printer *p,
+	const char *prefix, const char *name, int id);
+
 __isl_give isl_printer *ppcg_set_macro_names(__isl_take isl_printer *p);
 __isl_give isl_printer *ppcg_set_macros(__isl_take isl_printer *p,
 	const char *min, const char *max);
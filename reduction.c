@@ -0,0 +1,217 @@
+#include <string.h>
+
+#include <isl/ctx.h>
+#include <isl/id.h>
+#include <isl/aff.h>
+#include <isl/set.h>
+#include <isl/map.h>
+#include <isl/union_map.h>
+
+#include "reduction.h"
+
+/* Return the OpenMP reduction operator corresponding to
+ * the compound assignment operator "op" or
+ * to the binary operator "op" if "binary" is set.
+ * Return NULL if "op" does not correspond to a reduction operator.
+ *
+ * Note that "s -= e" is a reduction with operator "+"
+ * since the partial results need to be added.
+ */
+static const char *reduction_op(enum pet_op_type op, int binary)
+{
+	if (binary) {
+		switch (op) {
+		case pet_op_add:	return "+";
+		case pet_op_mul:	return "*";
+		case pet_op_and:	return "&";
+		case pet_op_xor:	return "^";
+		case pet_op_or:		return "|";
+		default:		return NULL;
+		}
+	}
+
+	switch (op) {
+	case pet_op_add_assign:	return "+";
+	case pet_op_sub_assign:	return "+";
+	case pet_op_mul_assign:	return "*";
+	case pet_op_and_assign:	return "&";
+	case pet_op_xor_assign:	return "^";
+	case pet_op_or_assign:	return "|";
+	default:		return NULL;
+	}
+}
+
+/* Is "expr" an access to the scalar "var"?
+ * If "var" is NULL, then check if "expr" is an access to any scalar.
+ */
+static int is_scalar_access(__isl_keep pet_expr *expr, __isl_keep isl_id *var)
+{
+	int scalar;
+	isl_id *id;
+	isl_multi_pw_aff *index;
+
+	if (pet_expr_get_type(expr) != pet_expr_access)
+		return 0;
+	index = pet_expr_access_get_index(expr);
+	scalar = index && isl_multi_pw_aff_dim(index, isl_dim_out) == 0 &&
+		isl_multi_pw_aff_has_tuple_id(index, isl_dim_out);
+	isl_multi_pw_aff_free(index);
+	if (!scalar || !var)
+		return scalar;
+	id = pet_expr_access_get_id(expr);
+	isl_id_free(id);
+	return id == var;
+}
+
+/* pet_expr_foreach_access_expr callback that aborts the traversal
+ * if "expr" writes to some element or accesses the variable "user".
+ */
+static int check_operand_access(__isl_keep pet_expr *expr, void *user)
+{
+	isl_id *var = user;
+	isl_id *id;
+
+	if (pet_expr_access_is_write(expr))
+		return -1;
+	id = pet_expr_access_get_id(expr);
+	isl_id_free(id);
+	return id == var ? -1 : 0;
+}
+
+/* Is "operand" a valid operand of a reduction on "var"?
+ * That is, does it not access "var" and does it not write
+ * to anything?
+ */
+static int is_reduction_operand(__isl_keep pet_expr *operand,
+	__isl_keep isl_id *var)
+{
+	return pet_expr_foreach_access_expr(operand, &check_operand_access,
+						var) >= 0;
+}
+
+/* Is "stmt" a reduction, i.e., an associative and commutative
+ * update of a scalar variable, of the form
+ *
+ *	s op= e;
+ * or
+ *	s = s op e;	s = e op s;
+ *
+ * with "op" one of +, *, &, ^ or | (or of the form s -= e) and
+ * "e" an expression that does not access "s" and that has no side effects
+ * on any accessed variable?
+ * If so, return the OpenMP reduction operator and
+ * set *var to the identifier of "s".
+ * Otherwise, return NULL.
+ *
+ * Since the statement only writes to "s" and reads "s" only once,
+ * all dependences between instances of such statements
+ * that update the same variable with the same operator
+ * are due to the update and can be ignored if the updates
+ * are performed in a different order.
+ */
+const char *ppcg_stmt_reduction(struct pet_stmt *stmt, __isl_give isl_id **var)
+{
+	pet_expr *expr, *lhs = NULL, *rhs = NULL, *operand = NULL;
+	const char *op = NULL;
+	isl_id *id = NULL;
+
+	*var = NULL;
+	if (!stmt || stmt->n_arg > 0 ||
+	    pet_tree_get_type(stmt->body) != pet_tree_expr)
+		return NULL;
+	expr = pet_tree_expr_get_expr(stmt->body);
+	if (!expr || pet_expr_get_type(expr) != pet_expr_op ||
+	    pet_expr_get_n_arg(expr) != 2)
+		goto done;
+
+	lhs = pet_expr_get_arg(expr, 0);
+	rhs = pet_expr_get_arg(expr, 1);
+	if (!is_scalar_access(lhs, NULL))
+		goto done;
+	id = pet_expr_access_get_id(lhs);
+
+	if (pet_expr_op_get_type(expr) != pet_op_assign) {
+		op = reduction_op(pet_expr_op_get_type(expr), 0);
+		operand = pet_expr_copy(rhs);
+	} else if (pet_expr_get_type(rhs) == pet_expr_op &&
+		   pet_expr_get_n_arg(rhs) == 2) {
+		pet_expr *arg0, *arg1;
+
+		op = reduction_op(pet_expr_op_get_type(rhs), 1);
+		arg0 = pet_expr_get_arg(rhs, 0);
+		arg1 = pet_expr_get_arg(rhs, 1);
+		if (is_scalar_access(arg0, id))
+			operand = pet_expr_copy(arg1);
+		else if (is_scalar_access(arg1, id))
+			operand = pet_expr_copy(arg0);
+		pet_expr_free(arg0);
+		pet_expr_free(arg1);
+	}
+
+	if (!op || !operand || !is_reduction_operand(operand, id))
+		op = NULL;
+done:
+	pet_expr_free(operand);
+	pet_expr_free(lhs);
+	pet_expr_free(rhs);
+	pet_expr_free(expr);
+	if (op)
+		*var = id;
+	else
+		isl_id_free(id);
+	return op;
+}
+
+/* Return the dependences in "dep" between instances of reduction
+ * statements in "scop" (according to ppcg_stmt_reduction) that
+ * update the same variable with the same operator.
+ * These dependences only enforce the order in which the updates
+ * are performed.
+ */
+__isl_give isl_union_map *ppcg_reduction_dependences(struct pet_scop *scop,
+	__isl_keep isl_union_map *dep)
+{
+	int i, j;
+	const char **op;
+	isl_id **var;
+	isl_ctx *ctx;
+	isl_union_map *pairs;
+
+	if (!scop || !dep)
+		return NULL;
+
+	ctx = isl_union_map_get_ctx(dep);
+	op = isl_calloc_array(ctx, const char *, scop->n_stmt);
+	var = isl_calloc_array(ctx, isl_id *, scop->n_stmt);
+	if (scop->n_stmt && (!op || !var))
+		goto error;
+
+	for (i = 0; i < scop->n_stmt; ++i)
+		op[i] = ppcg_stmt_reduction(scop->stmts[i], &var[i]);
+
+	pairs = isl_union_map_empty(isl_union_map_get_space(dep));
+	for (i = 0; i < scop->n_stmt; ++i) {
+		for (j = 0; j < scop->n_stmt; ++j) {
+			isl_map *pair;
+
+			if (!op[i] || !op[j] || var[i] != var[j] ||
+			    strcmp(op[i], op[j]))
+				continue;
+			pair = isl_map_from_domain_and_range(
+				    isl_set_copy(scop->stmts[i]->domain),
+				    isl_set_copy(scop->stmts[j]->domain));
+			pairs = isl_union_map_add_map(pairs, pair);
+		}
+	}
+
+	for (i = 0; i < scop->n_stmt; ++i)
+		isl_id_free(var[i]);
+	free(op);
+	free(var);
+
+	return isl_union_map_intersect(isl_union_map_copy(dep), pairs);
+error:
+	free(op);
+	free(var);
+	return NULL;
+}
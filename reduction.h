@@ -0,0 +1,13 @@
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include <isl/id.h>
+#include <isl/union_map.h>
+#include <pet.h>
+
+const char *ppcg_stmt_reduction(struct pet_stmt *stmt,
+	__isl_give isl_id **var);
+__isl_give isl_union_map *ppcg_reduction_dependences(struct pet_scop *scop,
+	__isl_keep isl_union_map *dep);
+
+#endif
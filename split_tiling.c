@@ -22,14 +22,30 @@
 #include "split_tiling.h"
 #include "util.h"
 
-/* Obtain the lexicographically minimum tile of the iteration domain of "node".
- * The input node "node" should have applied parallelogram tiling.
+/* Return a sample point of "set" for some values of the parameters
+ * that satisfy the constraints in "context".
+ * The parameters are projected out such that the result
+ * does not depend on the parameters.
  */
-static __isl_give isl_point *split_tile_obtain_source_tile(__isl_keep isl_schedule_node *node)
+static __isl_give isl_point *sample_point_in_context(
+	__isl_take isl_union_set *set, __isl_keep isl_set *context)
 {
 	int n;
-	isl_point *result;
-	isl_set *params;
+
+	set = isl_union_set_intersect_params(set, isl_set_copy(context));
+	n = isl_union_set_dim(set, isl_dim_param);
+	set = isl_union_set_project_out(set, isl_dim_param, 0, n);
+
+	return isl_union_set_sample_point(set);
+}
+
+/* Obtain the lexicographically minimum tile of the iteration domain of "node"
+ * for some values of the parameters in "context".
+ * The input node "node" should have applied parallelogram tiling.
+ */
+static __isl_give isl_point *split_tile_obtain_source_tile(
+	__isl_keep isl_schedule_node *node, __isl_keep isl_set *context)
+{
 	isl_union_set *domain, *tile;
 	isl_union_map *schedule;
 
@@ -42,16 +58,7 @@ static __isl_give isl_point *split_tile_obtain_source_tile(__isl_keep isl_schedu
 	tile = isl_union_set_apply(domain, schedule);
 	tile = isl_union_set_lexmin(tile);
 
-	params = isl_union_set_params(isl_union_set_copy(tile));
-	tile = isl_union_set_gist_params(tile, params);
-	
-	//TODO: non-continuous parameter dims
-	n = isl_union_set_dim(tile, isl_dim_param);
-	tile = isl_union_set_project_out(tile, isl_dim_param, 0, n);
-
-	result = isl_union_set_sample_point(tile);
-
-	return result;
+	return sample_point_in_context(tile, context);
 }
 
 /* Obtain the lexicographically minimum point of those covered by
@@ -59,12 +66,11 @@ static __isl_give isl_point *split_tile_obtain_source_tile(__isl_keep isl_schedu
  * the original iteration domain. The result should be a point
  * that may be lexicographically smaller than the minimum point
  * of the original iteration domain.
+ * The point is taken for some values of the parameters in "context".
  */
-static __isl_give isl_point *split_tile_obtain_source_point(__isl_keep isl_schedule_node *node)
+static __isl_give isl_point *split_tile_obtain_source_point(
+	__isl_keep isl_schedule_node *node, __isl_keep isl_set *context)
 {
-	int n;
-	isl_set *params;
-	isl_point *result;
 	isl_union_set *domain, *tile, *points;
 	isl_union_map *schedule;
 
@@ -82,52 +88,55 @@ static __isl_give isl_point *split_tile_obtain_source_point(__isl_keep isl_sched
 	points = isl_union_set_apply(tile, schedule);
 	points = isl_union_set_lexmin(points);
 
-	params = isl_union_set_params(isl_union_set_copy(points));
-	points = isl_union_set_gist_params(points, params);
-	
-	//TODO: non-continuous parameter dims
-	n = isl_union_set_dim(points, isl_dim_param);
-	points = isl_union_set_project_out(points, isl_dim_param, 0, n);
-
-	result = isl_union_set_sample_point(points);
-	
-	return result;
+	return sample_point_in_context(points, context);
 }
 
-/* Obtain the time dimension size of input "domain". This size
+/* Obtain an upper bound on the time dimension size of input "domain"
+ * over the values of the parameters in "context". This size
  * should be compared with parallelogram tiling size. In case
  * the parallelogram tiling size is greater than this size,
- * this size should be used to compute the power of flow dep.  
+ * this size should be used to compute the power of flow dep.
+ *
+ * The size is computed symbolically as the number of values
+ * attained by the first dimension of any statement in "domain".
+ * Return INT32_MAX if this number is not bounded by "context".
  */
-static int obtain_time_dim_size(__isl_keep isl_union_set *domain)
+static int obtain_time_dim_size(__isl_keep isl_union_set *domain,
+	__isl_keep isl_set *context)
 {
-	int bound;
-	isl_val *ub, *lb;
-	isl_point *max, *min;
-	isl_union_set *points;
+	int i, n, bound;
+	isl_val *max;
+	isl_set *time;
+	isl_set_list *list;
 
 	if(!domain)
 		return -1;
 
-	points = isl_union_set_lexmax(isl_union_set_copy(domain));
-	max = isl_union_set_sample_point(points);
-	ub = isl_point_get_coordinate_val(max, isl_dim_set, 0);
-
-	points = isl_union_set_lexmin(isl_union_set_copy(domain));
-	min = isl_union_set_sample_point(points);
-	lb = isl_point_get_coordinate_val(min, isl_dim_set, 0);
+	time = isl_set_empty(isl_space_set_alloc(isl_set_get_ctx(context), 0, 1));
+	list = isl_union_set_get_set_list(domain);
+	n = isl_set_list_n_set(list);
+	for (i = 0; i < n; i++) {
+		isl_set *set;
 
-	bound = isl_val_get_num_si(ub) - isl_val_get_num_si(lb);
-	
-	isl_point_free(max);
-	isl_point_free(min);
-	isl_val_free(ub);
-	isl_val_free(lb);
+		set = isl_set_list_get_set(list, i);
+		set = isl_set_project_out(set, isl_dim_set, 1,
+					isl_set_dim(set, isl_dim_set) - 1);
+		set = isl_set_reset_tuple_id(set);
+		time = isl_set_union(time, set);
+	}
+	isl_set_list_free(list);
+	time = isl_set_intersect_params(time, isl_set_copy(context));
 
-	if(!bound)
-		return INT32_MAX;
+	max = ppcg_pw_aff_max_val(ppcg_set_dim_extent(time, 0));
+	if (!max)
+		return -1;
+	if (isl_val_is_int(max))
+		bound = isl_val_get_num_si(max);
+	else
+		bound = INT32_MAX;
+	isl_val_free(max);
 
-	return bound + 1;
+	return bound;
 }
 
 /* Compute the dependence along time dimension for one iteration within
@@ -169,9 +178,8 @@ static __isl_give isl_union_map *compute_whole_iteration_dependence(__isl_take i
 static int split_tile_compute_dependence(__isl_keep isl_schedule_node *node,
 	__isl_keep isl_point *point, struct ppcg_scop *scop)
 {
-	int n_stmt, n, size, factor;
+	int n_stmt, size, factor;
 	isl_val *val, *val0, *val1, *val2, *val3;
-	isl_set *params;
 	isl_point *pnt0, *pnt1;
 	isl_union_set *domain, *source, *sink, *universe;
 	isl_union_map *dependence;
@@ -187,18 +195,15 @@ static int split_tile_compute_dependence(__isl_keep isl_schedule_node *node,
 		dependence = compute_whole_iteration_dependence(dependence, universe);
 	}
 	
-	params = isl_union_map_params(isl_union_map_copy(dependence));
-	dependence = isl_union_map_gist_params(dependence, params);
+	dependence = isl_union_map_gist_params(dependence,
+					isl_set_copy(scop->context));
 	dependence = isl_union_map_gist_domain(dependence, isl_union_set_copy(domain));
 	dependence = isl_union_map_gist_range(dependence, domain);
 	
 	pnt0 = isl_union_set_sample_point(isl_union_set_copy(source));
 	sink = isl_union_set_apply(source, dependence);
 	sink = isl_union_set_lexmax(sink);
-	//TODO: non-continuous parameter dims
-	n = isl_union_set_dim(sink, isl_dim_param);
-	sink = isl_union_set_project_out(sink, isl_dim_param, 0, n);
-	pnt1 = isl_union_set_sample_point(sink);
+	pnt1 = sample_point_in_context(sink, scop->context);
 
 	val0 = isl_point_get_coordinate_val(pnt0, isl_dim_set, 1);
 	val1 = isl_point_get_coordinate_val(pnt1, isl_dim_set, 1);
@@ -275,7 +280,6 @@ static int split_tile_compute_space_dependence(__isl_keep isl_schedule_node *nod
 {
 	int i, j, n_stmt, n, m, shift;
 	isl_ctx *ctx;
-	isl_set *params;
 	isl_union_set *domain;
 	isl_union_map *dependence;
 	isl_basic_map_list *space_dep_bmap_list;
@@ -290,8 +294,8 @@ static int split_tile_compute_space_dependence(__isl_keep isl_schedule_node *nod
 		return shift;
 
 	dependence = isl_union_map_copy(scop->dep_flow);
-	params = isl_union_map_params(isl_union_map_copy(dependence));
-	dependence = isl_union_map_gist_params(dependence, params);
+	dependence = isl_union_map_gist_params(dependence,
+					isl_set_copy(scop->context));
 	dependence = isl_union_map_gist_domain(dependence, isl_union_set_copy(domain));
 	dependence = isl_union_map_gist_range(dependence, domain);
 
@@ -328,13 +332,12 @@ static int split_tile_compute_space_dependence(__isl_keep isl_schedule_node *nod
 	return shift;
 }
 
-/* Obtain the lexicographically maximum tile of the input "dependence".
+/* Obtain the lexicographically maximum tile of the input "dependence"
+ * for some values of the parameters in "context".
  */
 static __isl_give isl_point *split_tile_obtain_sink_tile(__isl_keep isl_schedule_node *node,
-	__isl_keep isl_point *point)
+	__isl_keep isl_point *point, __isl_keep isl_set *context)
 {
-	int n;
-	isl_point *result;
 	isl_union_set *tile;
 	isl_union_map *schedule;
 
@@ -344,12 +347,8 @@ static __isl_give isl_point *split_tile_obtain_sink_tile(__isl_keep isl_schedule
 	schedule = isl_schedule_node_band_get_partial_schedule_union_map(node);
 	tile = isl_union_set_from_point(isl_point_copy(point));
 	tile = isl_union_set_apply(tile, schedule);
-	//TODO: non-continuous parameter dims
-	n = isl_union_set_dim(tile, isl_dim_param);
-	tile = isl_union_set_project_out(tile, isl_dim_param, 0, n);
-	result = isl_union_set_sample_point(tile);
 
-	return result;
+	return sample_point_in_context(tile, context);
 }
 
 /* Obtain the lexicographically maximum point of the input "dependence".
@@ -1034,6 +1033,145 @@ static void *split_tile_construct_phases(__isl_keep isl_union_set_list *phases,
 	return phases;
 }
 
+/* Return an upper bound on the number of tiles of size "size"
+ * along member "pos" of the band node "node"
+ * for the values of the parameters in "context",
+ * or INT32_MAX if the number of tiles is not bounded by "context".
+ * Return -1 on error.
+ */
+static int n_tiles_along_member(__isl_keep isl_schedule_node *node, int pos,
+	int size, __isl_keep isl_set *context)
+{
+	int n;
+	isl_multi_union_pw_aff *mupa;
+	isl_union_pw_aff *upa;
+	isl_union_set *domain;
+	isl_set *range;
+	isl_val *max;
+	isl_bool empty;
+
+	domain = isl_schedule_node_get_domain(node);
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	upa = isl_multi_union_pw_aff_get_union_pw_aff(mupa, pos);
+	isl_multi_union_pw_aff_free(mupa);
+	domain = isl_union_set_apply(domain,
+				isl_union_map_from_union_pw_aff(upa));
+	empty = isl_union_set_is_empty(domain);
+	if (empty < 0 || empty) {
+		isl_union_set_free(domain);
+		return empty < 0 ? -1 : 0;
+	}
+	range = isl_set_from_union_set(domain);
+	range = isl_set_intersect_params(range, isl_set_copy(context));
+
+	max = ppcg_pw_aff_max_val(ppcg_set_dim_extent(range, 0));
+	if (!max)
+		return -1;
+	if (isl_val_is_infty(max))
+		n = INT32_MAX;
+	else
+		n = (isl_val_get_num_si(max) + size - 1) / size + 1;
+	isl_val_free(max);
+
+	return n;
+}
+
+/* Estimate the number of phases of split tiling the band node "node"
+ * with time tile size "time_size" and space tile size "size",
+ * given that the dependences move "factor" positions along
+ * the second statement dimension per time step.
+ * The estimate is derived from the distance along the second member
+ * of the (untiled) band between the lexmin point "point" and
+ * the point that depends on it "time_size - 1" time steps later,
+ * in the same way split_tile derives the actual number of phases
+ * from the tiles containing these two points.
+ */
+static int estimate_n_phase(__isl_keep isl_schedule_node *node,
+	__isl_keep isl_point *point, int factor, int time_size, int size,
+	__isl_keep isl_set *context)
+{
+	int d;
+	isl_point *sink, *p0, *p1;
+	isl_val *v0, *v1;
+
+	sink = split_tile_obtain_sink_point(isl_point_copy(point),
+					time_size - 1, factor);
+	p0 = split_tile_obtain_sink_tile(node, point, context);
+	p1 = split_tile_obtain_sink_tile(node, sink, context);
+	v0 = isl_point_get_coordinate_val(p0, isl_dim_set, 1);
+	v1 = isl_point_get_coordinate_val(p1, isl_dim_set, 1);
+	d = isl_val_get_num_si(v1) - isl_val_get_num_si(v0);
+	if (d < 0)
+		d = -d;
+
+	isl_val_free(v0);
+	isl_val_free(v1);
+	isl_point_free(p0);
+	isl_point_free(p1);
+	isl_point_free(sink);
+
+	return (d + size - 1) / size + 1;
+}
+
+/* Choose the size of the time tile for split tiling the band node "node"
+ * with the aim of minimizing synchronization, given that the time
+ * dimension has at most "bound" (different from INT32_MAX) iterations.
+ *
+ * Each time tile requires a synchronization after each of its phases,
+ * so the number of synchronizations is minimized by covering
+ * the entire time dimension by a single time tile.
+ * However, the number of phases grows with the size of the time tile,
+ * reducing the number of tiles that can be executed concurrently
+ * within each phase.  If the "phase_parallelism" option is set,
+ * then the time tile (starting from the entire time dimension and
+ * halving the size each time) is only enlarged beyond the time tile size
+ * in "sizes" as long as the number of tiles along the space dimension
+ * divided by the estimated number of phases is at least
+ * the value of this option.
+ */
+static int choose_time_tile_size(__isl_keep isl_schedule_node *node,
+	struct ppcg_scop *scop, __isl_keep isl_multi_val *sizes, int bound)
+{
+	int time_size, size, n_tiles, factor;
+	int min = scop->options->phase_parallelism;
+	isl_val *v;
+	isl_point *point;
+
+	v = isl_multi_val_get_val(sizes, 0);
+	time_size = isl_val_get_num_si(v);
+	isl_val_free(v);
+	if (min <= 0 || bound <= time_size)
+		return bound;
+
+	v = isl_multi_val_get_val(sizes, 1);
+	size = isl_val_get_num_si(v);
+	isl_val_free(v);
+	n_tiles = n_tiles_along_member(node, 1, size, scop->context);
+	if (n_tiles < 0)
+		return -1;
+	if (n_tiles == INT32_MAX)
+		return bound;
+
+	point = split_tile_obtain_source_point(node, scop->context);
+	if (!point)
+		return -1;
+	factor = split_tile_compute_dependence(node, point, scop);
+
+	for (; bound > time_size; bound = (bound + 1) / 2) {
+		int n_phase;
+
+		n_phase = estimate_n_phase(node, point, factor, bound, size,
+					scop->context);
+		if (n_tiles / n_phase >= min)
+			break;
+	}
+	isl_point_free(point);
+
+	if (bound < time_size)
+		bound = time_size;
+	return bound;
+}
+
 /* Split tiling. We first apply parallelogram tiling on the band node,
  * followed by constructing the fixed power of flow dependence, slope of
  * dependence across tiles along the same time tile band, and introduced
@@ -1063,7 +1201,7 @@ __isl_give isl_schedule_node *split_tile(__isl_take isl_schedule_node *node,
 	n_stmt = isl_union_set_n_set(domain);
 
 	//compute the bound of time dimension
-	bound = obtain_time_dim_size(domain);
+	bound = obtain_time_dim_size(domain, scop->context);
 	printf("####################time bound=%d####################\n", bound);
 
 	//compute size along time dimension
@@ -1072,6 +1210,13 @@ __isl_give isl_schedule_node *split_tile(__isl_take isl_schedule_node *node,
 
 	//minimize synchronization by enlarging the time tiling 
 	if(scop->options->min_sync && bound != INT32_MAX){
+		bound = choose_time_tile_size(node, scop, sizes, bound);
+		if (bound < 0) {
+			isl_union_set_free(domain);
+			isl_val_free(v0);
+			isl_multi_val_free(sizes);
+			return isl_schedule_node_free(node);
+		}
 		delta = bound - 1;
 		v1 = isl_val_int_from_si(ctx, bound);
 		sizes = isl_multi_val_set_val(sizes, 0, v1);
@@ -1084,12 +1229,12 @@ __isl_give isl_schedule_node *split_tile(__isl_take isl_schedule_node *node,
 	node = isl_schedule_node_band_tile(node, copy_sizes);
 	
 	//. obtain the lexmin tile
-	source_tile = split_tile_obtain_source_tile(node);
+	source_tile = split_tile_obtain_source_tile(node, scop->context);
 	printf("####################source_tile####################\n");
 	isl_point_dump(source_tile);
 	
 	//obtain the lexmin point of the lexmin tile
-	source_point = split_tile_obtain_source_point(node);
+	source_point = split_tile_obtain_source_point(node, scop->context);
 	printf("####################source point####################\n");
 	isl_point_dump(source_point);
 	
@@ -1109,7 +1254,8 @@ __isl_give isl_schedule_node *split_tile(__isl_take isl_schedule_node *node,
 	isl_point_dump(sink_point);
 
 	//obtain the tile of the lexmax sink
-	sink_tile = split_tile_obtain_sink_tile(node, sink_point);
+	sink_tile = split_tile_obtain_sink_tile(node, sink_point,
+						scop->context);
 	printf("####################sink_tile####################\n");
 	isl_point_dump(sink_tile);
 	
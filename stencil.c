@@ -0,0 +1,347 @@
+#include <stdio.h>
+
+#include <isl/ctx.h>
+#include <isl/space.h>
+#include <isl/val.h>
+#include <isl/aff.h>
+#include <isl/ilp.h>
+#include <isl/set.h>
+#include <isl/map.h>
+#include <isl/union_set.h>
+#include <isl/union_map.h>
+#include <isl/printer.h>
+
+#include "hybrid.h"
+#include "stencil.h"
+
+/* Return the set of dependence distances of the flow dependences
+ * in "scop" between statement instances that reach the band node "node",
+ * with respect to the members of this band, for those dependences
+ * that are not carried by any outer node.
+ * The parameters are projected out such that
+ * distances that depend on the parameters result in an unbounded set.
+ */
+static __isl_give isl_set *band_flow_distances(struct ppcg_scop *scop,
+	__isl_keep isl_schedule_node *node)
+{
+	int i, depth;
+	isl_bool empty;
+	isl_space *space;
+	isl_union_set *domain;
+	isl_union_map *prefix, *partial, *sched, *dep;
+	isl_set *distances;
+
+	domain = isl_schedule_node_get_domain(node);
+	prefix = isl_schedule_node_get_prefix_schedule_union_map(node);
+	partial = isl_schedule_node_band_get_partial_schedule_union_map(node);
+	sched = isl_union_map_flat_range_product(prefix, partial);
+
+	dep = isl_union_map_copy(scop->dep_flow);
+	dep = isl_union_map_intersect_domain(dep, isl_union_set_copy(domain));
+	dep = isl_union_map_intersect_range(dep, domain);
+	dep = isl_union_map_apply_domain(dep, isl_union_map_copy(sched));
+	dep = isl_union_map_apply_range(dep, sched);
+	empty = isl_union_map_is_empty(dep);
+	if (empty < 0 || empty) {
+		isl_union_map_free(dep);
+		if (empty < 0)
+			return NULL;
+		space = isl_schedule_node_band_get_space(node);
+		space = isl_space_drop_dims(space, isl_dim_param, 0,
+				isl_space_dim(space, isl_dim_param));
+		return isl_set_empty(space);
+	}
+	distances = isl_set_from_union_set(isl_union_map_deltas(dep));
+
+	depth = isl_schedule_node_get_schedule_depth(node);
+	for (i = 0; i < depth; ++i)
+		distances = isl_set_fix_si(distances, isl_dim_set, i, 0);
+	distances = isl_set_project_out(distances, isl_dim_set, 0, depth);
+	distances = isl_set_project_out(distances, isl_dim_param, 0,
+				isl_set_dim(distances, isl_dim_param));
+
+	return distances;
+}
+
+/* Is every dependence distance in "distances" carried by
+ * the outermost dimension, i.e., is the first component
+ * of every distance at least one?
+ */
+static isl_bool outer_carries_all(__isl_keep isl_set *distances)
+{
+	isl_set *carried;
+	isl_bool subset;
+
+	carried = isl_set_universe(isl_set_get_space(distances));
+	carried = isl_set_lower_bound_si(carried, isl_dim_set, 0, 1);
+	subset = isl_set_is_subset(distances, carried);
+	isl_set_free(carried);
+
+	return subset;
+}
+
+/* Determine whether the band node "node" represents a stencil computation
+ * based on the flow dependences in "scop" and, if not, set *reason
+ * to a description of why not.
+ *
+ * In particular, the band should have at least two members,
+ * a time dimension followed by one or more space dimensions,
+ * and the flow dependences that are not carried by any outer node
+ * should have distance vectors that are bounded independently
+ * of the parameters (such that the slopes of the dependences
+ * with respect to the time dimension are bounded) and that are
+ * all carried by the time dimension.
+ */
+static isl_bool is_stencil(struct ppcg_scop *scop,
+	__isl_keep isl_schedule_node *node, const char **reason)
+{
+	isl_set *distances;
+	isl_bool empty, carried, bounded;
+
+	if (isl_schedule_node_band_n_member(node) < 2) {
+		*reason = "band has fewer than two members";
+		return isl_bool_false;
+	}
+
+	distances = band_flow_distances(scop, node);
+	empty = isl_set_is_empty(distances);
+	if (empty < 0 || empty) {
+		isl_set_free(distances);
+		*reason = "band does not carry any flow dependences";
+		return empty < 0 ? isl_bool_error : isl_bool_false;
+	}
+
+	bounded = isl_set_is_bounded(distances);
+	carried = outer_carries_all(distances);
+	isl_set_free(distances);
+	if (bounded < 0 || carried < 0)
+		return isl_bool_error;
+	if (!bounded) {
+		*reason = "dependence distances are not constant";
+		return isl_bool_false;
+	}
+	if (!carried) {
+		*reason = "outer band member does not carry all dependences";
+		return isl_bool_false;
+	}
+
+	return isl_bool_true;
+}
+
+/* Check whether the affine expression "aff" (defined over "set")
+ * is a plain affine expression, i.e., one without integer divisions
+ * and with integer coefficients, and, if not, set *user to 0.
+ */
+static isl_stat check_plain_aff(__isl_take isl_set *set,
+	__isl_take isl_aff *aff, void *user)
+{
+	int *plain = user;
+	isl_size n_div;
+	isl_val *d;
+
+	n_div = isl_aff_dim(aff, isl_dim_div);
+	d = isl_aff_get_denominator_val(aff);
+	isl_set_free(set);
+	isl_aff_free(aff);
+	if (n_div < 0 || !d) {
+		isl_val_free(d);
+		return isl_stat_error;
+	}
+	if (n_div != 0 || !isl_val_is_one(d))
+		*plain = 0;
+	isl_val_free(d);
+
+	return isl_stat_ok;
+}
+
+/* Check whether "pa" consists of a single plain affine expression
+ * and, if not, set *user to 0.
+ */
+static isl_stat check_plain_pw_aff(__isl_take isl_pw_aff *pa, void *user)
+{
+	int *plain = user;
+	isl_size n;
+	isl_stat r;
+
+	n = isl_pw_aff_n_piece(pa);
+	if (n < 0) {
+		isl_pw_aff_free(pa);
+		return isl_stat_error;
+	}
+	if (n != 1) {
+		*plain = 0;
+		isl_pw_aff_free(pa);
+		return isl_stat_ok;
+	}
+	r = isl_pw_aff_foreach_piece(pa, &check_plain_aff, user);
+	isl_pw_aff_free(pa);
+
+	return r;
+}
+
+/* Is the partial schedule of each statement in each member
+ * of the band node "node" a single plain affine expression?
+ * Both split tiling and overlapped tiling extract the single
+ * affine expression of each statement and construct the shapes
+ * of the tiles from its coefficients.
+ */
+static isl_bool has_plain_affine_members(__isl_keep isl_schedule_node *node)
+{
+	int i, n;
+	int plain = 1;
+	isl_multi_union_pw_aff *mupa;
+
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	if (!mupa)
+		return isl_bool_error;
+	n = isl_multi_union_pw_aff_dim(mupa, isl_dim_set);
+	for (i = 0; plain && i < n; ++i) {
+		isl_union_pw_aff *upa;
+		isl_stat r;
+
+		upa = isl_multi_union_pw_aff_get_union_pw_aff(mupa, i);
+		r = isl_union_pw_aff_foreach_pw_aff(upa,
+						&check_plain_pw_aff, &plain);
+		isl_union_pw_aff_free(upa);
+		if (r < 0)
+			plain = -1;
+	}
+	isl_multi_union_pw_aff_free(mupa);
+
+	if (plain < 0)
+		return isl_bool_error;
+	return isl_bool_ok(plain);
+}
+
+/* Does the band node "node" have any statement instances
+ * for some values of the parameters that satisfy the context of "scop"?
+ * Both split tiling and overlapped tiling derive the shapes of the tiles
+ * from sample points in the iteration domain of the band.
+ */
+static isl_bool has_instances(struct ppcg_scop *scop,
+	__isl_keep isl_schedule_node *node)
+{
+	isl_union_set *domain;
+	isl_bool empty;
+
+	domain = isl_schedule_node_get_domain(node);
+	domain = isl_union_set_intersect_params(domain,
+						isl_set_copy(scop->context));
+	empty = isl_union_set_is_empty(domain);
+	isl_union_set_free(domain);
+
+	return isl_bool_not(empty);
+}
+
+/* Does the stencil band node "node" satisfy the preconditions
+ * of split and overlapped tiling and, if not, set *reason
+ * to a description of why not?
+ */
+static isl_bool can_tile_stencil(struct ppcg_scop *scop,
+	__isl_keep isl_schedule_node *node, const char **reason)
+{
+	isl_bool ok;
+
+	ok = has_plain_affine_members(node);
+	if (ok < 0 || !ok) {
+		*reason = "stencil band members are not plain affine";
+		return ok;
+	}
+	ok = has_instances(scop, node);
+	if (ok < 0 || !ok) {
+		*reason = "stencil band has no instances in the context";
+		return ok;
+	}
+
+	return isl_bool_true;
+}
+
+/* Choose the kind of tiling to apply to the band node "node"
+ * and store it in *type, along with a short description of the reason
+ * for this choice in *reason.
+ *
+ * If "allow_hybrid" is set and "node" together with its parent
+ * has the input pattern of hybrid tiling, i.e., a time dimension
+ * in the parent band followed by the space dimensions in "node",
+ * then hybrid hexagonal tiling is chosen.
+ * The caller is still responsible for checking that the dependence
+ * distances are sufficiently bounded for hybrid tiling to apply.
+ * Otherwise, if "node" represents a stencil computation
+ * that satisfies the preconditions of split and overlapped tiling,
+ * then overlapped tiling is chosen if the band contains
+ * a single statement and split tiling if it contains several.
+ * In all other cases, plain rectangular tiling is chosen.
+ */
+isl_stat ppcg_stencil_choose_tiling(struct ppcg_scop *scop,
+	__isl_keep isl_schedule_node *node, int allow_hybrid,
+	enum ppcg_tiling_type *type, const char **reason)
+{
+	isl_bool stencil;
+	isl_union_set *domain;
+	int n;
+
+	*type = ppcg_tiling_rectangular;
+	if (allow_hybrid) {
+		isl_bool hybrid;
+
+		hybrid = ppcg_ht_parent_has_input_pattern(node);
+		if (hybrid < 0)
+			return isl_stat_error;
+		if (hybrid) {
+			*type = ppcg_tiling_hybrid;
+			*reason = "time dimension in parent band";
+			return isl_stat_ok;
+		}
+	}
+
+	stencil = is_stencil(scop, node, reason);
+	if (stencil >= 0 && stencil)
+		stencil = can_tile_stencil(scop, node, reason);
+	if (stencil < 0)
+		return isl_stat_error;
+	if (!stencil)
+		return isl_stat_ok;
+
+	domain = isl_schedule_node_get_domain(node);
+	n = isl_union_set_n_set(domain);
+	isl_union_set_free(domain);
+	if (n == 1) {
+		*type = ppcg_tiling_overlapped;
+		*reason = "single statement stencil";
+	} else {
+		*type = ppcg_tiling_split;
+		*reason = "multiple statement stencil";
+	}
+
+	return isl_stat_ok;
+}
+
+/* Report the choice "type" of tiling for the band node "node"
+ * with reason "reason".
+ */
+void ppcg_stencil_report_tiling(__isl_keep isl_schedule_node *node,
+	enum ppcg_tiling_type type, const char *reason)
+{
+	static const char *name[] = {
+		[ppcg_tiling_rectangular] = "rectangular",
+		[ppcg_tiling_split] = "split",
+		[ppcg_tiling_overlapped] = "overlapped",
+		[ppcg_tiling_hybrid] = "hybrid",
+	};
+	isl_ctx *ctx;
+	isl_printer *p;
+	isl_multi_union_pw_aff *mupa;
+
+	ctx = isl_schedule_node_get_ctx(node);
+	mupa = isl_schedule_node_band_get_partial_schedule(node);
+	p = isl_printer_to_file(ctx, stdout);
+	p = isl_printer_print_str(p, "Band ");
+	p = isl_printer_print_multi_union_pw_aff(p, mupa);
+	p = isl_printer_print_str(p, " uses ");
+	p = isl_printer_print_str(p, name[type]);
+	p = isl_printer_print_str(p, " tiling: ");
+	p = isl_printer_print_str(p, reason);
+	p = isl_printer_end_line(p);
+	isl_printer_free(p);
+	isl_multi_union_pw_aff_free(mupa);
+}
@@ -0,0 +1,24 @@
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <isl/schedule_node.h>
+
+#include "ppcg.h"
+
+/* The kinds of tiling that can be selected for a band
+ * by ppcg_stencil_choose_tiling.
+ */
+enum ppcg_tiling_type {
+	ppcg_tiling_rectangular,
+	ppcg_tiling_split,
+	ppcg_tiling_overlapped,
+	ppcg_tiling_hybrid
+};
+
+isl_stat ppcg_stencil_choose_tiling(struct ppcg_scop *scop,
+	__isl_keep isl_schedule_node *node, int allow_hybrid,
+	enum ppcg_tiling_type *type, const char **reason);
+void ppcg_stencil_report_tiling(__isl_keep isl_schedule_node *node,
+	enum ppcg_tiling_type type, const char *reason);
+
+#endif
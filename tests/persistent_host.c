@@ -0,0 +1,33 @@
+#include <stdlib.h>
+
+#define N 100
+
+/* The first statement is not part of any loop and is therefore
+ * executed on the host, before the kernel that reads its result.
+ */
+static void f(int A[N], int B[N], int v)
+{
+#pragma scop
+	A[0] = v;
+	for (int i = 0; i < N; ++i)
+		B[i] = A[i] + 1;
+#pragma endscop
+}
+
+int main()
+{
+	int A[N], B[N];
+
+	for (int i = 0; i < N; ++i)
+		A[i] = i;
+	for (int v = 1; v <= 2; ++v) {
+		f(A, B, v);
+		if (B[0] != v + 1)
+			return EXIT_FAILURE;
+		for (int i = 1; i < N; ++i)
+			if (B[i] != i + 1)
+				return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
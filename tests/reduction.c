@@ -0,0 +1,50 @@
+#include <stdlib.h>
+
+#define N 100
+#define M 20
+
+int main()
+{
+	int A[N], B[N], C[M];
+	int s1 = 0, s2 = 0, p = 1, t = 0, v = 0;
+	int s1_ref = 0, s2_ref = 0, p_ref = 1, t_ref = 0, v_ref = 0;
+
+	for (int i = 0; i < N; ++i)
+		A[i] = i % 13;
+	for (int i = 0; i < M; ++i)
+		C[i] = 1 + i % 2;
+#pragma scop
+	for (int i = 0; i < N; ++i)
+		s1 += A[i];
+	for (int i = 0; i < N; ++i)
+		s2 -= A[i];
+	for (int i = 0; i < M; ++i)
+		p = p * C[i];
+	for (int i = 0; i < N; ++i) {
+		t += A[i];
+		B[i] = t;
+	}
+	for (int i = 0; i < M; ++i) {
+		v += A[i];
+		v ^= C[i];
+	}
+#pragma endscop
+	for (int i = 0; i < N; ++i) {
+		s1_ref += A[i];
+		s2_ref -= A[i];
+		t_ref += A[i];
+		if (B[i] != t_ref)
+			return EXIT_FAILURE;
+	}
+	for (int i = 0; i < M; ++i) {
+		p_ref = p_ref * C[i];
+		v_ref += A[i];
+		v_ref ^= C[i];
+	}
+	if (s1 != s1_ref || s2 != s2_ref || p != p_ref)
+		return EXIT_FAILURE;
+	if (t != t_ref || v != v_ref)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
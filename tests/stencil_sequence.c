@@ -0,0 +1,38 @@
+#include <stdlib.h>
+
+#define T 10
+#define N 100
+
+int main()
+{
+	int A[T + 1][N], B[T + 1][N];
+	int A_ref[T + 1][N], B_ref[T + 1][N];
+
+	for (int t = 0; t <= T; ++t)
+		for (int i = 0; i < N; ++i) {
+			A[t][i] = A_ref[t][i] = t == 0 ? i % 7 : 0;
+			B[t][i] = B_ref[t][i] = t == 0 ? i % 5 : 0;
+		}
+#pragma scop
+	for (int t = 0; t < T; ++t)
+		for (int i = 1; i < N - 1; ++i)
+			A[t + 1][i] = A[t][i - 1] + A[t][i] + A[t][i + 1];
+	for (int t = 0; t < T; ++t)
+		for (int i = 1; i < N - 1; ++i)
+			B[t + 1][i] = B[t][i - 1] + B[t][i + 1] + A[T][i];
+#pragma endscop
+	for (int t = 0; t < T; ++t)
+		for (int i = 1; i < N - 1; ++i)
+			A_ref[t + 1][i] = A_ref[t][i - 1] + A_ref[t][i] +
+					A_ref[t][i + 1];
+	for (int t = 0; t < T; ++t)
+		for (int i = 1; i < N - 1; ++i)
+			B_ref[t + 1][i] = B_ref[t][i - 1] + B_ref[t][i + 1] +
+					A_ref[T][i];
+	for (int t = 0; t <= T; ++t)
+		for (int i = 0; i < N; ++i)
+			if (A[t][i] != A_ref[t][i] || B[t][i] != B_ref[t][i])
+				return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
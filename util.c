@@ -10,6 +10,7 @@
 #include <isl/space.h>
 #include <isl/val.h>
 #include <isl/aff.h>
+#include <isl/ilp.h>
 #include <isl/set.h>
 
 #include "util.h"
@@ -103,3 +104,43 @@ __isl_give isl_multi_pw_aff *ppcg_size_from_extent(__isl_take isl_set *set)
 
 	return mpa;
 }
+
+/* Return the number of values that dimension "pos" of "set" attains
+ * as a function of the parameters, i.e., the difference between
+ * the maximal and the minimal value plus one.
+ */
+__isl_give isl_pw_aff *ppcg_set_dim_extent(__isl_take isl_set *set, int pos)
+{
+	isl_space *space;
+	isl_aff *one;
+	isl_pw_aff *max, *min;
+
+	max = isl_set_dim_max(isl_set_copy(set), pos);
+	min = isl_set_dim_min(set, pos);
+	space = isl_pw_aff_get_domain_space(max);
+	one = isl_aff_zero_on_domain(isl_local_space_from_space(space));
+	one = isl_aff_add_constant_si(one, 1);
+	max = isl_pw_aff_add(max, isl_pw_aff_from_aff(one));
+
+	return isl_pw_aff_sub(max, min);
+}
+
+/* Return the maximal value attained by "pa" over its domain,
+ * or infinity if "pa" is not bounded from above.
+ */
+__isl_give isl_val *ppcg_pw_aff_max_val(__isl_take isl_pw_aff *pa)
+{
+	isl_set *set;
+	isl_aff *obj;
+	isl_val *v;
+
+	set = isl_set_from_pw_aff(pa);
+	obj = isl_aff_var_on_domain(
+		isl_local_space_from_space(isl_set_get_space(set)),
+		isl_dim_set, 0);
+	v = isl_set_max_val(set, obj);
+	isl_aff_free(obj);
+	isl_set_free(set);
+
+	return v;
+}
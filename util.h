@@ -5,6 +5,7 @@
 
 #include <isl/space.h>
 #include <isl/val.h>
+#include <isl/aff.h>
 
 /* Compare the prefix of "s" to "prefix" up to the length of "prefix".
  */
@@ -18,5 +19,7 @@ __isl_give isl_multi_val *ppcg_multi_val_from_int(__isl_take isl_space *space,
 __isl_give isl_multi_val *ppcg_multi_val_from_int_list(
 	__isl_take isl_space *space, int *list);
 __isl_give isl_multi_pw_aff *ppcg_size_from_extent(__isl_take isl_set *set);
+__isl_give isl_pw_aff *ppcg_set_dim_extent(__isl_take isl_set *set, int pos);
+__isl_give isl_val *ppcg_pw_aff_max_val(__isl_take isl_pw_aff *pa);
 
 #endif